@@ -1,4 +1,5 @@
 #define PCF8575_SUPPORT
+#define CONFIG_SUPPORT // Keeps the encoder counters over a reboot
 #include "Panel.h"
 
 
@@ -237,6 +237,277 @@ private:
 #endif // #ifdef PCF8575_SUPPORT
 
 
+//
+// CONFIG_SUPPORT
+// Small key/value store in EEPROM, for settings that should survive
+// a reboot. Values are read from a RAM cache, and writes are spread
+// over the whole area.
+//
+#ifdef CONFIG_SUPPORT
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+// EEPROM area, in 16 byte records, all of a 328P's 1KB by default
+#ifndef CONFIG_BASE
+#define CONFIG_BASE 0
+#endif
+#ifndef CONFIG_SLOTS
+#define CONFIG_SLOTS 64
+#endif
+
+// Keys kept, each takes 20 bytes of RAM
+#ifndef CONFIG_MAX
+#define CONFIG_MAX 8
+#endif
+
+// Milliseconds a changed value has to stay put before it's written,
+// so something like an encoder being spun costs one write, not dozens.
+// Each key settles on its own, so a busy one can't hold up the rest.
+#ifndef CONFIG_SETTLE_MS
+#define CONFIG_SETTLE_MS 5000
+#endif
+
+#if CONFIG_MAX >= CONFIG_SLOTS
+#error "CONFIG_SLOTS must be more than CONFIG_MAX"
+#endif
+
+#define CONFIG_KEY_LEN 9
+
+// Writes a record may fall behind before it's rewritten, well inside
+// the 32768 the sequence numbers can be compared over
+#define CONFIG_REFRESH 8192
+
+#define CONFIG_NIL 0xFF
+
+typedef struct config_record {
+  int32_t value;
+  uint16_t seq;
+  char key[CONFIG_KEY_LEN];  // NUL padded, not terminated when full
+  uint8_t crc;
+} config_record_t;
+
+typedef struct config_entry {
+  char key[CONFIG_KEY_LEN + 1];
+  int32_t value;
+  uint8_t slot;  // Record holding the value, CONFIG_NIL until written
+  bool dirty;
+  tick due;      // When a dirty value has settled
+} config_entry_t;
+
+/*
+ * Log structured store
+ *
+ * Every write is a whole new record, put in the next slot round the
+ * area that doesn't hold the current record of any key, so the cells
+ * wear evenly and a write cut short by a power loss (caught by the
+ * CRC) still leaves the previous value. The newest sequence number
+ * tells setup where writing left off, and which record of a key is
+ * current. A record skipped over for too long is rewritten, to keep
+ * the sequence numbers in range of each other.
+ */
+config_entry_t CONFIG[CONFIG_MAX];
+uint8_t CONFIG_COUNT = 0;
+uint8_t CONFIG_HEAD = 0;  // Next slot to try
+uint16_t CONFIG_SEQ = 0;
+
+int config_addr(uint8_t slot) {
+  return CONFIG_BASE + (slot * sizeof(config_record_t));
+}
+
+uint8_t config_crc(config_record_t* r) {
+  uint8_t* p = (uint8_t*)r;
+  uint8_t crc = 0;
+  uint8_t i;
+
+  for (i = 0; i < offsetof(config_record_t, crc); i++)
+    crc = _crc8_ccitt_update(crc, p[i]);
+
+  return crc;
+}
+
+bool config_read(uint8_t slot, config_record_t* r) {
+  EEPROM.get(config_addr(slot), *r);
+
+  // Erased cells read 0xFF
+  return (r->key[0] != '\0') && ((uint8_t)r->key[0] != 0xFF)
+         && (config_crc(r) == r->crc);
+}
+
+uint16_t config_seq(uint8_t slot) {
+  uint16_t seq;
+
+  EEPROM.get(config_addr(slot) + offsetof(config_record_t, seq), seq);
+  return seq;
+}
+
+uint8_t config_find(const char* key) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (strncmp(CONFIG[i].key, key, CONFIG_KEY_LEN) == 0)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+// Key whose current record is in slot
+uint8_t config_owner(uint8_t slot) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (CONFIG[i].slot == slot)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+uint8_t config_add(const char* key) {
+  config_entry_t* e;
+
+  if ((CONFIG_COUNT >= CONFIG_MAX) || (strlen(key) > CONFIG_KEY_LEN))
+    return CONFIG_NIL;
+
+  e = &CONFIG[CONFIG_COUNT];
+  memset(e, 0, sizeof(config_entry_t));
+  strncpy(e->key, key, CONFIG_KEY_LEN);
+  e->slot = CONFIG_NIL;
+
+  return CONFIG_COUNT++;
+}
+
+// Fill the cache, called by Panel::setup() before any component
+void config_setup() {
+  config_record_t r;
+  uint8_t newest = CONFIG_NIL;
+  uint8_t slot;
+  uint8_t i;
+
+  for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!config_read(slot, &r))
+      continue;
+
+    if ((newest == CONFIG_NIL) || ((int16_t)(r.seq - CONFIG_SEQ) > 0)) {
+      newest = slot;
+      CONFIG_SEQ = r.seq;
+    }
+
+    // Several records of a key, the newest is the one
+    i = config_find(r.key);
+    if (i == CONFIG_NIL) {
+      char key[CONFIG_KEY_LEN + 1];
+
+      memcpy(key, r.key, CONFIG_KEY_LEN);
+      key[CONFIG_KEY_LEN] = '\0';
+      i = config_add(key);
+      if (i == CONFIG_NIL)
+        continue;
+
+    } else if ((int16_t)(r.seq - config_seq(CONFIG[i].slot)) < 0) {
+      continue;
+    }
+
+    CONFIG[i].value = r.value;
+    CONFIG[i].slot = slot;
+  }
+
+  if (newest != CONFIG_NIL) {
+    CONFIG_HEAD = (newest + 1) % CONFIG_SLOTS;
+    CONFIG_SEQ++;
+  }
+}
+
+void config_write(uint8_t i) {
+  config_record_t r;
+  uint8_t* p = (uint8_t*)&r;
+  uint8_t slot;
+  uint8_t owner;
+  uint8_t b;
+  int addr;
+
+  // There's always a free slot, CONFIG_MAX is under CONFIG_SLOTS
+  for (;;) {
+    slot = CONFIG_HEAD;
+    CONFIG_HEAD = (CONFIG_HEAD + 1) % CONFIG_SLOTS;
+
+    owner = config_owner(slot);
+    if (owner == CONFIG_NIL)
+      break;
+
+    if ((uint16_t)(CONFIG_SEQ - config_seq(slot)) > CONFIG_REFRESH) {
+      CONFIG[owner].dirty = true;
+      CONFIG[owner].due = GLOBAL_TC;
+    }
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.seq = CONFIG_SEQ++;
+  strncpy(r.key, CONFIG[i].key, CONFIG_KEY_LEN);
+  r.value = CONFIG[i].value;
+  r.crc = config_crc(&r);
+
+  addr = config_addr(slot);
+  for (b = 0; b < sizeof(r); b++)
+    EEPROM.update(addr + b, p[b]);
+
+  CONFIG[i].slot = slot;
+  CONFIG[i].dirty = false;
+}
+
+// Write out one changed value that has settled. A record is 16
+// blocking EEPROM writes, about 55ms, so each loop() only pays for one.
+void config_flush() {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (CONFIG[i].dirty && is_tc_alert(CONFIG[i].due)) {
+      config_write(i);
+      return;
+    }
+  }
+}
+
+bool config_get(const char* key, int32_t* value) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL)
+    return false;
+
+  *value = CONFIG[i].value;
+  return true;
+}
+
+// False when the key is too long, or there's no room for it.
+// now skips the settle time, the value goes out on the next loop().
+bool config_set(const char* key, int32_t value, bool now = false) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL) {
+    i = config_add(key);
+    if (i == CONFIG_NIL)
+      return false;
+
+  } else if ((CONFIG[i].value == value) && !CONFIG[i].dirty) {
+    return true;
+  }
+
+  CONFIG[i].value = value;
+  CONFIG[i].dirty = true;
+  CONFIG[i].due = now ? GLOBAL_TC : get_tc_alert(CONFIG_SETTLE_MS);
+
+  return true;
+}
+
+#endif // #ifdef CONFIG_SUPPORT
+
+
 /*
  * Components
  */
@@ -287,6 +558,36 @@ public:
     this->id = id;
     this->type = type;
   }
+
+#ifdef CONFIG_SUPPORT
+  // Keep a value over a reboot, under the component's id, or
+  // "<id>.<n>" for one of several. Written once it has settled.
+  bool persist(int32_t value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_set(key, value);
+  }
+
+  // Value persisted before the last reboot, false if there isn't one
+  bool restore(int32_t* value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_get(key, value);
+  }
+
+private:
+  // False when the key would be too long
+  bool config_key(char* key, size_t len, int8_t n) {
+    int used;
+
+    if (n < 0)
+      used = snprintf(key, len, "%s", id);
+    else
+      used = snprintf(key, len, "%s.%d", id, n);
+
+    return used <= CONFIG_KEY_LEN;
+  }
+#endif
 };
 
 class InputComponent : public Component {
@@ -474,6 +775,10 @@ public:
         _lcd->noBacklight();
       }
 
+#ifdef CONFIG_SUPPORT
+      persist(_backlight);
+#endif
+
       return "ACK";
     }
 
@@ -530,6 +835,18 @@ public:
     // _lcd->backlight(); // Enable backlight by default?
     _backlight = true;  
 
+#ifdef CONFIG_SUPPORT
+    int32_t backlight;
+
+    if (restore(&backlight)) {
+      _backlight = backlight;
+      if (_backlight)
+        _lcd->backlight();
+      else
+        _lcd->noBacklight();
+    }
+#endif
+
     return true;
   }
 
@@ -809,6 +1126,10 @@ public:
         _counter--;
         _dir = "LEFT";
       }
+
+#ifdef CONFIG_SUPPORT
+      persist(_counter);
+#endif
     }
     _lastStateCLK = _currentStateCLK;
 
@@ -820,6 +1141,13 @@ public:
   }
 
   bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t counter;
+
+    if (restore(&counter))
+      _counter = counter;
+#endif
+
     _clk->setup();
     _dt->setup();
 
@@ -975,6 +1303,11 @@ public:
   bool setup() {
     int i;
 
+#ifdef CONFIG_SUPPORT
+    // Components restore their settings in setup()
+    config_setup();
+#endif
+
     for (i = 0; inputs[i]; i++)
       if (!inputs[i]->setup())
         return false;
@@ -1006,6 +1339,9 @@ char* com_prot_desc(Panel*, char*);
 char* com_prot_ping(Panel*, char*);
 char* com_prot_set(Panel*, char*);
 char* com_prot_get(Panel*, char*);
+#ifdef CONFIG_SUPPORT
+char* com_prot_config(Panel*, char*);
+#endif
 
 /* List of commands */
 cmd_t command[] = {
@@ -1015,6 +1351,9 @@ cmd_t command[] = {
   { "DESC", com_prot_desc },
   { "SET", com_prot_set },
   { "GET", com_prot_get },
+#ifdef CONFIG_SUPPORT
+  { "CONFIG", com_prot_config },
+#endif
   { 0 }
 };
 
@@ -1070,6 +1409,11 @@ bool Panel::loop() {
   for (i = 0; outputs[i]; i++)
     outputs[i]->update();
 
+#ifdef CONFIG_SUPPORT
+  // Write out settings that have stopped changing
+  config_flush();
+#endif
+
   // Check Serial
   if (Serial.available() > 0) {
     char* cmd;
@@ -1185,4 +1529,60 @@ char* com_prot_get(Panel* panel, char* args) {
   return "ACK";
 }
 
+#ifdef CONFIG_SUPPORT
+// "CONFIG LIST" (or just CONFIG) prints every stored key and value,
+// "CONFIG GET <key>" one of them, and "CONFIG SET <key> <value>"
+// stores a value without waiting for it to settle. Components read
+// theirs in setup(), so a SET reaches them on the next boot.
+char* com_prot_config(Panel* panel, char* args) {
+  uint8_t i;
+  int32_t value;
+  char* opt = NULL;
+  char* key = NULL;
+  char* value_str = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (!opt || (strcasecmp(opt, "LIST") == 0)) {
+    for (i = 0; i < CONFIG_COUNT; i++) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", CONFIG[i].key, CONFIG[i].value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    return "ACK";
+  }
+
+  key = params ? pop_token(params, &params) : NULL;
+
+  if (strcasecmp(opt, "GET") == 0) {
+    if (!key)
+      return "ERR\tCONFIG GET needs a key";
+
+    if (!config_get(key, &value))
+      return "ERR\tCONFIG key not found";
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", key, value);
+    Serial.println(panel->buf);
+    Serial.flush();
+    return "ACK";
+  }
+
+  if (strcasecmp(opt, "SET") == 0) {
+    value_str = params ? pop_token(params, NULL) : NULL;
+    if (!key || !value_str)
+      return "ERR\tCONFIG SET needs key and value";
+
+    if (!config_set(key, atol(value_str), true))
+      return "ERR\tCONFIG SET key too long or store full";
+
+    return "ACK";
+  }
+
+  return "ERR\tCONFIG wanted LIST, GET or SET";
+}
+#endif
+
 #endif
@@ -1,6 +1,8 @@
 #define MHZ19_SUPPORT
 #define SSFD_SUPPORT
 #define DHT_SUPPORT
+#define HIST_SUPPORT
+#define CONFIG_SUPPORT // Keeps the SSFD brightness over a reboot
 #include "Panel.h"
 
 // Number of milliseconds between poll events
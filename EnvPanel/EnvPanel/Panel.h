@@ -241,6 +241,479 @@ private:
 #endif // #ifdef PCF8575_SUPPORT
 
 
+//
+// HIST_SUPPORT
+// Sensor readings are kept in small on-device histories, so a host
+// that reconnects can fill in what it missed with HIST <comp> [n].
+//
+#ifdef HIST_SUPPORT
+
+// Slots per history, a sample takes one, plus one each for a big jump
+// or a long gap
+#ifndef HIST_SLOTS
+#define HIST_SLOTS 32
+#endif
+
+// At most one sample per history in this time
+#ifndef HIST_PERIOD_MS
+#define HIST_PERIOD_MS 60000
+#endif
+
+// Marks a delta too big for a slot, the next slot holds all 16 bits
+#define HIST_ESCAPE -128
+
+// Marks a gap too long for a slot, it's held in the slot after any
+// value escape: seconds, or minutes with the top bit set
+#define HIST_LONG_GAP 255
+
+typedef union hist_slot {
+  struct {
+    int8_t dv;  // Change from the sample before
+    uint8_t dt;  // Seconds since the sample before
+  } d;
+  int16_t raw;
+} hist_slot_t;
+
+int16_t hist_gap_encode(uint32_t dt) {
+  if (dt < 0x8000)
+    return dt;
+
+  return 0x8000 | min(dt / 60, 0x7FFFUL);
+}
+
+uint32_t hist_gap_decode(int16_t raw) {
+  uint16_t gap = raw;
+
+  if (gap & 0x8000)
+    return (uint32_t)(gap & 0x7FFF) * 60;
+
+  return gap;
+}
+
+/*
+ * Delta encoded ring of samples
+ *
+ * Only the oldest value is stored whole (_base), every sample holds its
+ * change in value and time from the one before it. When the ring is
+ * full the oldest sample is dropped and the next one's delta is folded
+ * into _base. Ages are counted back from the newest sample.
+ */
+class History {
+public:
+  char* name;
+
+  History(char* name) {
+    this->name = name;
+  }
+
+  // Whether a new sample would be kept
+  bool due() {
+    return !_count || is_tc_alert(_next);
+  }
+
+  void add(int16_t value) {
+    int16_t dv = value - _last;
+    uint32_t dt = (GLOBAL_TC - _last_tc) / 1000;
+    hist_slot_t slot;
+    bool big;
+
+    if (!_count) {
+      _base = value;
+      dv = 0;
+      dt = 0;
+    }
+
+    big = (dv > 127 || dv < -127);
+    slot.d.dv = big ? HIST_ESCAPE : dv;
+    slot.d.dt = min(dt, (uint32_t)HIST_LONG_GAP);
+    push(slot, 1 + big + (dt >= HIST_LONG_GAP));
+
+    if (big) {
+      slot.raw = dv;
+      push(slot, 1);
+    }
+
+    if (dt >= HIST_LONG_GAP) {
+      slot.raw = hist_gap_encode(dt);
+      push(slot, 1);
+    }
+
+    _count++;
+    _last = value;
+    _last_tc = GLOBAL_TC;
+    _next = get_tc_alert(HIST_PERIOD_MS);
+  }
+
+  uint8_t count() {
+    return _count;
+  }
+
+  // Seconds since the newest sample
+  uint32_t age() {
+    return (GLOBAL_TC - _last_tc) / 1000;
+  }
+
+  // Seconds between the oldest and newest of the last n samples
+  uint32_t span(uint8_t n) {
+    int16_t value;
+    uint32_t dt;
+    uint8_t i;
+    uint32_t total = 0;
+
+    rewind();
+    for (i = 0; next(&value, &dt); i++)
+      if (i > _count - n)
+        total += dt;
+
+    return total;
+  }
+
+  // Walk the samples oldest first, rewind() then next() until false
+  void rewind() {
+    _pos = 0;
+    _value = _base;
+  }
+
+  bool next(int16_t* value, uint32_t* dt) {
+    hist_slot_t slot;
+    int16_t dv;
+    bool oldest = (_pos == 0);
+
+    if (_pos >= _used)
+      return false;
+
+    slot = _slots[(_head + _pos++) % HIST_SLOTS];
+    dv = slot.d.dv;
+    *dt = slot.d.dt;
+
+    if (slot.d.dv == HIST_ESCAPE)
+      dv = _slots[(_head + _pos++) % HIST_SLOTS].raw;
+
+    if (slot.d.dt == HIST_LONG_GAP)
+      *dt = hist_gap_decode(_slots[(_head + _pos++) % HIST_SLOTS].raw);
+
+    // The oldest sample's delta was folded into _base when the one
+    // before it was dropped
+    if (!oldest)
+      _value += dv;
+
+    *value = _value;
+    return true;
+  }
+
+private:
+  void push(hist_slot_t slot, uint8_t need) {
+    while (_used + need > HIST_SLOTS)
+      drop();
+
+    _slots[(_head + _used++) % HIST_SLOTS] = slot;
+  }
+
+  void drop() {
+    int16_t value;
+    uint32_t dt;
+
+    // Step past the oldest, then the new oldest value becomes the base
+    rewind();
+    next(&value, &dt);
+    _head = (_head + _pos) % HIST_SLOTS;
+    _used -= _pos;
+    _count--;
+
+    if (_used) {
+      hist_slot_t slot = _slots[_head];
+      _base += (slot.d.dv == HIST_ESCAPE) ? _slots[(_head + 1) % HIST_SLOTS].raw : slot.d.dv;
+    }
+  }
+
+  hist_slot_t _slots[HIST_SLOTS];
+  uint8_t _head = 0;   // Oldest slot
+  uint8_t _used = 0;   // Slots in use
+  uint8_t _count = 0;  // Samples, escapes take extra slots
+  int16_t _base = 0;   // Value of the oldest sample
+  int16_t _last = 0;   // Value of the newest sample
+  tick _last_tc = 0;
+  tick _next = 0;
+
+  // Walk position
+  uint8_t _pos = 0;
+  int16_t _value = 0;
+};
+
+#endif // #ifdef HIST_SUPPORT
+
+
+//
+// CONFIG_SUPPORT
+// Small key/value store in EEPROM, for settings that should survive
+// a reboot. Values are read from a RAM cache, and writes are spread
+// over the whole area.
+//
+#ifdef CONFIG_SUPPORT
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+// EEPROM area, in 16 byte records, all of a 328P's 1KB by default
+#ifndef CONFIG_BASE
+#define CONFIG_BASE 0
+#endif
+#ifndef CONFIG_SLOTS
+#define CONFIG_SLOTS 64
+#endif
+
+// Keys kept, each takes 20 bytes of RAM
+#ifndef CONFIG_MAX
+#define CONFIG_MAX 8
+#endif
+
+// Milliseconds a changed value has to stay put before it's written,
+// so something like an encoder being spun costs one write, not dozens.
+// Each key settles on its own, so a busy one can't hold up the rest.
+#ifndef CONFIG_SETTLE_MS
+#define CONFIG_SETTLE_MS 5000
+#endif
+
+#if CONFIG_MAX >= CONFIG_SLOTS
+#error "CONFIG_SLOTS must be more than CONFIG_MAX"
+#endif
+
+#define CONFIG_KEY_LEN 9
+
+// Writes a record may fall behind before it's rewritten, well inside
+// the 32768 the sequence numbers can be compared over
+#define CONFIG_REFRESH 8192
+
+#define CONFIG_NIL 0xFF
+
+typedef struct config_record {
+  int32_t value;
+  uint16_t seq;
+  char key[CONFIG_KEY_LEN];  // NUL padded, not terminated when full
+  uint8_t crc;
+} config_record_t;
+
+typedef struct config_entry {
+  char key[CONFIG_KEY_LEN + 1];
+  int32_t value;
+  uint8_t slot;  // Record holding the value, CONFIG_NIL until written
+  bool dirty;
+  tick due;      // When a dirty value has settled
+} config_entry_t;
+
+/*
+ * Log structured store
+ *
+ * Every write is a whole new record, put in the next slot round the
+ * area that doesn't hold the current record of any key, so the cells
+ * wear evenly and a write cut short by a power loss (caught by the
+ * CRC) still leaves the previous value. The newest sequence number
+ * tells setup where writing left off, and which record of a key is
+ * current. A record skipped over for too long is rewritten, to keep
+ * the sequence numbers in range of each other.
+ */
+config_entry_t CONFIG[CONFIG_MAX];
+uint8_t CONFIG_COUNT = 0;
+uint8_t CONFIG_HEAD = 0;  // Next slot to try
+uint16_t CONFIG_SEQ = 0;
+
+int config_addr(uint8_t slot) {
+  return CONFIG_BASE + (slot * sizeof(config_record_t));
+}
+
+uint8_t config_crc(config_record_t* r) {
+  uint8_t* p = (uint8_t*)r;
+  uint8_t crc = 0;
+  uint8_t i;
+
+  for (i = 0; i < offsetof(config_record_t, crc); i++)
+    crc = _crc8_ccitt_update(crc, p[i]);
+
+  return crc;
+}
+
+bool config_read(uint8_t slot, config_record_t* r) {
+  EEPROM.get(config_addr(slot), *r);
+
+  // Erased cells read 0xFF
+  return (r->key[0] != '\0') && ((uint8_t)r->key[0] != 0xFF)
+         && (config_crc(r) == r->crc);
+}
+
+uint16_t config_seq(uint8_t slot) {
+  uint16_t seq;
+
+  EEPROM.get(config_addr(slot) + offsetof(config_record_t, seq), seq);
+  return seq;
+}
+
+uint8_t config_find(const char* key) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (strncmp(CONFIG[i].key, key, CONFIG_KEY_LEN) == 0)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+// Key whose current record is in slot
+uint8_t config_owner(uint8_t slot) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (CONFIG[i].slot == slot)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+uint8_t config_add(const char* key) {
+  config_entry_t* e;
+
+  if ((CONFIG_COUNT >= CONFIG_MAX) || (strlen(key) > CONFIG_KEY_LEN))
+    return CONFIG_NIL;
+
+  e = &CONFIG[CONFIG_COUNT];
+  memset(e, 0, sizeof(config_entry_t));
+  strncpy(e->key, key, CONFIG_KEY_LEN);
+  e->slot = CONFIG_NIL;
+
+  return CONFIG_COUNT++;
+}
+
+// Fill the cache, called by Panel::setup() before any component
+void config_setup() {
+  config_record_t r;
+  uint8_t newest = CONFIG_NIL;
+  uint8_t slot;
+  uint8_t i;
+
+  for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!config_read(slot, &r))
+      continue;
+
+    if ((newest == CONFIG_NIL) || ((int16_t)(r.seq - CONFIG_SEQ) > 0)) {
+      newest = slot;
+      CONFIG_SEQ = r.seq;
+    }
+
+    // Several records of a key, the newest is the one
+    i = config_find(r.key);
+    if (i == CONFIG_NIL) {
+      char key[CONFIG_KEY_LEN + 1];
+
+      memcpy(key, r.key, CONFIG_KEY_LEN);
+      key[CONFIG_KEY_LEN] = '\0';
+      i = config_add(key);
+      if (i == CONFIG_NIL)
+        continue;
+
+    } else if ((int16_t)(r.seq - config_seq(CONFIG[i].slot)) < 0) {
+      continue;
+    }
+
+    CONFIG[i].value = r.value;
+    CONFIG[i].slot = slot;
+  }
+
+  if (newest != CONFIG_NIL) {
+    CONFIG_HEAD = (newest + 1) % CONFIG_SLOTS;
+    CONFIG_SEQ++;
+  }
+}
+
+void config_write(uint8_t i) {
+  config_record_t r;
+  uint8_t* p = (uint8_t*)&r;
+  uint8_t slot;
+  uint8_t owner;
+  uint8_t b;
+  int addr;
+
+  // There's always a free slot, CONFIG_MAX is under CONFIG_SLOTS
+  for (;;) {
+    slot = CONFIG_HEAD;
+    CONFIG_HEAD = (CONFIG_HEAD + 1) % CONFIG_SLOTS;
+
+    owner = config_owner(slot);
+    if (owner == CONFIG_NIL)
+      break;
+
+    if ((uint16_t)(CONFIG_SEQ - config_seq(slot)) > CONFIG_REFRESH) {
+      CONFIG[owner].dirty = true;
+      CONFIG[owner].due = GLOBAL_TC;
+    }
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.seq = CONFIG_SEQ++;
+  strncpy(r.key, CONFIG[i].key, CONFIG_KEY_LEN);
+  r.value = CONFIG[i].value;
+  r.crc = config_crc(&r);
+
+  addr = config_addr(slot);
+  for (b = 0; b < sizeof(r); b++)
+    EEPROM.update(addr + b, p[b]);
+
+  CONFIG[i].slot = slot;
+  CONFIG[i].dirty = false;
+}
+
+// Write out one changed value that has settled. A record is 16
+// blocking EEPROM writes, about 55ms, so each loop() only pays for one.
+void config_flush() {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (CONFIG[i].dirty && is_tc_alert(CONFIG[i].due)) {
+      config_write(i);
+      return;
+    }
+  }
+}
+
+bool config_get(const char* key, int32_t* value) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL)
+    return false;
+
+  *value = CONFIG[i].value;
+  return true;
+}
+
+// False when the key is too long, or there's no room for it.
+// now skips the settle time, the value goes out on the next loop().
+bool config_set(const char* key, int32_t value, bool now = false) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL) {
+    i = config_add(key);
+    if (i == CONFIG_NIL)
+      return false;
+
+  } else if ((CONFIG[i].value == value) && !CONFIG[i].dirty) {
+    return true;
+  }
+
+  CONFIG[i].value = value;
+  CONFIG[i].dirty = true;
+  CONFIG[i].due = now ? GLOBAL_TC : get_tc_alert(CONFIG_SETTLE_MS);
+
+  return true;
+}
+
+#endif // #ifdef CONFIG_SUPPORT
+
+
 /*
  * Components
  */
@@ -314,6 +787,36 @@ public:
     this->id = id;
     this->type = type;
   }
+
+#ifdef CONFIG_SUPPORT
+  // Keep a value over a reboot, under the component's id, or
+  // "<id>.<n>" for one of several. Written once it has settled.
+  bool persist(int32_t value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_set(key, value);
+  }
+
+  // Value persisted before the last reboot, false if there isn't one
+  bool restore(int32_t* value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_get(key, value);
+  }
+
+private:
+  // False when the key would be too long
+  bool config_key(char* key, size_t len, int8_t n) {
+    int used;
+
+    if (n < 0)
+      used = snprintf(key, len, "%s", id);
+    else
+      used = snprintf(key, len, "%s.%d", id, n);
+
+    return used <= CONFIG_KEY_LEN;
+  }
+#endif
 };
 
 class InputComponent : public Component {
@@ -325,6 +828,13 @@ public:
   // Is called every iteration of loop()
   // if returns true, getMessage() is returned as an EVENT
   virtual bool poll() = 0;
+
+#ifdef HIST_SUPPORT
+  // Histories kept by the component, NULL past the last one
+  virtual History* history(uint8_t i) {
+    return NULL;
+  }
+#endif
 };
 
 class OutputComponent : public Component {
@@ -460,6 +970,16 @@ private:
 #ifdef SSFD_SUPPORT
 #include <TM1637.h>
 
+#define SSFD_DIGITS 4
+
+// TM1637 commands
+#define TM1637_CMD_FIXED 0x44   // Write data to a fixed address
+#define TM1637_CMD_ADDR 0xC0    // Or'ed with the digit position
+#define TM1637_CMD_DISPLAY 0x88 // Display on, or'ed with brightness 0-7
+
+#define SSFD_SEG_BLANK 0x00
+#define SSFD_SEG_MINUS 0x40
+
 class SsfdComponent : public OutputComponent {
 public:
   SsfdComponent(char* id, uint8_t clock_pin, uint8_t data_pin)
@@ -468,6 +988,7 @@ public:
 
       // Init values
       this->_brightness = 1;
+      this->_valid = 0;
   }
 
   char* set(char* args) {
@@ -485,7 +1006,8 @@ public:
     // Clear the entire screen
     if(strcasecmp(line_num, "CLR") == 0) 
     {
-      _tm1637->clearDisplay();
+      for (pos_num = 0; pos_num < SSFD_DIGITS; pos_num++)
+        display_segments(pos_num, SSFD_SEG_BLANK);
 
       return "ACK";
     }
@@ -495,12 +1017,14 @@ public:
     {
       if(strcasecmp(params, "OFF") == 0) {
         this->_brightness = 0;
+        apply_brightness();
 
         return "ACK";
       }
 
       if(strcasecmp(params, "ONN") == 0) {
         this->_brightness = 1;
+        apply_brightness();
 
         return "ACK";
       }
@@ -510,6 +1034,7 @@ public:
           && (params[0] >= '0') 
           && (params[0] <= '7') ) {
         this->_brightness = params[0] - '0';
+        apply_brightness();
       }else{
         return "ERR Valid LIGHT values are 0-7";
       }
@@ -517,6 +1042,35 @@ public:
       return "ACK";
     }
 
+    // Whole value, right aligned, with the rest blank or 0 padded
+    if(strcasecmp(line_num, "NUM") == 0) 
+    {
+      pos = params ? pop_token(params, &output) : NULL;
+      if (!pos)
+        return "ERR SET NUM wanted value";
+
+      if (!display_number(atoi(pos), (output && output[0] == '0')))
+        return "ERR SET NUM value not between -999-9999";
+
+      return "ACK";
+    }
+
+    // Raw segment bits from position 1, e.g. RAW 0x76 0x79 0x38 0x73
+    if(strcasecmp(line_num, "RAW") == 0) 
+    {
+      for (pos_num = 0; params && pos_num < SSFD_DIGITS; pos_num++) {
+        pos = pop_token(params, &params);
+        if (!pos)
+          break;
+        display_segments(pos_num, strtol(pos, NULL, 0));
+      }
+
+      if (!pos_num)
+        return "ERR SET RAW wanted segment values";
+
+      return "ACK";
+    }
+
     // Treat it as a one digit line number
     switch (line_num[0]) {
       case '1':
@@ -553,17 +1107,29 @@ public:
   }
 
   bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t brightness;
+
+    if (restore(&brightness))
+      _brightness = constrain(brightness, 0, 7);
+#endif
+
     _tm1637->init();
     _tm1637->point(false);
     _tm1637->set(_brightness);
 
+    // init() blanks the digits through the library, so what the chip
+    // shows isn't known until each position is written
+    _valid = 0;
+    apply_brightness();
+
     return true;
   }
 
   // Display a single character at a given position
   // Supports numbers and a limited number of characters
   void display_digit(uint8_t pos, int8_t data) {
-    _tm1637->display(pos, data);
+    display_segments(pos, _tm1637->coding(data));
   }
 
   // Call with nolead = 0 to have in skip leading zeros
@@ -582,9 +1148,75 @@ public:
     }
   }
 
+  // Right aligned, unused positions are blanked or zero padded.
+  // Returns false if num doesn't fit.
+  bool display_number(int16_t num, bool zero_pad=false) {
+    uint8_t segs[SSFD_DIGITS];
+    bool negative = (num < 0);
+    uint16_t value = negative ? -num : num;
+    int8_t i;
+
+    if (num > 9999 || num < -999)
+      return false;
+
+    for (i = SSFD_DIGITS - 1; i >= 0; i--) {
+      if (value || zero_pad || i == (SSFD_DIGITS - 1))
+        segs[i] = _tm1637->coding(value % 10);
+      else
+        segs[i] = SSFD_SEG_BLANK;
+
+      value /= 10;
+    }
+
+    // The minus sign goes in front of the digits, or in place of the
+    // first padding zero. num >= -999 always leaves it a position.
+    if (negative) {
+      for (i = 0; !zero_pad && segs[i] == SSFD_SEG_BLANK; i++);
+      segs[zero_pad ? 0 : i - 1] = SSFD_SEG_MINUS;
+    }
+
+    for (i = 0; i < SSFD_DIGITS; i++)
+      display_segments(i, segs[i]);
+
+    return true;
+  }
+
+  // Write segment bits to a position, skipped when it already shows them
+  void display_segments(uint8_t pos, uint8_t segs) {
+    if (pos >= SSFD_DIGITS)
+      return;
+
+    if ((_valid & _BV(pos)) && _segs[pos] == segs)
+      return;
+
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_FIXED);
+    _tm1637->stop();
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_ADDR | pos);
+    _tm1637->writeByte(segs);
+    _tm1637->stop();
+
+    _segs[pos] = segs;
+    _valid |= _BV(pos);
+  }
+
 private:
   TM1637* _tm1637;
   uint8_t _brightness; // Value is 0-7
+  uint8_t _segs[SSFD_DIGITS]; // Last segments written to each position
+  uint8_t _valid; // Bit per position that _segs is known for
+
+  void apply_brightness() {
+    _tm1637->set(_brightness); // Keeps the library's own writes in step
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_DISPLAY | _brightness);
+    _tm1637->stop();
+
+#ifdef CONFIG_SUPPORT
+    persist(_brightness);
+#endif
+  }
 };
 
 
@@ -646,6 +1278,10 @@ public:
         _lcd->noBacklight();
       }
 
+#ifdef CONFIG_SUPPORT
+      persist(_backlight);
+#endif
+
       return "ACK";
     }
 
@@ -702,6 +1338,18 @@ public:
     // _lcd->backlight(); // Enable backlight by default?
     _backlight = true;  
 
+#ifdef CONFIG_SUPPORT
+    int32_t backlight;
+
+    if (restore(&backlight)) {
+      _backlight = backlight;
+      if (_backlight)
+        _lcd->backlight();
+      else
+        _lcd->noBacklight();
+    }
+#endif
+
     return true;
   }
 
@@ -719,75 +1367,402 @@ private:
 #endif // #ifdef LCD20X4_SUPPORT
 
 
+//
+// Pin change edge capture
+// Used by sensors that time their pulses in the background. Every
+// level change on a watched pin is handed to its EdgeListener, along
+// with a micros() timestamp, from the pin change interrupt. The
+// PCINT vectors belong to the capture, so SoftwareSerial can't be
+// used alongside it.
+//
+#if defined(MHZ19_SUPPORT) && !defined(MHZ19_UART_SUPPORT)
+#define EDGE_SUPPORT
+#endif
+#ifdef DHT_SUPPORT
+#define EDGE_SUPPORT
+#endif
+
+#ifdef EDGE_SUPPORT
+#include <avr/interrupt.h>
+
+// Maximum number of pins being watched
+#ifndef EDGE_MAX_PINS
+#define EDGE_MAX_PINS 4
+#endif
+
+class EdgeListener {
+public:
+  // Called from the interrupt, so keep it short
+  virtual void edge(bool level, uint32_t us) = 0;
+};
+
+typedef struct edge_pin {
+  volatile uint8_t* in;
+  uint8_t mask;
+  uint8_t group;  // PCICR bit, which vector the pin raises
+  uint8_t last;
+  EdgeListener* listener;
+} edge_pin_t;
+
+edge_pin_t EDGE_PINS[EDGE_MAX_PINS];
+volatile uint8_t EDGE_COUNT = 0;
+
+// Start watching a pin, false if it has no pin change interrupt or
+// we're full
+bool edge_watch(uint8_t pin, EdgeListener* listener) {
+  edge_pin_t* p;
+  volatile uint8_t* pcicr = digitalPinToPCICR(pin);
+
+  if (!pcicr || EDGE_COUNT >= EDGE_MAX_PINS)
+    return false;
+
+  p = &EDGE_PINS[EDGE_COUNT];
+  p->in = portInputRegister(digitalPinToPort(pin));
+  p->mask = digitalPinToBitMask(pin);
+  p->group = digitalPinToPCICRbit(pin);
+  p->last = *p->in & p->mask;
+  p->listener = listener;
+
+  noInterrupts();
+  EDGE_COUNT++;
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCIFR = _BV(p->group);
+  *pcicr |= _BV(p->group);
+  interrupts();
+
+  return true;
+}
+
+void edge_dispatch(uint8_t group) {
+  uint32_t now = micros();
+  edge_pin_t* p;
+  uint8_t level;
+  uint8_t i;
+
+  for (i = 0; i < EDGE_COUNT; i++) {
+    p = &EDGE_PINS[i];
+    if (p->group != group)
+      continue;
+
+    level = *p->in & p->mask;
+    if (level != p->last) {
+      p->last = level;
+      p->listener->edge(level, now);
+    }
+  }
+}
+
+ISR(PCINT0_vect) {
+  edge_dispatch(0);
+}
+
+ISR(PCINT1_vect) {
+  edge_dispatch(1);
+}
+
+ISR(PCINT2_vect) {
+  edge_dispatch(2);
+}
+
+#endif // #ifdef EDGE_SUPPORT
+
+
 //
 // MHZ19 (CO2) Sensor support
+// Read through the PWM output by default, or with MHZ19_UART_SUPPORT
+// through the serial interface on a Stream the sketch has started at
+// 9600 baud (SoftwareSerial, or a spare hardware UART).
 //
 #ifdef MHZ19_SUPPORT
 
+// Full scale the sensor is configured for
+#ifndef MHZ19_RANGE
+#define MHZ19_RANGE 5000
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+
+// Every command and reply is 9 bytes, 0xFF, command, data, checksum
+#define MHZ19_FRAME_LEN 9
+#define MHZ19_START 0xFF
+#define MHZ19_SENSOR 0x01
+
+#define MHZ19_CMD_READ 0x86
+#define MHZ19_CMD_ABC 0x79
+#define MHZ19_CMD_RANGE 0x99
+
+#define MHZ19_ABC_ONN 0xA0
+#define MHZ19_ABC_OFF 0x00
+
+#else
+
+// PWM output cycle is 1004ms, a 2ms high start, the reading, and a
+// 2ms low end; anything too far off that is a glitch
+#define MHZ19_PWM_CYCLE_MIN_US 900000UL
+#define MHZ19_PWM_CYCLE_MAX_US 1100000UL
+#define MHZ19_PWM_EDGE_US 2000UL
+
+#endif // #ifdef MHZ19_UART_SUPPORT
+
+/*
+ * PWM: the output is timed from pin change interrupts, each rising edge
+ * completes a cycle and the high time is kept, so poll() only has to
+ * turn the last complete cycle into ppm.
+ *
+ * UART: poll() sends a read command every interval, and picks the
+ * reply up a byte at a time as it arrives, dropping any frame that
+ * fails its checksum.
+ */
+#ifdef MHZ19_UART_SUPPORT
 class Mhz19Component : public InputComponent {
+public:
+  Mhz19Component(char* id, Stream* serial, uint32_t interval = 60000)
+    : InputComponent(id, mhz19_type) {
+      this->_serial = serial;
+      this->_interval = interval;
+      this->_co2 = 0;
+#ifdef HIST_SUPPORT
+      this->_hist = new History("CO2");
+#endif
+  }
+#else
+class Mhz19Component : public InputComponent, public EdgeListener {
 public:
   Mhz19Component(char* id, uint8_t pin, uint32_t interval = 60000)
     : InputComponent(id, mhz19_type) {
       this->_pin = pin;
       this->_interval = interval;
       this->_co2 = 0;
+#ifdef HIST_SUPPORT
+      this->_hist = new History("CO2");
+#endif
   }
+#endif
 
   bool poll() {
+    bool rc = false;
+    uint16_t co2;
+
+#ifdef MHZ19_UART_SUPPORT
+    if (readCO2UART(&co2))
+      rc = reading(co2);
 
-    // Update system details if it's time
+    // Ask for the next reading, the reply turns up on a later poll()
     if(is_tc_alert(_timer)) {
-      bool rc = false;
-      uint16_t co2 = readCO2PWM();
+      sendCommand(MHZ19_CMD_READ, 0, 0, 0);
+      _timer = get_tc_alert(_interval);
+    }
+#else
+    // Update system details if it's time. Nothing new from the sensor
+    // yet leaves the timer due, so the first cycle after boot is read
+    // as soon as it's captured
+    if(is_tc_alert(_timer) && readCO2PWM(&co2)) {
+      _timer = get_tc_alert(_interval);
+      rc = reading(co2);
+    }
+#endif
 
-      // Update state if something changed
-      if(co2 != _co2) {
-        _co2 = co2;
-        rc = true;
-      }
+    return rc;
+  }
 
-      // Reset timer
-      _timer = get_tc_alert(_interval);
+  // RANGE <ppm> sets the full scale, ABC ONN|OFF switches the sensor's
+  // automatic baseline correction (UART only)
+  char* set(char* args) {
+    char* cmd;
+    char* params;
+    char* value;
 
-      return rc;
+    cmd = pop_token(args, &params);
+    value = params ? pop_token(params, NULL) : NULL;
+    if (!cmd || !value)
+      return "ERR MHZ19 SET wanted RANGE or ABC and a value";
+
+    if (strcasecmp(cmd, "RANGE") == 0) {
+      uint16_t range = atol(value);
+
+      if (range < 1000)
+        return "ERR MHZ19 RANGE too small";
+
+      _range = range;
+#ifdef MHZ19_UART_SUPPORT
+      sendCommand(MHZ19_CMD_RANGE, 0, range >> 8, range & 0xFF);
+#endif
+      return "ACK";
     }
 
-    // No update
-    return false;
+#ifdef MHZ19_UART_SUPPORT
+    if (strcasecmp(cmd, "ABC") == 0) {
+      if (strcasecmp(value, "ONN") == 0)
+        sendCommand(MHZ19_CMD_ABC, MHZ19_ABC_ONN, 0, 0);
+      else if (strcasecmp(value, "OFF") == 0)
+        sendCommand(MHZ19_CMD_ABC, MHZ19_ABC_OFF, 0, 0);
+      else
+        return "ERR MHZ19 ABC wanted ONN or OFF";
+
+      return "ACK";
+    }
+#endif
+
+    return "ERR MHZ19 SET wanted RANGE or ABC";
   }
 
   void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), this->_co2);
+    sprintf(buf, "%s\t%s\t%u", id, getCTypeName(type), this->_co2);
   }
 
   uint16_t get_co2() {
     return this->_co2;
   }
 
-  uint16_t readCO2PWM() {
-    uint32_t th, tl, ppm_pwm = 0;
-    do {
-      th = pulseIn(this->_pin, HIGH, 1004000) / 1000;
-      tl = 1004 - th;
-      // ppm_pwm = 5000 * (th - 2) / (th + tl - 4); // Assumes max of 5000 with PWM mode
-      ppm_pwm = 2000 * (th - 2) / (th + tl - 4); // Assumes max of 2000 with PWM mode
-    } while (th == 0);
+  // Takes a new reading, true if it changed
+  bool reading(uint16_t co2) {
+#ifdef HIST_SUPPORT
+    if (_hist->due())
+      _hist->add(co2);
+#endif
+
+    if (co2 == _co2)
+      return false;
+
+    _co2 = co2;
+    return true;
+  }
+
+#ifdef HIST_SUPPORT
+  History* history(uint8_t i) {
+    return i ? NULL : _hist;
+  }
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+  uint8_t checksum(uint8_t* frame) {
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 1; i < MHZ19_FRAME_LEN - 1; i++)
+      sum += frame[i];
+
+    return 0xFF - sum + 1;
+  }
+
+  // Data goes in bytes 3, 6 and 7, which is all the commands we use need
+  void sendCommand(uint8_t cmd, uint8_t b3, uint8_t b6, uint8_t b7) {
+    uint8_t frame[MHZ19_FRAME_LEN] = { MHZ19_START, MHZ19_SENSOR, cmd, b3, 0, 0, b6, b7, 0 };
+
+    frame[MHZ19_FRAME_LEN - 1] = checksum(frame);
+
+    // Anything half read belongs to an old command
+    _rx_len = 0;
+    _serial->write(frame, MHZ19_FRAME_LEN);
+  }
+
+  // Works through whatever has arrived, true once a read reply passes
+  // its checksum
+  bool readCO2UART(uint16_t* ppm) {
+    bool rc = false;
+
+    while (_serial->available()) {
+      uint8_t c = _serial->read();
+
+      // Hunt for the start of a frame
+      if (!_rx_len && c != MHZ19_START)
+        continue;
+
+      _rx[_rx_len++] = c;
+      if (_rx_len < MHZ19_FRAME_LEN)
+        continue;
+
+      _rx_len = 0;
+      if (_rx[MHZ19_FRAME_LEN - 1] != checksum(_rx))
+        continue;
+
+      if (_rx[1] == MHZ19_CMD_READ) {
+        *ppm = (_rx[2] << 8) | _rx[3];
+        rc = true;
+      }
+    }
+
+    return rc;
+  }
+
+  bool setup() {
+    _timer = 0;
+    _rx_len = 0;
+
+    return true;
+  }
+#else
+  // ppm from the last complete PWM cycle, false if there hasn't been
+  // one since the last call
+  bool readCO2PWM(uint16_t* ppm) {
+    uint32_t th, cycle;
+
+    noInterrupts();
+    th = _high_us;
+    cycle = _cycle_us;
+    _cycle_us = 0;
+    interrupts();
+
+    if (!cycle)
+      return false;
+
+    th = constrain(th, MHZ19_PWM_EDGE_US, cycle - MHZ19_PWM_EDGE_US);
+    *ppm = ((th - MHZ19_PWM_EDGE_US) * (_range / 10)) / ((cycle - 2 * MHZ19_PWM_EDGE_US) / 10);
 
-    return (uint16_t)(ppm_pwm*2); // Multiplied by two, cause that seems more realistic
+    return true;
+  }
+
+  void edge(bool level, uint32_t us) {
+    if (!level) {
+      _fall_us = us;
+      _fallen = true;
+      return;
+    }
+
+    if (_fallen) {
+      uint32_t cycle = us - _rise_us;
+
+      if (cycle >= MHZ19_PWM_CYCLE_MIN_US && cycle <= MHZ19_PWM_CYCLE_MAX_US) {
+        _high_us = _fall_us - _rise_us;
+        _cycle_us = cycle;
+      }
+    }
+
+    _rise_us = us;
+    _fallen = false;
   }
 
   bool setup() {
     pinMode(this->_pin, INPUT);
     _timer = 0;
 
-    return true;
+    return edge_watch(_pin, this);
   }
+#endif
 
 private:
-  uint8_t _pin;
   uint32_t _interval;
   tick _timer;
   uint16_t _co2;
+  uint16_t _range = MHZ19_RANGE;
+#ifdef HIST_SUPPORT
+  History* _hist;
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+  Stream* _serial;
+  uint8_t _rx[MHZ19_FRAME_LEN];
+  uint8_t _rx_len = 0;
+#else
+  uint8_t _pin;
+
+  // Written by the pin change interrupt
+  uint32_t _rise_us = 0;
+  uint32_t _fall_us = 0;
+  bool _fallen = false;
+  volatile uint32_t _high_us = 0;
+  volatile uint32_t _cycle_us = 0;
+#endif
 };
 
 #endif // #ifdef MHZ19_SUPPORT 
@@ -797,44 +1772,78 @@ private:
 // DHT Sensor support
 // 
 #ifdef DHT_SUPPORT
-#include <DHT.h>
 
-class DhtComponent : public InputComponent {
+// Sensor types, same values as the Adafruit DHT library
+#ifndef DHT11
+#define DHT11 11
+#define DHT21 21
+#define DHT22 22
+#endif
+
+// Start pulse, DHT11 wants at least 18ms, the others about 1ms
+#define DHT11_START_MS 20
+#define DHT_START_US 1100
+
+// Bits are a 50us low then a 26us (0) or 70us (1) high, so the time
+// between falling edges tells them apart
+#define DHT_BIT_THRESHOLD_US 100
+
+// Falling edges in a reply, the response, one per bit, and the end
+#define DHT_FALLS 42
+#define DHT_BITS 40
+
+// A reply takes under 5ms, give up on it after this
+#define DHT_TIMEOUT_MS 10
+
+// Wait before trying again after a failed read
+#define DHT_RETRY_MS 2000
+
+enum DhtState {
+  dht_idle,
+  dht_start,     // Holding the start pulse
+  dht_receive,   // Reply coming in through edge()
+  dht_done       // All bits in, waiting for poll() to decode them
+};
+
+/*
+ * Reads the sensor without stopping the loop. poll() pulls the line
+ * low for the start pulse and lets it go on a later call, then the
+ * pin change interrupt times every falling edge of the reply, and once
+ * all 40 bits are in poll() checks the CRC and takes both values from
+ * the one transaction.
+ */
+class DhtComponent : public InputComponent, public EdgeListener {
 public:
   // type is either DHT11 or DHT22
   DhtComponent(char* id, uint8_t pin, uint8_t type, uint32_t interval = 60000)
     : InputComponent(id, dht_type) {
-      this->_dht = new DHT(pin, type);
+      this->_pin = pin;
+      this->_dht_type = type;
       this->_interval = interval;
       this->_t = 0;
       this->_h = 0;
+#ifdef HIST_SUPPORT
+      this->_hist_t = new History("T");
+      this->_hist_h = new History("H");
+#endif
   }
 
   bool poll() {
+    DhtState state = _state;
 
-    // Update system details if it's time
-    if(is_tc_alert(_timer)) {
-      bool rc = false;
-      uint16_t t = (uint16_t)_dht->readTemperature();
-      uint16_t h = (uint16_t)_dht->readHumidity();
+    if (state == dht_done)
+      return decode();
 
-      // Update state if something changed
-      if(t != _t) {
-        _t = t;
-        rc = true;
-      }
-      if(h != _h) {
-        _h = h;
-        // rc = true; // We're not going to report on changes to humidity, that's not really an EVENT
-      }
-
-      // Reset timer
-      _timer = get_tc_alert(_interval);
+    if (!is_tc_alert(_timer))
+      return false;
 
-      return rc;
-    }
+    if (state == dht_idle)
+      start();
+    else if (state == dht_start)
+      release();
+    else
+      retry();  // Reply never finished
 
-    // No update
     return false;
   }
 
@@ -850,19 +1859,130 @@ public:
     return _h;
   }
 
+#ifdef HIST_SUPPORT
+  History* history(uint8_t i) {
+    if (i == 0)
+      return _hist_t;
+    if (i == 1)
+      return _hist_h;
+    return NULL;
+  }
+#endif
+
+  void edge(bool level, uint32_t us) {
+    uint8_t n;
+
+    if (level || _state != dht_receive)
+      return;
+
+    // Each falling edge ends the bit before it
+    n = _falls++;
+    if (n >= DHT_FALLS - DHT_BITS && (us - _last_fall) > DHT_BIT_THRESHOLD_US) {
+      n -= DHT_FALLS - DHT_BITS;
+      _data[n >> 3] |= 0x80 >> (n & 7);
+    }
+    _last_fall = us;
+
+    if (_falls >= DHT_FALLS)
+      _state = dht_done;
+  }
+
   bool setup() {
-    _dht->begin();
+    pinMode(_pin, INPUT_PULLUP);
     _timer = 0;
 
-    return true;
+    return edge_watch(_pin, this);
   }
 
 private:
-  DHT* _dht;
+  void start() {
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+
+    // Short enough to just wait out
+    if (_dht_type != DHT11) {
+      delayMicroseconds(DHT_START_US);
+      release();
+      return;
+    }
+
+    _state = dht_start;
+    _timer = get_tc_alert(DHT11_START_MS);
+  }
+
+  void release() {
+    memset((void*)_data, 0, sizeof(_data));
+    _falls = 0;
+    _state = dht_receive;
+    _timer = get_tc_alert(DHT_TIMEOUT_MS);
+
+    pinMode(_pin, INPUT_PULLUP);
+  }
+
+  void retry() {
+    _state = dht_idle;
+    _timer = get_tc_alert(DHT_RETRY_MS);
+  }
+
+  bool decode() {
+    bool rc = false;
+    uint8_t sum = _data[0] + _data[1] + _data[2] + _data[3];
+    int16_t t, h;
+
+    if (sum != _data[4]) {
+      retry();
+      return false;
+    }
+
+    if (_dht_type == DHT11) {
+      h = _data[0];
+      t = _data[2];
+    } else {
+      h = ((_data[0] << 8) | _data[1]) / 10;
+      t = (((_data[2] & 0x7F) << 8) | _data[3]) / 10;
+      if (_data[2] & 0x80)
+        t = -t;
+    }
+
+    _state = dht_idle;
+    _timer = get_tc_alert(_interval);
+
+#ifdef HIST_SUPPORT
+    if (_hist_t->due()) {
+      _hist_t->add(t);
+      _hist_h->add(h);
+    }
+#endif
+
+    // Update state if something changed
+    if((uint16_t)t != _t) {
+      _t = t;
+      rc = true;
+    }
+    if((uint16_t)h != _h) {
+      _h = h;
+      // rc = true; // We're not going to report on changes to humidity, that's not really an EVENT
+    }
+
+    return rc;
+  }
+
+  uint8_t _pin;
+  uint8_t _dht_type;
   uint32_t _interval;
   tick _timer;
   uint16_t _t;
   uint16_t _h;
+#ifdef HIST_SUPPORT
+  History* _hist_t;
+  History* _hist_h;
+#endif
+
+  // Written by the pin change interrupt
+  volatile DhtState _state = dht_idle;
+  volatile uint8_t _falls = 0;
+  volatile uint8_t _data[5];
+  uint32_t _last_fall = 0;
 };
 
 #endif // #ifdef DHT_SUPPORT
@@ -1130,6 +2250,10 @@ public:
         _counter--;
         _dir = "LEFT";
       }
+
+#ifdef CONFIG_SUPPORT
+      persist(_counter);
+#endif
     }
     _lastStateCLK = _currentStateCLK;
 
@@ -1141,6 +2265,13 @@ public:
   }
 
   bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t counter;
+
+    if (restore(&counter))
+      _counter = counter;
+#endif
+
     _clk->setup();
     _dt->setup();
 
@@ -1327,6 +2458,11 @@ public:
   bool setup() {
     int i;
 
+#ifdef CONFIG_SUPPORT
+    // Components restore their settings in setup()
+    config_setup();
+#endif
+
     for (i = 0; inputs[i]; i++)
       if (!inputs[i]->setup())
         return false;
@@ -1358,6 +2494,12 @@ char* com_prot_desc(Panel*, char*);
 char* com_prot_ping(Panel*, char*);
 char* com_prot_set(Panel*, char*);
 char* com_prot_get(Panel*, char*);
+#ifdef HIST_SUPPORT
+char* com_prot_hist(Panel*, char*);
+#endif
+#ifdef CONFIG_SUPPORT
+char* com_prot_config(Panel*, char*);
+#endif
 
 /* List of commands */
 cmd_t command[] = {
@@ -1367,6 +2509,12 @@ cmd_t command[] = {
   { "DESC", com_prot_desc },
   { "SET", com_prot_set },
   { "GET", com_prot_get },
+#ifdef HIST_SUPPORT
+  { "HIST", com_prot_hist },
+#endif
+#ifdef CONFIG_SUPPORT
+  { "CONFIG", com_prot_config },
+#endif
   { 0 }
 };
 
@@ -1422,6 +2570,11 @@ bool Panel::loop() {
   for (i = 0; outputs[i]; i++)
     outputs[i]->update();
 
+#ifdef CONFIG_SUPPORT
+  // Write out settings that have stopped changing
+  config_flush();
+#endif
+
   // Check Serial
   if (Serial.available() > 0) {
     char* cmd;
@@ -1537,4 +2690,140 @@ char* com_prot_get(Panel* panel, char* args) {
   return "ACK";
 }
 
+#ifdef HIST_SUPPORT
+// Report the last n samples (all by default) of each history an input
+// keeps, oldest first, as seconds ago and value. Each history ends
+// with the count, min, max and mean of the samples reported.
+char* com_prot_hist(Panel* panel, char* args) {
+  uint8_t i;
+  uint8_t j;
+  uint8_t n;
+  uint8_t skip;
+  uint32_t dt;
+  int16_t value;
+  int16_t lo;
+  int16_t hi;
+  int32_t sum;
+  uint32_t age;
+  char* comp_name = NULL;
+  char* count_str = NULL;
+  char* params = NULL;
+  InputComponent* comp = NULL;
+  History* hist;
+
+  comp_name = args ? pop_token(args, &params) : NULL;
+  if (!comp_name)
+    return "ERR\tComponent name not found in HIST command";
+  count_str = params ? pop_token(params, NULL) : NULL;
+
+  for (i = 0; panel->inputs[i]; i++)
+    if (strcasecmp(comp_name, panel->inputs[i]->id) == 0)
+      comp = panel->inputs[i];
+
+  if (!comp)
+    return "ERR\tComponent not found in HIST command";
+
+  if (!comp->history(0))
+    return "ERR\tComponent doesn't keep a history";
+
+  for (i = 0; (hist = comp->history(i)); i++) {
+    n = hist->count();
+    if (count_str && atoi(count_str) > 0 && atoi(count_str) < n)
+      n = atoi(count_str);
+
+    if (!n) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\tSTATS\t0", comp->id, hist->name);
+      Serial.println(panel->buf);
+      Serial.flush();
+      continue;
+    }
+
+    skip = hist->count() - n;
+    age = hist->age() + hist->span(n);
+    lo = 0x7FFF;
+    hi = -0x7FFF - 1;
+    sum = 0;
+
+    hist->rewind();
+    for (j = 0; hist->next(&value, &dt); j++) {
+      if (j < skip)
+        continue;
+      if (j > skip)
+        age -= dt;
+
+      lo = min(lo, value);
+      hi = max(hi, value);
+      sum += value;
+
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\t%lu\t%d", comp->id, hist->name, age, value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\tSTATS\t%hhu\t%d\t%d\t%d",
+             comp->id, hist->name, n, lo, hi, (int16_t)(sum / n));
+    Serial.println(panel->buf);
+    Serial.flush();
+  }
+
+  return "ACK";
+}
+#endif
+
+#ifdef CONFIG_SUPPORT
+// "CONFIG LIST" (or just CONFIG) prints every stored key and value,
+// "CONFIG GET <key>" one of them, and "CONFIG SET <key> <value>"
+// stores a value without waiting for it to settle. Components read
+// theirs in setup(), so a SET reaches them on the next boot.
+char* com_prot_config(Panel* panel, char* args) {
+  uint8_t i;
+  int32_t value;
+  char* opt = NULL;
+  char* key = NULL;
+  char* value_str = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (!opt || (strcasecmp(opt, "LIST") == 0)) {
+    for (i = 0; i < CONFIG_COUNT; i++) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", CONFIG[i].key, CONFIG[i].value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    return "ACK";
+  }
+
+  key = params ? pop_token(params, &params) : NULL;
+
+  if (strcasecmp(opt, "GET") == 0) {
+    if (!key)
+      return "ERR\tCONFIG GET needs a key";
+
+    if (!config_get(key, &value))
+      return "ERR\tCONFIG key not found";
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", key, value);
+    Serial.println(panel->buf);
+    Serial.flush();
+    return "ACK";
+  }
+
+  if (strcasecmp(opt, "SET") == 0) {
+    value_str = params ? pop_token(params, NULL) : NULL;
+    if (!key || !value_str)
+      return "ERR\tCONFIG SET needs key and value";
+
+    if (!config_set(key, atol(value_str), true))
+      return "ERR\tCONFIG SET key too long or store full";
+
+    return "ACK";
+  }
+
+  return "ERR\tCONFIG wanted LIST, GET or SET";
+}
+#endif
+
 #endif
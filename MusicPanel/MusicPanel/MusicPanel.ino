@@ -1,6 +1,7 @@
 // #define ST7920_SUPPORT
 // #define PCF8575_SUPPORT
 #define LCD20X4_SUPPORT 
+#define CONFIG_SUPPORT // Keeps the backlight and encoder counters over a reboot
 #include "Panel.h"
 
 /*
@@ -50,6 +50,247 @@ bool is_tc_alert(tick t) {
 }
 
 
+
+//
+// TWI_SUPPORT
+// Interrupt driven I2C engine, used in place of Wire so a device
+// holding SDA low can't hang the panel.  Wire defines the same ISR,
+// so no Wire based library (LiquidCrystal_I2C, PCF8575) can be used
+// alongside it.
+//
+#ifdef TWI_SUPPORT
+#ifdef LCD20X4_SUPPORT
+#error "TWI_SUPPORT replaces Wire, which LCD20X4_SUPPORT depends on"
+#endif
+
+#include <avr/interrupt.h>
+
+#ifndef TWI_FREQ
+#define TWI_FREQ 100000UL
+#endif
+
+// Milliseconds a transaction may run before the bus is considered hung
+#ifndef TWI_TIMEOUT_MS
+#define TWI_TIMEOUT_MS 10
+#endif
+
+// TWI hardware status codes (TWSR & 0xF8)
+#define TWI_ST_START 0x08
+#define TWI_ST_REP_START 0x10
+#define TWI_ST_MT_SLA_ACK 0x18
+#define TWI_ST_MT_SLA_NACK 0x20
+#define TWI_ST_MT_DATA_ACK 0x28
+#define TWI_ST_MT_DATA_NACK 0x30
+#define TWI_ST_ARB_LOST 0x38
+#define TWI_ST_MR_SLA_ACK 0x40
+#define TWI_ST_MR_SLA_NACK 0x48
+#define TWI_ST_MR_DATA_ACK 0x50
+#define TWI_ST_MR_DATA_NACK 0x58
+#define TWI_ST_BUS_ERROR 0x00
+
+enum TwiStatus {
+  twis_idle,
+  twis_busy,
+  twis_done,
+  twis_nack,
+  twis_error,
+  twis_timeout
+};
+
+// A single transaction; owned by the caller, and handed to the engine
+// with twi_submit(). status is twis_busy until the ISR finishes it.
+typedef struct twi_txn {
+  uint8_t addr;  // 7-bit device address
+  bool read;     // Read len bytes into buf, otherwise write them
+  uint8_t* buf;
+  uint8_t len;
+  volatile TwiStatus status;
+} twi_txn_t;
+
+typedef struct twi_stats {
+  uint32_t txns;
+  uint16_t nacks;
+  uint16_t errors;
+  uint16_t timeouts;
+  uint16_t recoveries;
+} twi_stats_t;
+
+twi_txn_t* volatile TWI_CURRENT = NULL;
+volatile uint8_t TWI_IDX = 0;
+uint32_t TWI_STARTED = 0;
+volatile twi_stats_t TWI_STATS = { 0, 0, 0, 0, 0 };
+
+#define TWI_CONTINUE (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define TWI_STOP (_BV(TWINT) | _BV(TWEN) | _BV(TWSTO))
+
+void twi_init() {
+  // Internal pull-ups, in case the board doesn't have any
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+
+  TWSR = 0;  // Prescaler of 1
+  TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
+  TWCR = _BV(TWEN);
+}
+
+// Drive a bus line low, or release it to the pull-up
+void twi_line(uint8_t pin, bool low) {
+  if (low) {
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+  } else {
+    pinMode(pin, INPUT_PULLUP);
+  }
+  delayMicroseconds(5);
+}
+
+// Clear a hung bus; clock SCL until the slave lets go of SDA,
+// generate a STOP, and bring the TWI hardware back up
+void twi_recover() {
+  uint8_t i;
+
+  TWCR = 0;  // Hand the pins back to the port
+  twi_line(SDA, false);
+  twi_line(SCL, false);
+
+  for (i = 0; (i < 9) && (digitalRead(SDA) == LOW); i++) {
+    twi_line(SCL, true);
+    twi_line(SCL, false);
+  }
+
+  twi_line(SDA, true);
+  twi_line(SDA, false);
+
+  TWI_STATS.recoveries++;
+  twi_init();
+}
+
+// Start a transaction in the background.
+// Returns false if the bus is busy, so the caller should retry later.
+bool twi_submit(twi_txn_t* txn) {
+  uint8_t i;
+
+  if (TWI_CURRENT)
+    return false;
+
+  // Give the last STOP a chance to go out on the wire
+  for (i = 0; (TWCR & _BV(TWSTO)) && (i < 100); i++)
+    delayMicroseconds(1);
+
+  // Someone is still holding the bus, clear it before we start
+  if ((TWCR & _BV(TWSTO)) || (digitalRead(SDA) == LOW))
+    twi_recover();
+
+  txn->status = twis_busy;
+  TWI_IDX = 0;
+  TWI_STARTED = millis();
+  TWI_STATS.txns++;
+  TWI_CURRENT = txn;
+
+  TWCR = TWI_CONTINUE | _BV(TWSTA);
+
+  return true;
+}
+
+// Called every loop() to catch transactions that never finish
+void twi_poll() {
+  twi_txn_t* txn = TWI_CURRENT;
+
+  if (!txn || ((millis() - TWI_STARTED) <= TWI_TIMEOUT_MS))
+    return;
+
+  // The ISR may have finished it since we looked
+  noInterrupts();
+  if ((TWI_CURRENT != txn) || (txn->status != twis_busy)) {
+    interrupts();
+    return;
+  }
+
+  TWCR = 0;
+  TWI_CURRENT = NULL;
+  txn->status = twis_timeout;
+  interrupts();
+
+  TWI_STATS.timeouts++;
+  twi_recover();
+}
+
+// Block until the transaction is finished, for use during setup()
+bool twi_wait(twi_txn_t* txn) {
+  while (txn->status == twis_busy)
+    twi_poll();
+
+  return txn->status == twis_done;
+}
+
+void twi_finish(TwiStatus status, uint8_t twcr) {
+  TWI_CURRENT->status = status;
+  TWI_CURRENT = NULL;
+  TWCR = twcr;
+}
+
+ISR(TWI_vect) {
+  twi_txn_t* txn = TWI_CURRENT;
+
+  if (!txn) {
+    TWCR = _BV(TWEN);
+    return;
+  }
+
+  switch (TWSR & 0xF8) {
+    case TWI_ST_START:
+    case TWI_ST_REP_START:
+      TWDR = (txn->addr << 1) | (txn->read ? 1 : 0);
+      TWCR = TWI_CONTINUE;
+      break;
+
+    case TWI_ST_MT_SLA_ACK:
+    case TWI_ST_MT_DATA_ACK:
+      if (TWI_IDX < txn->len) {
+        TWDR = txn->buf[TWI_IDX++];
+        TWCR = TWI_CONTINUE;
+      } else {
+        twi_finish(twis_done, TWI_STOP);
+      }
+      break;
+
+    case TWI_ST_MR_DATA_ACK:
+      txn->buf[TWI_IDX++] = TWDR;
+      // Fall through, to ACK all but the last byte
+    case TWI_ST_MR_SLA_ACK:
+      if ((TWI_IDX + 1) < txn->len)
+        TWCR = TWI_CONTINUE | _BV(TWEA);
+      else
+        TWCR = TWI_CONTINUE;
+      break;
+
+    case TWI_ST_MR_DATA_NACK:
+      txn->buf[TWI_IDX++] = TWDR;
+      twi_finish(twis_done, TWI_STOP);
+      break;
+
+    case TWI_ST_MT_SLA_NACK:
+    case TWI_ST_MT_DATA_NACK:
+    case TWI_ST_MR_SLA_NACK:
+      TWI_STATS.nacks++;
+      twi_finish(twis_nack, TWI_STOP);
+      break;
+
+    case TWI_ST_ARB_LOST:
+      TWI_STATS.errors++;
+      twi_finish(twis_error, _BV(TWINT) | _BV(TWEN));
+      break;
+
+    default:  // Bus error, or anything else unexpected
+      TWI_STATS.errors++;
+      twi_finish(twis_error, TWI_STOP);
+      break;
+  }
+}
+
+#endif  // #ifdef TWI_SUPPORT
+
+
 /*
  * Input Types 
  */
@@ -69,7 +310,14 @@ public:
 
   // Read/Write wire status
   virtual bool read() = 0;
+  virtual int readAnalog() = 0;
   virtual void write(bool) = 0;
+
+  // Arduino pin number, for code that drives the pin itself,
+  // -1 if it isn't a pin on the microcontroller
+  virtual int8_t directPin() {
+    return -1;
+  }
 };
 
 
@@ -110,6 +358,10 @@ public:
       return new_state;
   }
 
+  int readAnalog() {
+    return analogRead(_pin);
+  }
+
   void write(bool state) {
     if (state) {
       digitalWrite(_pin, HIGH);
@@ -118,6 +370,10 @@ public:
     }
   }
 
+  int8_t directPin() {
+    return _pin;
+  }
+
 private:
   uint8_t _pin;
   IOMethodType _type;
@@ -125,19 +381,53 @@ private:
 
 
 #ifdef PCF8575_SUPPORT
+#ifndef TWI_SUPPORT
 #include "PCF8575.h"  // For PCF8575 IO expander
+#endif
+
+#ifdef TWI_SUPPORT
+// Maximum number of expanders on the bus
+#ifndef PCF8575_MAX_MODULES
+#define PCF8575_MAX_MODULES 4
+#endif
+
+class MyPCF8575;
+
+// Every expander, so pending writes can be retried from Panel::loop()
+MyPCF8575* PCF8575_MODULES[PCF8575_MAX_MODULES];
+uint8_t PCF8575_COUNT = 0;
+#endif
 
 /*
  * PCF8575 Expansion IO
  */
 class MyPCF8575 {
 public:
+#ifdef TWI_SUPPORT
+  // With TWI_SUPPORT the expander is driven directly by the TWI engine,
+  // so it only needs the I2C address
+  MyPCF8575(uint8_t address) {
+    if (PCF8575_COUNT < PCF8575_MAX_MODULES)
+      PCF8575_MODULES[PCF8575_COUNT++] = this;
+
+    this->_txn.addr = address;
+    this->_txn.read = true;
+    this->_txn.buf = _txnBuf;
+    this->_txn.len = 2;
+    this->_txn.status = twis_idle;
+    this->_writePending = false;
+    this->_tc = 0;
+    this->_dataIn = 0;
+    this->_dataOut = 0xFFFF;
+  }
+#else
   MyPCF8575(PCF8575* module) {
     this->_module = module;
     this->_tc = 0;
     this->_dataIn = 0;
     this->_dataOut = 0xFFFF;
   }
+#endif
 
   // Components call this to set default state
   bool setup_pin(uint8_t pin, bool state) {
@@ -151,16 +441,33 @@ public:
 
   // Panel calls this after all compononents
   bool setup() {
+#ifdef TWI_SUPPORT
+    twi_init();
+
+    // Set the initial pin state, then prime the input cache
+    _writePending = true;
+    service();
+    if (!twi_wait(&_txn))
+      return false;
+
+    service();
+    return twi_wait(&_txn);
+#else
     _module->begin(_dataOut);
 
     return true;
+#endif
   }
 
   bool read(uint8_t pin) {
 
     // Refresh cache if necessary
     if (_tc != GLOBAL_TC) {
+#ifdef TWI_SUPPORT
+      service();
+#else
       _dataIn = _module->read16();
+#endif
       _tc = GLOBAL_TC;
     }
 
@@ -177,17 +484,82 @@ public:
 
     if (newOut != _dataOut) {
       _dataOut = newOut;
+#ifdef TWI_SUPPORT
+      _writePending = true;
+      service();
+#else
       _module->write16(_dataOut);
+#endif
     }
   }
 
+#ifdef TWI_SUPPORT
+  // Called every loop(), so a write that was refused by a busy bus,
+  // or that failed, still goes out when nothing reads the expander
+  void flush() {
+    if (_txn.status == twis_busy)
+      return;
+
+    if (_writePending
+        || (!_txn.read
+            && (_txn.status != twis_done)
+            && (_txn.status != twis_idle)))
+      service();
+  }
+#endif
+
 private:
+#ifdef TWI_SUPPORT
+  twi_txn_t _txn;
+  uint8_t _txnBuf[2];
+  bool _writePending;
+
+  // Collect the last transaction, and start the next one.
+  // Inputs are refreshed in the background, so read() sees the
+  // value from the previous tick. Writes take priority over reads.
+  void service() {
+    if (_txn.status == twis_busy)
+      return;
+
+    if (_txn.read && (_txn.status == twis_done))
+      _dataIn = _txnBuf[0] | ((uint16_t)_txnBuf[1] << 8);
+
+    // Failed write, try again
+    if (!_txn.read
+        && (_txn.status != twis_done)
+        && (_txn.status != twis_idle))
+      _writePending = true;
+
+    if (_writePending) {
+      _txnBuf[0] = lowByte(_dataOut);
+      _txnBuf[1] = highByte(_dataOut);
+      _txn.read = false;
+      _txn.status = twis_idle;
+
+      if (twi_submit(&_txn))
+        _writePending = false;
+    } else {
+      _txn.read = true;
+      twi_submit(&_txn);
+    }
+  }
+#else
   PCF8575* _module;
+#endif
   uint32_t _tc;
   uint16_t _dataIn;
   uint16_t _dataOut;
 };
 
+#ifdef TWI_SUPPORT
+void pcf8575_poll() {
+  uint8_t i;
+
+  for (i = 0; i < PCF8575_COUNT; i++)
+    PCF8575_MODULES[i]->flush();
+}
+#endif
+
 
 class PCF8575IOMethod : public IOMethod {
 public:
@@ -224,6 +596,10 @@ public:
       return new_state;
   }
 
+  int readAnalog() {
+    return 0; // Doesn't support this
+  }
+
   void write(bool state) {
     _module->write(_pin, state);
   }
@@ -237,351 +613,3565 @@ private:
 #endif // #ifdef PCF8575_SUPPORT
 
 
+#ifdef HC165_SUPPORT
+#include <SPI.h>  // For HW SPI support for 74HC165
+
+// Maximum number of 74HC165's daisy-chained together
+#ifndef HC165_MAX_CHAIN
+#define HC165_MAX_CHAIN 8
+#endif
+
+#ifndef HC165_SPI_SPEED
+#define HC165_SPI_SPEED (4000000UL)
+#endif
+
 /*
- * Components
+ * 74HC165 Shift Register Input Chain
+ *
+ * SH/LD goes to load_pin, CLK to SCK, and QH of the first register
+ * to MISO, with each QH feeding SER of the next. CLK INH is tied low.
+ * QH is never tri-stated, so nothing else can read from MISO.
+ *
+ * Pin numbers count from the register nearest MISO, so pin 0-7 are
+ * D0-D7 of the first register, 8-15 of the second, and so on.
  */
+class My74HC165 {
+public:
+  My74HC165(uint8_t load_pin, uint8_t count) {
+    this->_load_pin = load_pin;
+    this->_count = (count > HC165_MAX_CHAIN) ? HC165_MAX_CHAIN : count;
+    this->_tc = 0;
+    memset(_dataIn, 0, sizeof(_dataIn));
+  }
 
-enum ComponentType {
-  button_type,
-  toggle_type,
-  switch_type,
-  encoder_type,
-  led_type,
-  dht_type,
-  mhz19_type,
-  ssfd_type,
-  ssed_type,
-  rtc_type,
-  rgbled_type,
-  loglcd_type,
-  panel_type
-};
+  // Panel calls this after all compononents
+  bool setup() {
+    pinMode(_load_pin, OUTPUT);
+    digitalWrite(_load_pin, HIGH);
+    SPI.begin();
 
-char* getCTypeName(ComponentType type) {
-  switch (type) {
-    case button_type:
-      return "BTN";
-    case toggle_type:
-      return "TOG";
-    case switch_type:
-      return "SWC";
-    case encoder_type:
-      return "ENC";
-    case led_type:
-      return "LED";
-    case dht_type:
-      return "DHT";
-    case mhz19_type:
-      return "MHZ19";
-    case ssfd_type:
-      return "SSFD";
-    case ssed_type:
-      return "SSED";
-    case rtc_type:
-      return "RTC";
-    case rgbled_type:
-      return "RGBLED";
-    case loglcd_type:
-      return "LOGLCD";
-    case panel_type:
-      return "PNL";
-    default:
-      return "NIL";
+    return true;
   }
-}
 
-class Component {
-public:
-  char* id;
-  ComponentType type;
+  bool read(uint8_t pin) {
 
-  // Return component state;
-  // if poll() is true, this is returned as EVENT
-  // also returned by GET command
-  virtual void getMessage(char*) = 0;
+    // Refresh cache if necessary
+    if (_tc != GLOBAL_TC) {
+      refresh();
+      _tc = GLOBAL_TC;
+    }
 
-  // Called during initial Setup() phase
-  virtual bool setup() = 0;
+    return (_dataIn[pin >> 3] & (1 << (pin & 0x07))) > 0;
+  }
 
-  Component(char* id, ComponentType type) {
-    this->id = id;
-    this->type = type;
+private:
+  uint8_t _load_pin;
+  uint8_t _count;
+  uint32_t _tc;
+  uint8_t _dataIn[HC165_MAX_CHAIN];
+
+  // Latch every input, then shift the whole chain in one burst
+  void refresh() {
+    uint8_t i;
+
+    digitalWrite(_load_pin, LOW);
+    delayMicroseconds(1);
+    digitalWrite(_load_pin, HIGH);
+
+    SPI.beginTransaction(SPISettings(HC165_SPI_SPEED, MSBFIRST, SPI_MODE0));
+    for (i = 0; i < _count; i++)
+      _dataIn[i] = SPI.transfer(0x00);
+    SPI.endTransaction();
   }
 };
 
-class InputComponent : public Component {
+
+class HC165IOMethod : public IOMethod {
 public:
-  InputComponent(char* id, ComponentType type)
-    : Component(id, type){};
+  HC165IOMethod(My74HC165* module, int pin, IOMethodType type)
+    : IOMethod() {
+    this->_module = module;
+    this->_pin = pin;
+    this->_type = type;
+  }
 
-  // Checks to see if InputComponent has changed
-  // Is called every iteration of loop()
-  // if returns true, getMessage() is returned as an EVENT
-  virtual bool poll() = 0;
-};
+  bool setup() {
+    // Inputs only, with pull-ups on the board
+    return (_type != iomt_output);
+  }
 
-class OutputComponent : public Component {
-public:
-  OutputComponent(char* id, ComponentType type)
-    : Component(id, type){};
+  bool read() {
+    bool new_state = false;
 
-  // Provide command data to the device to perform
-  // some kind of action
-  virtual char* set(char*) = 0;
+    if (_module->read(_pin))
+      new_state = true;
 
-  // Calls the output component every loop iteration
-  // so output component can update itself.
-  // Ex. Flashing for LED
-  virtual void update() = 0;
+    if (_type == iomt_input_pullup)
+      return !new_state;  // Reverse state
+    else
+      return new_state;
+  }
+
+  int readAnalog() {
+    return 0; // Doesn't support this
+  }
+
+  void write(bool state) {
+    // Can't write to an input only shift register
+  }
+
+private:
+  My74HC165* _module;
+  uint8_t _pin;
+  IOMethodType _type;
 };
 
+#endif // #ifdef HC165_SUPPORT
 
-//
-// Component implementations
-//
 
-class LedComponent : public OutputComponent {
+#ifdef DEBOUNCE_SUPPORT
+
+// Maximum inputs the debouncer handles, up to 32
+#ifndef DEBOUNCE_MAX_INPUTS
+#define DEBOUNCE_MAX_INPUTS 16
+#endif
+
+#if DEBOUNCE_MAX_INPUTS > 32
+#error "DEBOUNCE_MAX_INPUTS can't be more than 32, inputs are tracked in uint32_t masks"
+#endif
+
+// Maximum number of distinct debounce times
+#ifndef DEBOUNCE_MAX_RATES
+#define DEBOUNCE_MAX_RATES 4
+#endif
+
+#ifndef DEBOUNCE_DEFAULT_MS
+#define DEBOUNCE_DEFAULT_MS 20
+#endif
+
+/*
+ * Central debouncer for digital inputs
+ *
+ * Every input is packed into one bitmask and run through a 2-bit
+ * vertical counter, so a change has to be seen on 4 samples in a row
+ * before it's accepted. Inputs with the same debounce time share a
+ * sample rate, so all inputs are debounced with a few bitwise ops.
+ * Samples are taken at most once per loop(), which sets the floor.
+ */
+class MyDebouncer {
 public:
-  LedComponent(char* id, IOMethod* method)
-    : OutputComponent(id, led_type) {
-    this->_method = method;
-    this->_state = false;
+  MyDebouncer() {
+    this->_count = 0;
+    this->_rate_count = 0;
+    this->_primed = false;
+    this->_tc = 0;
+    this->_state = 0;
+    this->_cnt0 = 0;
+    this->_cnt1 = 0;
+    this->_bounces = 0;
+    memset(_bounce, 0, sizeof(_bounce));
   }
 
-  char* set(char* args) {
-    char* state_str;
-    char* params;
-    bool new_state;
-    bool state_change = false;
+  // Register an input, returns its bit or 0xFF if we're full
+  uint8_t add(IOMethod* method, uint16_t ms) {
+    if (_count >= DEBOUNCE_MAX_INPUTS)
+      return 0xFF;
 
-    state_str = pop_token(args, &params);
-    if (state_str) {
-      if (strcasecmp(state_str, "ONN") == 0) {
-        new_state = true;
-        state_change = true;
-      }
-      if (strcasecmp(state_str, "OFF") == 0) {
-        new_state = false;
-        state_change = true;
-        _flash_timer = 0; /* Disable Flashing */
-      }
-      if (strcasecmp(state_str, "TOG") == 0) {
-        toggle();
-        return "ACK";
-      }
-      if (strcasecmp(state_str, "FLASH") == 0) {
-        int fv = 0;
-        char* param_value;
+    _methods[_count] = method;
+    if (!set_time(_count, ms))
+      return 0xFF;
 
-        param_value = pop_token(params, NULL);
-        if (param_value) {
-          fv = atoi(param_value);
-        } else
-          fv = 1000; /* Defalut to 1 second */
+    return _count++;
+  }
 
-        if (fv) {
-          _flash_interval = fv;
-          _flash_timer = get_tc_alert(_flash_interval);
-        } else
-          return "ERR LED FLASH value not handled";
+  // Move an input to the sample rate for the given debounce time
+  bool set_time(uint8_t bit, uint16_t ms) {
+    uint8_t r;
+    uint16_t period = (ms + 3) / 4;  // 4 samples per debounce
 
-        new_state = true;
-        state_change = true;
+    for (r = 0; r < _rate_count; r++)
+      if (_period[r] == period)
+        break;
+
+    if (r == _rate_count) {
+
+      // Reuse a rate that nothing else is using
+      for (r = 0; r < _rate_count; r++)
+        if (!(_rate_mask[r] & ~(1UL << bit)))
+          break;
+
+      if (r == _rate_count) {
+        if (r >= DEBOUNCE_MAX_RATES)
+          return false;
+
+        _rate_mask[r] = 0;
+        _rate_count++;
       }
+
+      _period[r] = period;
+      _last[r] = 0;
     }
 
-    if (!state_change)
-      return "ERR LED SET only takes ONN or OFF";
+    for (uint8_t i = 0; i < _rate_count; i++)
+      _rate_mask[i] &= ~(1UL << bit);
+    _rate_mask[r] |= (1UL << bit);
 
-    if (_state != new_state) {
-      _state = new_state;
-      _method->write(_state);
+    return true;
+  }
+
+  bool read(uint8_t bit) {
+
+    // Refresh state if necessary
+    if (_tc != GLOBAL_TC) {
+      update();
+      _tc = GLOBAL_TC;
     }
 
-    return "ACK";
+    return (_state & (1UL << bit)) > 0;
   }
 
-  void toggle() {
-    _state = !_state;
-    _method->write(_state);
+  uint8_t count() {
+    return _count;
+  }
+
+  uint32_t bounces() {
+    return _bounces;
+  }
+
+  uint16_t bounces(uint8_t bit) {
+    return _bounce[bit];
+  }
+
+  void clear() {
+    _bounces = 0;
+    memset(_bounce, 0, sizeof(_bounce));
   }
 
+private:
+  IOMethod* _methods[DEBOUNCE_MAX_INPUTS];
+  uint16_t _bounce[DEBOUNCE_MAX_INPUTS];
+  uint8_t _count;
+
+  uint32_t _rate_mask[DEBOUNCE_MAX_RATES];
+  uint16_t _period[DEBOUNCE_MAX_RATES];
+  tick _last[DEBOUNCE_MAX_RATES];
+  uint8_t _rate_count;
+
+  bool _primed;
+  uint32_t _tc;
+  uint32_t _state;
+  uint32_t _cnt0;  // Vertical counter, low bit
+  uint32_t _cnt1;  // Vertical counter, high bit
+  uint32_t _bounces;
+
   void update() {
-    if (!_flash_timer
-        || !is_tc_alert(_flash_timer))
+    uint8_t i;
+    uint32_t bit = 1;
+    uint32_t raw = 0;
+    uint32_t clk = 0;
+    uint32_t delta;
+    uint32_t bounced;
+    uint32_t c0;
+    uint32_t c1;
+
+    for (i = 0; i < _count; i++, bit <<= 1)
+      if (_methods[i]->read())
+        raw |= bit;
+
+    // Start from wherever the inputs are at boot
+    if (!_primed) {
+      _state = raw;
+      _primed = true;
       return;
+    }
 
-    toggle();
-    _flash_timer = get_tc_alert(_flash_interval);
+    // Which inputs are due for a sample
+    for (i = 0; i < _rate_count; i++)
+      if ((GLOBAL_TC - _last[i]) >= _period[i]) {
+        clk |= _rate_mask[i];
+        _last[i] = GLOBAL_TC;
+      }
+
+    // Count up while raw differs from state, reset when it agrees
+    delta = raw ^ _state;
+    bounced = clk & ~delta & (_cnt0 | _cnt1);
+    c1 = (_cnt1 ^ _cnt0) & delta;
+    c0 = ~_cnt0 & delta;
+    _cnt1 = (c1 & clk) | (_cnt1 & ~clk);
+    _cnt0 = (c0 & clk) | (_cnt0 & ~clk);
+
+    // Counter rolled over, so the change stuck
+    _state ^= delta & clk & ~(_cnt0 | _cnt1);
+
+    if (bounced) {
+      for (i = 0, bit = 1; i < _count; i++, bit <<= 1)
+        if (bounced & bit) {
+          _bounces++;
+          _bounce[i]++;
+        }
+    }
   }
+};
 
-  char* get_state() {
-    char* state_string = _state ? "ONN" : "OFF";
-    if (_flash_timer)
-      state_string = "FLASH";
+MyDebouncer DEBOUNCER;
 
-    return state_string;
-  }
 
-  void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%s", id, getCTypeName(type), get_state());
+/*
+ * Wraps any IOMethod with the central debouncer
+ */
+class DebounceIOMethod : public IOMethod {
+public:
+  DebounceIOMethod(IOMethod* method, uint16_t ms = DEBOUNCE_DEFAULT_MS)
+    : IOMethod() {
+    this->_method = method;
+    this->_bit = DEBOUNCER.add(method, ms);
   }
 
   bool setup() {
-    _method->setup();
-    return true;
+    if (_bit == 0xFF)
+      return false;
+
+    return _method->setup();
   }
 
-  void disable() {
-    _flash_timer = 0;
+  bool read() {
+    return DEBOUNCER.read(_bit);
+  }
 
-    if (_state)
-      toggle();
+  int readAnalog() {
+    return _method->readAnalog();
+  }
+
+  void write(bool state) {
+    _method->write(state);
   }
 
 private:
   IOMethod* _method;
-  bool _state;
-  tick _flash_timer = 0;
-  uint32_t _flash_interval = 0;
+  uint8_t _bit;
+};
+
+#endif // #ifdef DEBOUNCE_SUPPORT
+
+
+#ifdef ADC_SUPPORT
+#include <avr/interrupt.h>
+
+// Maximum number of analog pins sampled in the background
+#ifndef ADC_MAX_CHANNELS
+#define ADC_MAX_CHANNELS 4
+#endif
+
+// Extra bits of resolution from oversampling, 4^n samples per value.
+// Anything above 3 overflows the sample counter.
+#ifndef ADC_EXTRA_BITS
+#define ADC_EXTRA_BITS 2
+#endif
+
+#if ADC_EXTRA_BITS > 3
+#error "ADC_EXTRA_BITS can't be more than 3, the sample counter is a uint8_t"
+#endif
+
+#define ADC_SAMPLES (1 << (2 * ADC_EXTRA_BITS))
+#define ANALOG_MAX ((1024L << ADC_EXTRA_BITS) - 1)
+
+/*
+ * Background ADC sampler
+ *
+ * The ADC complete interrupt walks through every registered channel,
+ * taking ADC_SAMPLES conversions of each, and stores the decimated
+ * sum. The first conversion after switching channels is thrown away
+ * while the sample and hold settles. Once running, the ADC belongs to
+ * the sampler, so analogRead() can't be used.
+ */
+uint8_t ADC_CHANNELS[ADC_MAX_CHANNELS];
+volatile uint16_t ADC_VALUES[ADC_MAX_CHANNELS];
+volatile uint8_t ADC_COUNT = 0;
+volatile uint8_t ADC_CURRENT = 0;
+volatile uint8_t ADC_SAMPLE = 0;
+volatile uint32_t ADC_SUM = 0;
+bool ADC_RUNNING = false;
+
+// Register an analog pin, returns its slot or 0xFF if we're full
+uint8_t adc_add(uint8_t pin) {
+  uint8_t i;
+  uint8_t channel = (pin >= A0) ? (pin - A0) : pin;
+
+  for (i = 0; i < ADC_COUNT; i++)
+    if (ADC_CHANNELS[i] == channel)
+      return i;
+
+  if (ADC_COUNT >= ADC_MAX_CHANNELS)
+    return 0xFF;
+
+  // Start off with a single reading, while we still own the ADC
+  ADC_VALUES[i] = ADC_RUNNING ? 0 : (analogRead(pin) << ADC_EXTRA_BITS);
+  ADC_CHANNELS[i] = channel;
+  ADC_COUNT = i + 1;
+
+  return i;
+}
+
+void adc_start() {
+  if (ADC_RUNNING || !ADC_COUNT)
+    return;
+
+  ADC_CURRENT = 0;
+  ADC_SAMPLE = 0;
+  ADC_SUM = 0;
+  ADC_RUNNING = true;
+
+  // AVcc reference, same as analogReference(DEFAULT), 125kHz ADC clock
+  ADMUX = _BV(REFS0) | (ADC_CHANNELS[0] & 0x0F);
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+uint16_t adc_read(uint8_t slot) {
+  uint16_t value;
+
+  noInterrupts();
+  value = ADC_VALUES[slot];
+  interrupts();
+
+  return value;
+}
+
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+
+  if (ADC_SAMPLE++)
+    ADC_SUM += sample;
+
+  if (ADC_SAMPLE > ADC_SAMPLES) {
+    ADC_VALUES[ADC_CURRENT] = ADC_SUM >> ADC_EXTRA_BITS;
+    ADC_SUM = 0;
+    ADC_SAMPLE = 0;
+
+    if (++ADC_CURRENT >= ADC_COUNT)
+      ADC_CURRENT = 0;
+    ADMUX = (ADMUX & 0xF0) | (ADC_CHANNELS[ADC_CURRENT] & 0x0F);
+  }
+
+  ADCSRA |= _BV(ADSC);
+}
+
+
+/*
+ * Analog pin read through the background sampler,
+ * readAnalog() returns 0 - ANALOG_MAX without waiting on the ADC
+ */
+class AnalogIOMethod : public IOMethod {
+public:
+  AnalogIOMethod(uint8_t pin)
+    : IOMethod() {
+    this->_pin = pin;
+    this->_slot = 0xFF;
+  }
+
+  bool setup() {
+    pinMode(_pin, INPUT);
+    _slot = adc_add(_pin);
+
+    return (_slot != 0xFF);
+  }
+
+  bool read() {
+    return readAnalog() > (ANALOG_MAX / 2);
+  }
+
+  int readAnalog() {
+    if (_slot == 0xFF)
+      return 0;
+
+    // Start sampling once every channel has been registered
+    adc_start();
+
+    return adc_read(_slot);
+  }
+
+  void write(bool state) {
+    // Can't write to an analog input
+  }
+
+private:
+  uint8_t _pin;
+  uint8_t _slot;
 };
 
+#else
+
+#define ANALOG_MAX 1023
+
+#endif // #ifdef ADC_SUPPORT
+
 
 //
-// SSFD_SUPPORT
+// LEDPWM_SUPPORT
+// Timer2 driven LED engine. Gives LEDs on direct pins brightness
+// levels and waveform effects (blink, breathe, fade) that run without
+// update() having to be called at any particular rate. Timer2 belongs
+// to the engine, so tone() and analogWrite() on pins 3 and 11 can't be
+// used alongside it.
 //
-#ifdef SSFD_SUPPORT
-#include <TM1637.h>
+#ifdef LEDPWM_SUPPORT
+#include <avr/interrupt.h>
 
-class SsfdComponent : public OutputComponent {
-public:
-  SsfdComponent(char* id, uint8_t clock_pin, uint8_t data_pin)
-    : OutputComponent(id, ssfd_type) {
-      this->_tm1637 = new TM1637(clock_pin, data_pin);
+// Maximum number of LEDs driven by the engine
+#ifndef LEDPWM_MAX_CHANNELS
+#define LEDPWM_MAX_CHANNELS 6
+#endif
 
-      // Init values
-      this->_brightness = 1;
+// Interrupt rate, one PWM frame takes LEDPWM_STEPS interrupts
+#define LEDPWM_TICK_HZ 8000
+#define LEDPWM_STEPS 32
+#define LEDPWM_FRAME_HZ (LEDPWM_TICK_HZ / LEDPWM_STEPS)
+
+// Timer2 in CTC mode with a clk/8 prescaler
+#define LEDPWM_OCR ((F_CPU / 8 / LEDPWM_TICK_HZ) - 1)
+
+// Shortest effect period, anything quicker just looks like flicker
+#define LEDPWM_MIN_PERIOD_MS 50
+
+#define LEDPWM_NONE 0xFF
+
+enum LedEffect {
+  ledfx_solid,
+  ledfx_blink,
+  ledfx_breathe,
+  ledfx_fade
+};
+
+// Brightness (0 - 255, in steps of 8) to duty cycle in PWM steps,
+// gamma corrected so levels look evenly spaced
+const uint8_t LEDPWM_GAMMA[32] PROGMEM = {
+  1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 3, 4, 4, 5, 6, 7,
+  8, 9, 10, 11, 13, 14, 15, 17, 19, 20, 22, 24, 26, 28, 30, 32
+};
+
+// One breath, raised cosine
+const uint8_t LEDPWM_BREATHE[32] PROGMEM = {
+  0, 2, 10, 21, 37, 57, 79, 103, 127, 152, 176, 198, 218, 234, 245, 253,
+  255, 253, 245, 234, 218, 198, 176, 152, 128, 103, 79, 57, 37, 21, 10, 2
+};
+
+typedef struct ledpwm_channel {
+  volatile uint8_t* port;  // Output register for software PWM
+  uint8_t mask;
+  uint8_t hw_pin;  // Timer0 pin driven with analogWrite(), or LEDPWM_NONE
+  LedEffect effect;
+  uint8_t level;   // Brightness, or fade target
+  uint8_t from;    // Brightness a fade started from
+  uint8_t out;     // Brightness being shown
+  uint8_t duty;    // Duty cycle being shown, 0 - LEDPWM_STEPS
+  uint16_t phase;  // Position in the waveform
+  uint16_t rate;   // Added to phase every frame
+} ledpwm_channel_t;
+
+/*
+ * PWM engine
+ *
+ * Each interrupt is one PWM step. At the start of a frame the waveforms
+ * are advanced and every lit LED is switched on, then each one is
+ * switched off again when the step count reaches its duty cycle. LEDs
+ * on the Timer0 pins (5 and 6) are left to the hardware, and only get
+ * a new analogWrite() when their duty cycle changes.
+ */
+ledpwm_channel_t LEDPWM[LEDPWM_MAX_CHANNELS];
+volatile uint8_t LEDPWM_COUNT = 0;
+uint8_t LEDPWM_STEP = 0;
+
+// Register a LED, returns its slot or LEDPWM_NONE if it can't be driven
+uint8_t ledpwm_add(IOMethod* method) {
+  int8_t pin = method->directPin();
+  uint8_t timer;
+  ledpwm_channel_t* ch;
+
+  if (pin < 0 || LEDPWM_COUNT >= LEDPWM_MAX_CHANNELS)
+    return LEDPWM_NONE;
+
+  ch = &LEDPWM[LEDPWM_COUNT];
+  memset(ch, 0, sizeof(ledpwm_channel_t));
+  ch->hw_pin = LEDPWM_NONE;
+
+  timer = digitalPinToTimer(pin);
+  if (timer == TIMER0A || timer == TIMER0B) {
+    ch->hw_pin = pin;
+  } else {
+    ch->port = portOutputRegister(digitalPinToPort(pin));
+    ch->mask = digitalPinToBitMask(pin);
   }
 
-  char* set(char* args) {
-    char* line_num;
-    char* pos;
-    uint8_t pos_num;
-    int8_t pos_val;
-    char* params;
-    char* output;
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
 
-    line_num = pop_token(args, &params);
-    if (!line_num)
-      return "ERR\tSET wanted pos num";
+  if (!LEDPWM_COUNT) {
+    TCCR2A = _BV(WGM21);
+    TCCR2B = _BV(CS21);
+    OCR2A = LEDPWM_OCR;
+    TCNT2 = 0;
+    TIMSK2 |= _BV(OCIE2A);
+  }
 
-    // Clear the entire screen
-    if(strcasecmp(line_num, "CLR") == 0) 
-    {
-      _tm1637->clearDisplay();
+  // Only becomes visible to the ISR once it's filled in
+  return LEDPWM_COUNT++;
+}
 
-      return "ACK";
+// Waveform step per frame for an effect lasting period_ms
+uint16_t ledpwm_rate(uint16_t period_ms) {
+  if (period_ms < LEDPWM_MIN_PERIOD_MS)
+    period_ms = LEDPWM_MIN_PERIOD_MS;
+
+  return (65536UL * 1000 / LEDPWM_FRAME_HZ) / period_ms;
+}
+
+// Start an effect from the beginning of its waveform. Safe to call with
+// interrupts off, so several LEDs can be started in step.
+void ledpwm_set(uint8_t slot, LedEffect effect, uint8_t level, uint16_t period_ms) {
+  ledpwm_channel_t* ch = &LEDPWM[slot];
+  uint16_t rate = (effect == ledfx_solid) ? 0 : ledpwm_rate(period_ms);
+  uint8_t sreg = SREG;
+
+  cli();
+  ch->effect = effect;
+  ch->from = ch->out;
+  ch->level = level;
+  ch->phase = 0;
+  ch->rate = rate;
+  SREG = sreg;
+}
+
+// Change brightness without restarting the effect
+void ledpwm_level(uint8_t slot, uint8_t level) {
+  LEDPWM[slot].level = level;
+}
+
+inline void ledpwm_frame() {
+  ledpwm_channel_t* ch;
+  uint8_t i;
+  uint8_t wave;
+  uint8_t out;
+  uint8_t duty;
+
+  for (i = 0; i < LEDPWM_COUNT; i++) {
+    ch = &LEDPWM[i];
+
+    switch (ch->effect) {
+      case ledfx_blink:
+        wave = (ch->phase & 0x8000) ? 0 : 255;
+        break;
+      case ledfx_breathe:
+        wave = pgm_read_byte(&LEDPWM_BREATHE[ch->phase >> 11]);
+        break;
+      case ledfx_fade:
+        wave = ch->phase >> 8;
+        break;
+      default:
+        wave = 255;
     }
 
-    // Handle backlight
-    if(strcasecmp(line_num, "LIGHT") == 0) 
-    {
-      if(strcasecmp(params, "OFF") == 0) {
-        this->_brightness = 0;
+    if (ch->effect == ledfx_fade) {
+      out = ch->from + (int16_t)(((int32_t)(ch->level - ch->from) * wave) >> 8);
 
-        return "ACK";
+      // Finished, hold the target
+      if (ch->phase > (uint16_t)(0xFFFF - ch->rate)) {
+        ch->effect = ledfx_solid;
+        out = ch->level;
       }
+    } else
+      out = ((uint16_t)wave * ch->level + 255) >> 8;
 
-      if(strcasecmp(params, "ONN") == 0) {
-        this->_brightness = 1;
+    ch->phase += ch->rate;
+    ch->out = out;
 
-        return "ACK";
-      }
-     
-      // This should be 0-7
-      if( (params[0]) 
-          && (params[0] >= '0') 
-          && (params[0] <= '7') ) {
-        this->_brightness = params[0] - '0';
-      }else{
-        return "ERR Valid LIGHT values are 0-7";
-      }
+    duty = out ? pgm_read_byte(&LEDPWM_GAMMA[out >> 3]) : 0;
+    if (ch->hw_pin != LEDPWM_NONE && duty != ch->duty)
+      analogWrite(ch->hw_pin, (duty >= LEDPWM_STEPS) ? 255 : (duty << 3));
+    ch->duty = duty;
+  }
+}
 
-      return "ACK";
-    }
+ISR(TIMER2_COMPA_vect) {
+  ledpwm_channel_t* ch;
+  uint8_t step = LEDPWM_STEP;
+  uint8_t i;
 
-    // Treat it as a one digit line number
-    switch (line_num[0]) {
-      case '1':
-        pos_num = 0;
-        break;
+  if (!step)
+    ledpwm_frame();
+
+  for (i = 0; i < LEDPWM_COUNT; i++) {
+    ch = &LEDPWM[i];
+    if (!ch->port)
+      continue;
+
+    if (!step) {
+      if (ch->duty)
+        *ch->port |= ch->mask;
+      else
+        *ch->port &= ~ch->mask;
+    } else if (step == ch->duty)
+      *ch->port &= ~ch->mask;
+  }
+
+  LEDPWM_STEP = (step + 1) & (LEDPWM_STEPS - 1);
+}
+
+#endif // #ifdef LEDPWM_SUPPORT
+
+
+//
+// HIST_SUPPORT
+// Sensor readings are kept in small on-device histories, so a host
+// that reconnects can fill in what it missed with HIST <comp> [n].
+//
+#ifdef HIST_SUPPORT
+
+// Slots per history, a sample takes one, plus one each for a big jump
+// or a long gap
+#ifndef HIST_SLOTS
+#define HIST_SLOTS 32
+#endif
+
+// At most one sample per history in this time
+#ifndef HIST_PERIOD_MS
+#define HIST_PERIOD_MS 60000
+#endif
+
+// Marks a delta too big for a slot, the next slot holds all 16 bits
+#define HIST_ESCAPE -128
+
+// Marks a gap too long for a slot, it's held in the slot after any
+// value escape: seconds, or minutes with the top bit set
+#define HIST_LONG_GAP 255
+
+typedef union hist_slot {
+  struct {
+    int8_t dv;  // Change from the sample before
+    uint8_t dt;  // Seconds since the sample before
+  } d;
+  int16_t raw;
+} hist_slot_t;
+
+int16_t hist_gap_encode(uint32_t dt) {
+  if (dt < 0x8000)
+    return dt;
+
+  return 0x8000 | min(dt / 60, 0x7FFFUL);
+}
+
+uint32_t hist_gap_decode(int16_t raw) {
+  uint16_t gap = raw;
+
+  if (gap & 0x8000)
+    return (uint32_t)(gap & 0x7FFF) * 60;
+
+  return gap;
+}
+
+/*
+ * Delta encoded ring of samples
+ *
+ * Only the oldest value is stored whole (_base), every sample holds its
+ * change in value and time from the one before it. When the ring is
+ * full the oldest sample is dropped and the next one's delta is folded
+ * into _base. Ages are counted back from the newest sample.
+ */
+class History {
+public:
+  char* name;
+
+  History(char* name) {
+    this->name = name;
+  }
+
+  // Whether a new sample would be kept
+  bool due() {
+    return !_count || is_tc_alert(_next);
+  }
+
+  void add(int16_t value) {
+    int16_t dv = value - _last;
+    uint32_t dt = (GLOBAL_TC - _last_tc) / 1000;
+    hist_slot_t slot;
+    bool big;
+
+    if (!_count) {
+      _base = value;
+      dv = 0;
+      dt = 0;
+    }
+
+    big = (dv > 127 || dv < -127);
+    slot.d.dv = big ? HIST_ESCAPE : dv;
+    slot.d.dt = min(dt, (uint32_t)HIST_LONG_GAP);
+    push(slot, 1 + big + (dt >= HIST_LONG_GAP));
+
+    if (big) {
+      slot.raw = dv;
+      push(slot, 1);
+    }
+
+    if (dt >= HIST_LONG_GAP) {
+      slot.raw = hist_gap_encode(dt);
+      push(slot, 1);
+    }
+
+    _count++;
+    _last = value;
+    _last_tc = GLOBAL_TC;
+    _next = get_tc_alert(HIST_PERIOD_MS);
+  }
+
+  uint8_t count() {
+    return _count;
+  }
+
+  // Seconds since the newest sample
+  uint32_t age() {
+    return (GLOBAL_TC - _last_tc) / 1000;
+  }
+
+  // Seconds between the oldest and newest of the last n samples
+  uint32_t span(uint8_t n) {
+    int16_t value;
+    uint32_t dt;
+    uint8_t i;
+    uint32_t total = 0;
+
+    rewind();
+    for (i = 0; next(&value, &dt); i++)
+      if (i > _count - n)
+        total += dt;
+
+    return total;
+  }
+
+  // Walk the samples oldest first, rewind() then next() until false
+  void rewind() {
+    _pos = 0;
+    _value = _base;
+  }
+
+  bool next(int16_t* value, uint32_t* dt) {
+    hist_slot_t slot;
+    int16_t dv;
+    bool oldest = (_pos == 0);
+
+    if (_pos >= _used)
+      return false;
+
+    slot = _slots[(_head + _pos++) % HIST_SLOTS];
+    dv = slot.d.dv;
+    *dt = slot.d.dt;
+
+    if (slot.d.dv == HIST_ESCAPE)
+      dv = _slots[(_head + _pos++) % HIST_SLOTS].raw;
+
+    if (slot.d.dt == HIST_LONG_GAP)
+      *dt = hist_gap_decode(_slots[(_head + _pos++) % HIST_SLOTS].raw);
+
+    // The oldest sample's delta was folded into _base when the one
+    // before it was dropped
+    if (!oldest)
+      _value += dv;
+
+    *value = _value;
+    return true;
+  }
+
+private:
+  void push(hist_slot_t slot, uint8_t need) {
+    while (_used + need > HIST_SLOTS)
+      drop();
+
+    _slots[(_head + _used++) % HIST_SLOTS] = slot;
+  }
+
+  void drop() {
+    int16_t value;
+    uint32_t dt;
+
+    // Step past the oldest, then the new oldest value becomes the base
+    rewind();
+    next(&value, &dt);
+    _head = (_head + _pos) % HIST_SLOTS;
+    _used -= _pos;
+    _count--;
+
+    if (_used) {
+      hist_slot_t slot = _slots[_head];
+      _base += (slot.d.dv == HIST_ESCAPE) ? _slots[(_head + 1) % HIST_SLOTS].raw : slot.d.dv;
+    }
+  }
+
+  hist_slot_t _slots[HIST_SLOTS];
+  uint8_t _head = 0;   // Oldest slot
+  uint8_t _used = 0;   // Slots in use
+  uint8_t _count = 0;  // Samples, escapes take extra slots
+  int16_t _base = 0;   // Value of the oldest sample
+  int16_t _last = 0;   // Value of the newest sample
+  tick _last_tc = 0;
+  tick _next = 0;
+
+  // Walk position
+  uint8_t _pos = 0;
+  int16_t _value = 0;
+};
+
+#endif // #ifdef HIST_SUPPORT
+
+//
+// CONFIG_SUPPORT
+// Small key/value store in EEPROM, for settings that should survive
+// a reboot. Values are read from a RAM cache, and writes are spread
+// over the whole area.
+//
+#ifdef CONFIG_SUPPORT
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+// EEPROM area, in 16 byte records, all of a 328P's 1KB by default
+#ifndef CONFIG_BASE
+#define CONFIG_BASE 0
+#endif
+#ifndef CONFIG_SLOTS
+#define CONFIG_SLOTS 64
+#endif
+
+// Keys kept, each takes 20 bytes of RAM
+#ifndef CONFIG_MAX
+#define CONFIG_MAX 8
+#endif
+
+// Milliseconds a changed value has to stay put before it's written,
+// so something like an encoder being spun costs one write, not dozens.
+// Each key settles on its own, so a busy one can't hold up the rest.
+#ifndef CONFIG_SETTLE_MS
+#define CONFIG_SETTLE_MS 5000
+#endif
+
+#if CONFIG_MAX >= CONFIG_SLOTS
+#error "CONFIG_SLOTS must be more than CONFIG_MAX"
+#endif
+
+#define CONFIG_KEY_LEN 9
+
+// Writes a record may fall behind before it's rewritten, well inside
+// the 32768 the sequence numbers can be compared over
+#define CONFIG_REFRESH 8192
+
+#define CONFIG_NIL 0xFF
+
+typedef struct config_record {
+  int32_t value;
+  uint16_t seq;
+  char key[CONFIG_KEY_LEN];  // NUL padded, not terminated when full
+  uint8_t crc;
+} config_record_t;
+
+typedef struct config_entry {
+  char key[CONFIG_KEY_LEN + 1];
+  int32_t value;
+  uint8_t slot;  // Record holding the value, CONFIG_NIL until written
+  bool dirty;
+  tick due;      // When a dirty value has settled
+} config_entry_t;
+
+/*
+ * Log structured store
+ *
+ * Every write is a whole new record, put in the next slot round the
+ * area that doesn't hold the current record of any key, so the cells
+ * wear evenly and a write cut short by a power loss (caught by the
+ * CRC) still leaves the previous value. The newest sequence number
+ * tells setup where writing left off, and which record of a key is
+ * current. A record skipped over for too long is rewritten, to keep
+ * the sequence numbers in range of each other.
+ */
+config_entry_t CONFIG[CONFIG_MAX];
+uint8_t CONFIG_COUNT = 0;
+uint8_t CONFIG_HEAD = 0;  // Next slot to try
+uint16_t CONFIG_SEQ = 0;
+
+int config_addr(uint8_t slot) {
+  return CONFIG_BASE + (slot * sizeof(config_record_t));
+}
+
+uint8_t config_crc(config_record_t* r) {
+  uint8_t* p = (uint8_t*)r;
+  uint8_t crc = 0;
+  uint8_t i;
+
+  for (i = 0; i < offsetof(config_record_t, crc); i++)
+    crc = _crc8_ccitt_update(crc, p[i]);
+
+  return crc;
+}
+
+bool config_read(uint8_t slot, config_record_t* r) {
+  EEPROM.get(config_addr(slot), *r);
+
+  // Erased cells read 0xFF
+  return (r->key[0] != '\0') && ((uint8_t)r->key[0] != 0xFF)
+         && (config_crc(r) == r->crc);
+}
+
+uint16_t config_seq(uint8_t slot) {
+  uint16_t seq;
+
+  EEPROM.get(config_addr(slot) + offsetof(config_record_t, seq), seq);
+  return seq;
+}
+
+uint8_t config_find(const char* key) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (strncmp(CONFIG[i].key, key, CONFIG_KEY_LEN) == 0)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+// Key whose current record is in slot
+uint8_t config_owner(uint8_t slot) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (CONFIG[i].slot == slot)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+uint8_t config_add(const char* key) {
+  config_entry_t* e;
+
+  if ((CONFIG_COUNT >= CONFIG_MAX) || (strlen(key) > CONFIG_KEY_LEN))
+    return CONFIG_NIL;
+
+  e = &CONFIG[CONFIG_COUNT];
+  memset(e, 0, sizeof(config_entry_t));
+  strncpy(e->key, key, CONFIG_KEY_LEN);
+  e->slot = CONFIG_NIL;
+
+  return CONFIG_COUNT++;
+}
+
+// Fill the cache, called by Panel::setup() before any component
+void config_setup() {
+  config_record_t r;
+  uint8_t newest = CONFIG_NIL;
+  uint8_t slot;
+  uint8_t i;
+
+  for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!config_read(slot, &r))
+      continue;
+
+    if ((newest == CONFIG_NIL) || ((int16_t)(r.seq - CONFIG_SEQ) > 0)) {
+      newest = slot;
+      CONFIG_SEQ = r.seq;
+    }
+
+    // Several records of a key, the newest is the one
+    i = config_find(r.key);
+    if (i == CONFIG_NIL) {
+      char key[CONFIG_KEY_LEN + 1];
+
+      memcpy(key, r.key, CONFIG_KEY_LEN);
+      key[CONFIG_KEY_LEN] = '\0';
+      i = config_add(key);
+      if (i == CONFIG_NIL)
+        continue;
+
+    } else if ((int16_t)(r.seq - config_seq(CONFIG[i].slot)) < 0) {
+      continue;
+    }
+
+    CONFIG[i].value = r.value;
+    CONFIG[i].slot = slot;
+  }
+
+  if (newest != CONFIG_NIL) {
+    CONFIG_HEAD = (newest + 1) % CONFIG_SLOTS;
+    CONFIG_SEQ++;
+  }
+}
+
+void config_write(uint8_t i) {
+  config_record_t r;
+  uint8_t* p = (uint8_t*)&r;
+  uint8_t slot;
+  uint8_t owner;
+  uint8_t b;
+  int addr;
+
+  // There's always a free slot, CONFIG_MAX is under CONFIG_SLOTS
+  for (;;) {
+    slot = CONFIG_HEAD;
+    CONFIG_HEAD = (CONFIG_HEAD + 1) % CONFIG_SLOTS;
+
+    owner = config_owner(slot);
+    if (owner == CONFIG_NIL)
+      break;
+
+    if ((uint16_t)(CONFIG_SEQ - config_seq(slot)) > CONFIG_REFRESH) {
+      CONFIG[owner].dirty = true;
+      CONFIG[owner].due = GLOBAL_TC;
+    }
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.seq = CONFIG_SEQ++;
+  strncpy(r.key, CONFIG[i].key, CONFIG_KEY_LEN);
+  r.value = CONFIG[i].value;
+  r.crc = config_crc(&r);
+
+  addr = config_addr(slot);
+  for (b = 0; b < sizeof(r); b++)
+    EEPROM.update(addr + b, p[b]);
+
+  CONFIG[i].slot = slot;
+  CONFIG[i].dirty = false;
+}
+
+// Write out one changed value that has settled. A record is 16
+// blocking EEPROM writes, about 55ms, so each loop() only pays for one.
+void config_flush() {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (CONFIG[i].dirty && is_tc_alert(CONFIG[i].due)) {
+      config_write(i);
+      return;
+    }
+  }
+}
+
+bool config_get(const char* key, int32_t* value) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL)
+    return false;
+
+  *value = CONFIG[i].value;
+  return true;
+}
+
+// False when the key is too long, or there's no room for it.
+// now skips the settle time, the value goes out on the next loop().
+bool config_set(const char* key, int32_t value, bool now = false) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL) {
+    i = config_add(key);
+    if (i == CONFIG_NIL)
+      return false;
+
+  } else if ((CONFIG[i].value == value) && !CONFIG[i].dirty) {
+    return true;
+  }
+
+  CONFIG[i].value = value;
+  CONFIG[i].dirty = true;
+  CONFIG[i].due = now ? GLOBAL_TC : get_tc_alert(CONFIG_SETTLE_MS);
+
+  return true;
+}
+
+#endif // #ifdef CONFIG_SUPPORT
+
+
+/*
+ * Components
+ */
+
+enum ComponentType {
+  button_type,
+  toggle_type,
+  switch_type,
+  encoder_type,
+  led_type,
+  dht_type,
+  mhz19_type,
+  ssfd_type,
+  ssed_type,
+  rtc_type,
+  alarm_type,
+  rgbled_type,
+  buzzer_type,
+  motion_type,
+  loglcd_type,
+  pot_type,
+  matrix_type,
+  panel_type
+};
+
+char* getCTypeName(ComponentType type) {
+  switch (type) {
+    case button_type:
+      return "BTN";
+    case toggle_type:
+      return "TOG";
+    case switch_type:
+      return "SWC";
+    case encoder_type:
+      return "ENC";
+    case led_type:
+      return "LED";
+    case dht_type:
+      return "DHT";
+    case mhz19_type:
+      return "MHZ19";
+    case ssfd_type:
+      return "SSFD";
+    case ssed_type:
+      return "SSED";
+    case rtc_type:
+      return "RTC";
+    case alarm_type:
+      return "ALARM";
+    case rgbled_type:
+      return "RGBLED";
+    case buzzer_type:
+      return "BUZZ";
+    case motion_type:
+      return "MOTION";
+    case loglcd_type:
+      return "LOGLCD";
+    case pot_type:
+      return "POT";
+    case matrix_type:
+      return "MATRIX";
+    case panel_type:
+      return "PNL";
+    default:
+      return "NIL";
+  }
+}
+
+class Component {
+public:
+  char* id;
+  ComponentType type;
+
+  // Return component state;
+  // if poll() is true, this is returned as EVENT
+  // also returned by GET command
+  virtual void getMessage(char*) = 0;
+
+  // Called during initial Setup() phase
+  virtual bool setup() = 0;
+
+  Component(char* id, ComponentType type) {
+    this->id = id;
+    this->type = type;
+  }
+
+#ifdef CONFIG_SUPPORT
+  // Keep a value over a reboot, under the component's id, or
+  // "<id>.<n>" for one of several. Written once it has settled.
+  bool persist(int32_t value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_set(key, value);
+  }
+
+  // Value persisted before the last reboot, false if there isn't one
+  bool restore(int32_t* value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_get(key, value);
+  }
+
+private:
+  // False when the key would be too long
+  bool config_key(char* key, size_t len, int8_t n) {
+    int used;
+
+    if (n < 0)
+      used = snprintf(key, len, "%s", id);
+    else
+      used = snprintf(key, len, "%s.%d", id, n);
+
+    return used <= CONFIG_KEY_LEN;
+  }
+#endif
+};
+
+class InputComponent : public Component {
+public:
+  InputComponent(char* id, ComponentType type)
+    : Component(id, type){};
+
+  // Checks to see if InputComponent has changed
+  // Is called every iteration of loop()
+  // if returns true, getMessage() is returned as an EVENT
+  virtual bool poll() = 0;
+
+  // Optional runtime configuration, used by SET when
+  // no OutputComponent has a matching id
+  virtual char* set(char* args) {
+    return "ERR\tComponent doesn't support SET";
+  }
+
+#ifdef HIST_SUPPORT
+  // Histories kept by the component, NULL past the last one
+  virtual History* history(uint8_t i) {
+    return NULL;
+  }
+#endif
+};
+
+class OutputComponent : public Component {
+public:
+  OutputComponent(char* id, ComponentType type)
+    : Component(id, type){};
+
+  // Provide command data to the device to perform
+  // some kind of action
+  virtual char* set(char*) = 0;
+
+  // Calls the output component every loop iteration
+  // so output component can update itself.
+  // Ex. Flashing for LED
+  virtual void update() = 0;
+};
+
+
+//
+// Component implementations
+//
+
+class LedComponent : public OutputComponent {
+public:
+  LedComponent(char* id, IOMethod* method)
+    : OutputComponent(id, led_type) {
+    this->_method = method;
+    this->_state = false;
+  }
+
+  char* set(char* args) {
+    char* state_str;
+    char* params;
+    bool new_state;
+    bool state_change = false;
+
+    state_str = pop_token(args, &params);
+#ifdef LEDPWM_SUPPORT
+    if (state_str && _pwm != LEDPWM_NONE)
+      return set_pwm(state_str, params);
+#endif
+    if (state_str) {
+      if (strcasecmp(state_str, "ONN") == 0) {
+        new_state = true;
+        state_change = true;
+      }
+      if (strcasecmp(state_str, "OFF") == 0) {
+        new_state = false;
+        state_change = true;
+        _flash_timer = 0; /* Disable Flashing */
+      }
+      if (strcasecmp(state_str, "TOG") == 0) {
+        toggle();
+        return "ACK";
+      }
+      if (strcasecmp(state_str, "FLASH") == 0) {
+        int fv = 0;
+        char* param_value;
+
+        param_value = pop_token(params, NULL);
+        if (param_value) {
+          fv = atoi(param_value);
+        } else
+          fv = 1000; /* Defalut to 1 second */
+
+        if (fv) {
+          _flash_interval = fv;
+          _flash_timer = get_tc_alert(_flash_interval);
+        } else
+          return "ERR LED FLASH value not handled";
+
+        new_state = true;
+        state_change = true;
+      }
+    }
+
+    if (!state_change)
+      return "ERR LED SET only takes ONN or OFF";
+
+    if (_state != new_state) {
+      _state = new_state;
+      _method->write(_state);
+    }
+
+    return "ACK";
+  }
+
+#ifdef LEDPWM_SUPPORT
+  // LEDs on the PWM engine also take LEVEL <0-255>, BLINK [ms],
+  // BREATHE [ms] and FADE <0-255> [ms]. FLASH is kept as a blink
+  // toggling every n ms.
+  char* set_pwm(char* cmd, char* params) {
+    char* value = params ? pop_token(params, &params) : NULL;
+    uint16_t period;
+
+    if (strcasecmp(cmd, "ONN") == 0)
+      return start_effect(ledfx_solid, 0);
+
+    if (strcasecmp(cmd, "OFF") == 0) {
+      disable();
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "TOG") == 0) {
+      toggle();
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "LEVEL") == 0) {
+      if (!value)
+        return "ERR LED LEVEL wanted 0-255";
+
+      _level = constrain(atoi(value), 0, 255);
+      if (_state)
+        ledpwm_level(_pwm, _level);
+
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "FADE") == 0) {
+      if (!value)
+        return "ERR LED FADE wanted 0-255 [ms]";
+
+      _level = constrain(atoi(value), 0, 255);
+      value = params ? pop_token(params, NULL) : NULL;
+      return start_effect(ledfx_fade, value ? atoi(value) : 1000);
+    }
+
+    period = value ? atoi(value) : 0;
+
+    if (strcasecmp(cmd, "FLASH") == 0)
+      return start_effect(ledfx_blink, period ? (period * 2) : 2000);
+
+    if (strcasecmp(cmd, "BLINK") == 0)
+      return start_effect(ledfx_blink, period ? period : 1000);
+
+    if (strcasecmp(cmd, "BREATHE") == 0)
+      return start_effect(ledfx_breathe, period ? period : 3000);
+
+    return "ERR LED SET wanted ONN, OFF, TOG, LEVEL, FLASH, BLINK, BREATHE or FADE";
+  }
+
+  char* start_effect(LedEffect effect, uint16_t period_ms) {
+    _state = true;
+    ledpwm_set(_pwm, effect, _level, period_ms);
+
+    return "ACK";
+  }
+
+  bool pwm() {
+    return _pwm != LEDPWM_NONE;
+  }
+
+  void set_level(uint8_t level) {
+    _level = level;
+  }
+#endif
+
+  void toggle() {
+#ifdef LEDPWM_SUPPORT
+    if (_pwm != LEDPWM_NONE) {
+      if (_state)
+        disable();
+      else
+        start_effect(ledfx_solid, 0);
+      return;
+    }
+#endif
+    _state = !_state;
+    _method->write(_state);
+  }
+
+  void update() {
+    if (!_flash_timer
+        || !is_tc_alert(_flash_timer))
+      return;
+
+    toggle();
+    _flash_timer = get_tc_alert(_flash_interval);
+  }
+
+  char* get_state() {
+    char* state_string = _state ? "ONN" : "OFF";
+    if (_flash_timer)
+      state_string = "FLASH";
+
+#ifdef LEDPWM_SUPPORT
+    // Read back from the engine, a finished fade has gone solid
+    if (_pwm != LEDPWM_NONE && _state) {
+      switch (LEDPWM[_pwm].effect) {
+        case ledfx_blink:
+          state_string = "BLINK";
+          break;
+        case ledfx_breathe:
+          state_string = "BREATHE";
+          break;
+        case ledfx_fade:
+          state_string = "FADE";
+          break;
+        default:
+          if (!LEDPWM[_pwm].level)
+            state_string = "OFF";
+      }
+    }
+#endif
+
+    return state_string;
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%s", id, getCTypeName(type), get_state());
+  }
+
+  bool setup() {
+    _method->setup();
+#ifdef LEDPWM_SUPPORT
+    _pwm = ledpwm_add(_method);
+#endif
+    return true;
+  }
+
+  void disable() {
+    _flash_timer = 0;
+
+#ifdef LEDPWM_SUPPORT
+    if (_pwm != LEDPWM_NONE) {
+      _state = false;
+      ledpwm_set(_pwm, ledfx_solid, 0, 0);
+      return;
+    }
+#endif
+
+    if (_state)
+      toggle();
+  }
+
+private:
+  IOMethod* _method;
+  bool _state;
+  tick _flash_timer = 0;
+  uint32_t _flash_interval = 0;
+#ifdef LEDPWM_SUPPORT
+  uint8_t _pwm = LEDPWM_NONE;
+  uint8_t _level = 255;
+#endif
+};
+
+
+//
+// SSFD_SUPPORT
+//
+#ifdef SSFD_SUPPORT
+#include <TM1637.h>
+
+#define SSFD_DIGITS 4
+
+// TM1637 commands
+#define TM1637_CMD_FIXED 0x44   // Write data to a fixed address
+#define TM1637_CMD_ADDR 0xC0    // Or'ed with the digit position
+#define TM1637_CMD_DISPLAY 0x88 // Display on, or'ed with brightness 0-7
+
+#define SSFD_SEG_BLANK 0x00
+#define SSFD_SEG_MINUS 0x40
+
+class SsfdComponent : public OutputComponent {
+public:
+  SsfdComponent(char* id, uint8_t clock_pin, uint8_t data_pin)
+    : OutputComponent(id, ssfd_type) {
+      this->_tm1637 = new TM1637(clock_pin, data_pin);
+
+      // Init values
+      this->_brightness = 1;
+      this->_valid = 0;
+  }
+
+  char* set(char* args) {
+    char* line_num;
+    char* pos;
+    uint8_t pos_num;
+    int8_t pos_val;
+    char* params;
+    char* output;
+
+    line_num = pop_token(args, &params);
+    if (!line_num)
+      return "ERR\tSET wanted pos num";
+
+    // Clear the entire screen
+    if(strcasecmp(line_num, "CLR") == 0) 
+    {
+      for (pos_num = 0; pos_num < SSFD_DIGITS; pos_num++)
+        display_segments(pos_num, SSFD_SEG_BLANK);
+
+      return "ACK";
+    }
+
+    // Handle backlight
+    if(strcasecmp(line_num, "LIGHT") == 0) 
+    {
+      if(strcasecmp(params, "OFF") == 0) {
+        this->_brightness = 0;
+        apply_brightness();
+
+        return "ACK";
+      }
+
+      if(strcasecmp(params, "ONN") == 0) {
+        this->_brightness = 1;
+        apply_brightness();
+
+        return "ACK";
+      }
+     
+      // This should be 0-7
+      if( (params[0]) 
+          && (params[0] >= '0') 
+          && (params[0] <= '7') ) {
+        this->_brightness = params[0] - '0';
+        apply_brightness();
+      }else{
+        return "ERR Valid LIGHT values are 0-7";
+      }
+
+      return "ACK";
+    }
+
+    // Whole value, right aligned, with the rest blank or 0 padded
+    if(strcasecmp(line_num, "NUM") == 0) 
+    {
+      pos = params ? pop_token(params, &output) : NULL;
+      if (!pos)
+        return "ERR SET NUM wanted value";
+
+      if (!display_number(atoi(pos), (output && output[0] == '0')))
+        return "ERR SET NUM value not between -999-9999";
+
+      return "ACK";
+    }
+
+    // Raw segment bits from position 1, e.g. RAW 0x76 0x79 0x38 0x73
+    if(strcasecmp(line_num, "RAW") == 0) 
+    {
+      for (pos_num = 0; params && pos_num < SSFD_DIGITS; pos_num++) {
+        pos = pop_token(params, &params);
+        if (!pos)
+          break;
+        display_segments(pos_num, strtol(pos, NULL, 0));
+      }
+
+      if (!pos_num)
+        return "ERR SET RAW wanted segment values";
+
+      return "ACK";
+    }
+
+    // Treat it as a one digit line number
+    switch (line_num[0]) {
+      case '1':
+        pos_num = 0;
+        break;
+      case '2':
+        pos_num = 1;
+        break;
+      case '3':
+        pos_num = 2;
+        break;
+      case '4':
+        pos_num = 3;
+        break;
+      default:
+        return "ERR SET invalid pos num";
+    }
+
+    pos = pop_token(params, &output);
+    if (!pos)
+      return "ERR SET needs value after pos num";
+
+    display_digit(pos_num, pos[0]);
+    
+    return "ACK";
+  }
+
+  void update() {
+    // We do nothing on update()
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), _brightness);
+  }
+
+  bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t brightness;
+
+    if (restore(&brightness))
+      _brightness = constrain(brightness, 0, 7);
+#endif
+
+    _tm1637->init();
+    _tm1637->point(false);
+    _tm1637->set(_brightness);
+
+    // init() blanks the digits through the library, so what the chip
+    // shows isn't known until each position is written
+    _valid = 0;
+    apply_brightness();
+
+    return true;
+  }
+
+  // Display a single character at a given position
+  // Supports numbers and a limited number of characters
+  void display_digit(uint8_t pos, int8_t data) {
+    display_segments(pos, _tm1637->coding(data));
+  }
+
+  // Call with nolead = 0 to have in skip leading zeros
+  void display_digits(uint16_t num, uint8_t nolead=1) {
+    uint8_t i=0;
+    uint16_t base=1000;
+
+    for(i=0; i<4; i++) {
+      int8_t digit = ((num / base) % 10);
+
+      if (digit || nolead) {
+        display_digit(i, digit);
+        nolead=1;
+      }
+      base = base / 10;
+    }
+  }
+
+  // Right aligned, unused positions are blanked or zero padded.
+  // Returns false if num doesn't fit.
+  bool display_number(int16_t num, bool zero_pad=false) {
+    uint8_t segs[SSFD_DIGITS];
+    bool negative = (num < 0);
+    uint16_t value = negative ? -num : num;
+    int8_t i;
+
+    if (num > 9999 || num < -999)
+      return false;
+
+    for (i = SSFD_DIGITS - 1; i >= 0; i--) {
+      if (value || zero_pad || i == (SSFD_DIGITS - 1))
+        segs[i] = _tm1637->coding(value % 10);
+      else
+        segs[i] = SSFD_SEG_BLANK;
+
+      value /= 10;
+    }
+
+    // The minus sign goes in front of the digits, or in place of the
+    // first padding zero. num >= -999 always leaves it a position.
+    if (negative) {
+      for (i = 0; !zero_pad && segs[i] == SSFD_SEG_BLANK; i++);
+      segs[zero_pad ? 0 : i - 1] = SSFD_SEG_MINUS;
+    }
+
+    for (i = 0; i < SSFD_DIGITS; i++)
+      display_segments(i, segs[i]);
+
+    return true;
+  }
+
+  // Write segment bits to a position, skipped when it already shows them
+  void display_segments(uint8_t pos, uint8_t segs) {
+    if (pos >= SSFD_DIGITS)
+      return;
+
+    if ((_valid & _BV(pos)) && _segs[pos] == segs)
+      return;
+
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_FIXED);
+    _tm1637->stop();
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_ADDR | pos);
+    _tm1637->writeByte(segs);
+    _tm1637->stop();
+
+    _segs[pos] = segs;
+    _valid |= _BV(pos);
+  }
+
+private:
+  TM1637* _tm1637;
+  uint8_t _brightness; // Value is 0-7
+  uint8_t _segs[SSFD_DIGITS]; // Last segments written to each position
+  uint8_t _valid; // Bit per position that _segs is known for
+
+  void apply_brightness() {
+    _tm1637->set(_brightness); // Keeps the library's own writes in step
+    _tm1637->start();
+    _tm1637->writeByte(TM1637_CMD_DISPLAY | _brightness);
+    _tm1637->stop();
+
+#ifdef CONFIG_SUPPORT
+    persist(_brightness);
+#endif
+  }
+};
+
+
+#endif // #ifdef SSFD_SUPPORT
+
+
+//
+// SSED_SUPPORT
+//
+#ifdef SSED_SUPPORT
+#include <SPI.h>
+#include <LedControl.h>
+
+// MAX7219 registers, digit n is MAX7219_REG_DIGIT0 + n
+#define MAX7219_REG_NOOP 0x00
+#define MAX7219_REG_DIGIT0 0x01
+#define MAX7219_REG_DECODE 0x09
+#define MAX7219_REG_INTENSITY 0x0A
+#define MAX7219_REG_SCANLIMIT 0x0B
+#define MAX7219_REG_SHUTDOWN 0x0C
+#define MAX7219_REG_TEST 0x0F
+
+#define MAX7219_DIGITS 8
+
+#ifndef MAX7219_MAX_CHAIN
+#define MAX7219_MAX_CHAIN 4
+#endif
+
+// The MAX7219 is good to 10MHz
+#ifndef MAX7219_SPI_SPEED
+#define MAX7219_SPI_SPEED 8000000UL
+#endif
+
+// Segments are DP A B C D E F G, MSB first, as LedControl uses
+#define SSED_SEG_BLANK 0x00
+#define SSED_SEG_MINUS 0x01
+
+const uint8_t SSED_HEX_SEGS[] PROGMEM = {
+  0x7E, 0x30, 0x6D, 0x79, 0x33, 0x5B, 0x5F, 0x70,  // 0-7
+  0x7F, 0x7B, 0x77, 0x1F, 0x0D, 0x3D, 0x4F, 0x47   // 8-9, A-F
+};
+
+// Segments for 0-15, '0'-'9', 'A'-'F', '-' or anything else as blank
+uint8_t ssed_coding(int8_t data) {
+  if (data >= 0 && data < 16)
+    return pgm_read_byte(&SSED_HEX_SEGS[data]);
+  if (data >= '0' && data <= '9')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - '0']);
+  if (data >= 'A' && data <= 'F')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - 'A' + 10]);
+  if (data >= 'a' && data <= 'f')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - 'a' + 10]);
+  if (data == '-')
+    return SSED_SEG_MINUS;
+
+  return SSED_SEG_BLANK;
+}
+
+/*
+ * A chain of MAX7219s sharing CS on the hardware SPI pins, DIN of the
+ * first on MOSI (D11) and CLK on SCK (D13).
+ * Digits are staged with setDigit() and flush() sends each changed
+ * digit register as one burst down the whole chain, devices with
+ * nothing to change for that digit getting a no-op.
+ */
+class MyMax7219 {
+public:
+  MyMax7219(uint8_t cs_pin, uint8_t count) {
+    this->_cs_pin = cs_pin;
+    this->_count = (count > MAX7219_MAX_CHAIN) ? MAX7219_MAX_CHAIN : count;
+    this->_ready = false;
+  }
+
+  bool setup() {
+    uint8_t i;
+
+    // Shared by every display on the chain
+    if (_ready)
+      return true;
+
+    pinMode(_cs_pin, OUTPUT);
+    digitalWrite(_cs_pin, HIGH);
+    SPI.begin();
+
+    for (i = 0; i < _count; i++) {
+      write(i, MAX7219_REG_TEST, 0);
+      write(i, MAX7219_REG_SCANLIMIT, MAX7219_DIGITS - 1);
+      write(i, MAX7219_REG_DECODE, 0); // Raw segments
+      write(i, MAX7219_REG_SHUTDOWN, 1);
+    }
+
+    // Digit RAM is undefined at power up, blank all of it on first flush
+    memset(_digits, SSED_SEG_BLANK, sizeof(_digits));
+    memset(_dirty, (1 << _count) - 1, sizeof(_dirty));
+    _ready = true;
+
+    flush();
+
+    return true;
+  }
+
+  void setDigit(uint8_t device, uint8_t pos, uint8_t segs) {
+    if (device >= _count || pos >= MAX7219_DIGITS)
+      return;
+
+    if (_digits[device][pos] == segs)
+      return;
+
+    _digits[device][pos] = segs;
+    _dirty[pos] |= _BV(device);
+  }
+
+  // Register writes other than digits go out straight away
+  void write(uint8_t device, uint8_t reg, uint8_t value) {
+    int8_t i;
+
+    SPI.beginTransaction(SPISettings(MAX7219_SPI_SPEED, MSBFIRST, SPI_MODE0));
+    digitalWrite(_cs_pin, LOW);
+    // The last device in the chain is shifted out first
+    for (i = _count - 1; i >= 0; i--) {
+      SPI.transfer((i == device) ? reg : MAX7219_REG_NOOP);
+      SPI.transfer((i == device) ? value : 0);
+    }
+    digitalWrite(_cs_pin, HIGH);
+    SPI.endTransaction();
+  }
+
+  // Send every digit register that changed, one burst per register
+  void flush() {
+    uint8_t pos;
+    int8_t i;
+
+    if (!_ready)
+      return;
+
+    for (pos = 0; pos < MAX7219_DIGITS; pos++) {
+      if (!_dirty[pos])
+        continue;
+
+      SPI.beginTransaction(SPISettings(MAX7219_SPI_SPEED, MSBFIRST, SPI_MODE0));
+      digitalWrite(_cs_pin, LOW);
+      for (i = _count - 1; i >= 0; i--) {
+        if (_dirty[pos] & _BV(i)) {
+          SPI.transfer(MAX7219_REG_DIGIT0 + pos);
+          SPI.transfer(_digits[i][pos]);
+        } else {
+          SPI.transfer(MAX7219_REG_NOOP);
+          SPI.transfer(0);
+        }
+      }
+      digitalWrite(_cs_pin, HIGH);
+      SPI.endTransaction();
+
+      _dirty[pos] = 0;
+    }
+  }
+
+private:
+  uint8_t _cs_pin;
+  uint8_t _count;
+  bool _ready;
+  uint8_t _digits[MAX7219_MAX_CHAIN][MAX7219_DIGITS];
+  uint8_t _dirty[MAX7219_DIGITS]; // Bit per device, for each digit register
+};
+
+class SsedComponent : public OutputComponent {
+public:
+  // A display on its own pins, driven through LedControl
+  SsedComponent(char* id, uint8_t clock_pin, uint8_t data_pin, uint8_t cs_pin)
+    : OutputComponent(id, ssed_type) {
+      this->_led = new LedControl(data_pin, clock_pin, cs_pin);
+      this->_chain = NULL;
+      this->_device = 0;
+
+      // Init values
+      this->_brightness = 1;
+      this->_valid = 0;
+  }
+
+  // Device number device on a chain of MAX7219s, 0 being nearest the MCU
+  SsedComponent(char* id, MyMax7219* chain, uint8_t device)
+    : OutputComponent(id, ssed_type) {
+      this->_led = NULL;
+      this->_chain = chain;
+      this->_device = device;
+
+      // Init values
+      this->_brightness = 1;
+      this->_valid = 0;
+  }
+
+  char* set(char* args) {
+    char* line_num;
+    char* pos;
+    uint8_t pos_num;
+    char* params;
+    char* output;
+
+    line_num = pop_token(args, &params);
+    if (!line_num)
+      return "ERR\tSET wanted pos num";
+
+    // Clear the entire screen
+    if(strcasecmp(line_num, "CLR") == 0) 
+    {
+      for (pos_num = 0; pos_num < MAX7219_DIGITS; pos_num++)
+        display_segments(pos_num, SSED_SEG_BLANK);
+
+      return "ACK";
+    }
+
+    // Handle backlight
+    if(strcasecmp(line_num, "LIGHT") == 0) 
+    {
+      if(strcasecmp(params, "OFF") == 0) {
+        _brightness = 0;
+        apply_brightness();
+
+        return "ACK";
+      }
+
+      if(strcasecmp(params, "ONN") == 0) {
+        _brightness = 1;
+        apply_brightness();
+
+        return "ACK";
+      }
+     
+      // This should be 0-7
+      if( (params[0]) 
+          && (params[0] >= '0') 
+          && (params[0] <= '7') ) {
+        _brightness = params[0] - '0';
+        apply_brightness();
+      }else{
+        return "ERR Valid LIGHT values are 0-7";
+      }
+
+      return "ACK";
+    }
+
+    // Whole value, as display_digits() does
+    if(strcasecmp(line_num, "NUM") == 0) 
+    {
+      pos = params ? pop_token(params, &output) : NULL;
+      if (!pos)
+        return "ERR SET NUM wanted value";
+
+      display_digits(strtoul(pos, NULL, 10));
+
+      return "ACK";
+    }
+
+    // Treat it as a one digit line number
+    switch (line_num[0]) {
+      case '1':
+        pos_num = 0;
+        break;
       case '2':
         pos_num = 1;
         break;
-      case '3':
-        pos_num = 2;
+      case '3':
+        pos_num = 2;
+        break;
+      case '4':
+        pos_num = 3;
+        break;
+      case '5':
+        pos_num = 4;
+        break;
+      case '6':
+        pos_num = 5;
+        break;
+      case '7':
+        pos_num = 6;
+        break;
+      case '8':
+        pos_num = 7;
+        break;
+      default:
+        return "ERR SET invalid pos num";
+    }
+
+    pos = pop_token(params, &output);
+    if (!pos)
+      return "ERR SET needs value after pos num";
+
+    display_digit(pos_num, pos[0]);
+    
+    return "ACK";
+  }
+
+  void update() {
+    // Changed digits on a chain go out together, whichever display
+    // on it gets here first
+    if (_chain)
+      _chain->flush();
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), _brightness);
+  }
+
+  bool setup() {
+    if (_chain) {
+      _chain->setup();
+    } else {
+      _led->shutdown(0, false);
+      _led->clearDisplay(0);
+    }
+    apply_brightness();
+
+    // Both start blanked
+    memset(_segs, SSED_SEG_BLANK, sizeof(_segs));
+    _valid = 0xFF;
+
+    return true;
+  }
+
+  // Display a single character at a given position
+  // Supports numbers and a limited number of characters
+  void display_digit(uint8_t pos, int8_t data) {
+    display_segments(pos, ssed_coding(data));
+  }
+
+  // Digits that haven't changed aren't resent, and there's no clear
+  // first, so a refresh doesn't flicker
+  void display_digits(uint32_t num) {
+    uint32_t disp_num = num;
+
+    for(int i=0; i<8; i++) {
+      display_digit(i, (disp_num % 10));
+      disp_num = disp_num / 10;
+    }
+  }
+
+  void display_segments(uint8_t pos, uint8_t segs) {
+    if (pos >= MAX7219_DIGITS)
+      return;
+
+    if ((_valid & _BV(pos)) && _segs[pos] == segs)
+      return;
+
+    if (_chain)
+      _chain->setDigit(_device, pos, segs);
+    else
+      _led->setRow(0, pos, segs);
+
+    _segs[pos] = segs;
+    _valid |= _BV(pos);
+  }
+
+private:
+  LedControl* _led;
+  MyMax7219* _chain;
+  uint8_t _device;
+  uint8_t _brightness; // Value is 0-7
+  uint8_t _segs[MAX7219_DIGITS]; // Last segments written to each digit
+  uint8_t _valid; // Bit per digit that _segs is known for
+
+  void apply_brightness() {
+    if (_chain)
+      _chain->write(_device, MAX7219_REG_INTENSITY, _brightness);
+    else
+      _led->setIntensity(0, _brightness);
+  }
+};
+
+
+#endif // #ifdef SSED_SUPPORT
+
+
+//
+// BUZZER_SUPPORT
+// Pattern player for a buzzer on a direct pin. Timer1 belongs to the
+// player, so analogWrite() on pins 9 and 10 and the Servo library
+// can't be used alongside it.
+//
+#ifdef BUZZER_SUPPORT
+#include <avr/interrupt.h>
+
+// Step frequencies with a special meaning
+#define BUZZ_SILENT 0  // Pin low
+#define BUZZ_ON 1      // Pin high, for buzzers with their own oscillator
+#define BUZZ_MIN_HZ 31
+#define BUZZ_MAX_HZ 16000
+
+// A step with no duration ends the pattern, its frequency says how
+#define BUZZ_STOP 0
+#define BUZZ_REPEAT 1
+
+// Rate the timer runs at when it's only counting off a step
+#define BUZZ_TICK_HZ 1000
+
+#define BUZZ_NONE 0xFF
+
+typedef struct buzz_step {
+  uint16_t freq;  // Hz, or BUZZ_SILENT / BUZZ_ON
+  uint16_t ms;
+} buzz_step_t;
+
+const buzz_step_t BUZZ_STEPS[] PROGMEM = {
+  // 0: Silence
+  { BUZZ_STOP, 0 },
+  // 1: Single beep
+  { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 2: Two beeps
+  { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 }, { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 3: Three beeps
+  { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 }, { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 },
+  { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 4: Alarm, four quick beeps then a pause, until stopped
+  { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 }, { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 },
+  { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 }, { BUZZ_ON, 80 }, { BUZZ_SILENT, 600 },
+  { BUZZ_REPEAT, 0 },
+  // 5: Slow pulse, until stopped
+  { BUZZ_ON, 500 }, { BUZZ_SILENT, 500 }, { BUZZ_REPEAT, 0 },
+  // 6: Falling chime
+  { 1319, 150 }, { 988, 150 }, { 659, 300 }, { BUZZ_STOP, 0 },
+  // 7: Two tone siren, until stopped
+  { 880, 300 }, { 660, 300 }, { BUZZ_REPEAT, 0 }
+};
+
+// Index of each pattern's first step
+const uint8_t BUZZ_PATTERNS[] PROGMEM = { 0, 1, 3, 7, 13, 22, 25, 29 };
+#define BUZZ_PATTERN_COUNT (sizeof(BUZZ_PATTERNS) / sizeof(BUZZ_PATTERNS[0]))
+
+/*
+ * Pattern player
+ *
+ * Timer1 runs in CTC mode, interrupting at twice the tone frequency
+ * while a tone is playing (toggling the pin each time), or at
+ * BUZZ_TICK_HZ otherwise. Every interrupt counts down the current
+ * step, and the next step is loaded from the table in the ISR, so a
+ * pattern keeps its timing however long loop() takes.
+ */
+volatile uint8_t* BUZZ_PORT = NULL;
+uint8_t BUZZ_MASK = 0;
+volatile uint8_t BUZZ_PATTERN = BUZZ_NONE;
+uint8_t BUZZ_START = 0;
+uint8_t BUZZ_STEP = 0;
+bool BUZZ_TONE = false;
+uint16_t BUZZ_TICKS = 0;
+
+void buzz_stop() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+  BUZZ_TONE = false;
+  BUZZ_PATTERN = BUZZ_NONE;
+
+  if (BUZZ_PORT)
+    *BUZZ_PORT &= ~BUZZ_MASK;
+}
+
+// Load BUZZ_STEP into the timer, called from the ISR once running
+void buzz_load() {
+  uint16_t freq = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].freq);
+  uint16_t ms = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].ms);
+  uint16_t hz;
+  uint32_t ticks;
+
+  if (!ms) {
+    if (freq != BUZZ_REPEAT || BUZZ_STEP == BUZZ_START) {
+      buzz_stop();
+      return;
+    }
+
+    BUZZ_STEP = BUZZ_START;
+    freq = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].freq);
+    ms = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].ms);
+  }
+
+  BUZZ_TONE = (freq > BUZZ_ON);
+  hz = BUZZ_TONE ? (constrain(freq, BUZZ_MIN_HZ, BUZZ_MAX_HZ) * 2) : BUZZ_TICK_HZ;
+
+  if (freq == BUZZ_ON)
+    *BUZZ_PORT |= BUZZ_MASK;
+  else
+    *BUZZ_PORT &= ~BUZZ_MASK;
+
+  ticks = ((uint32_t)ms * hz) / 1000;
+  BUZZ_TICKS = ticks ? min(ticks, 0xFFFFUL) : 1;
+  OCR1A = (F_CPU / 8) / hz - 1;
+  BUZZ_STEP++;
+}
+
+void buzz_play(uint8_t pattern) {
+  buzz_stop();
+
+  BUZZ_START = pgm_read_byte(&BUZZ_PATTERNS[pattern]);
+  BUZZ_STEP = BUZZ_START;
+  BUZZ_PATTERN = pattern;
+
+  // CTC, clk/8
+  TCCR1A = 0;
+  TCNT1 = 0;
+  buzz_load();
+  if (BUZZ_PATTERN == BUZZ_NONE)
+    return;
+
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  TCCR1B = _BV(WGM12) | _BV(CS11);
+}
+
+ISR(TIMER1_COMPA_vect) {
+  if (BUZZ_TONE)
+    *BUZZ_PORT ^= BUZZ_MASK;
+
+  if (!--BUZZ_TICKS)
+    buzz_load();
+}
+
+
+class BuzzerComponent : public OutputComponent {
+public:
+  BuzzerComponent(char* id, uint8_t pin)
+    : OutputComponent(id, buzzer_type) {
+    this->_pin = pin;
+  }
+
+  // PATTERN <n>, or OFF
+  char* set(char* args) {
+    char* cmd;
+    char* params;
+    char* value;
+    int pattern;
+
+    cmd = pop_token(args, &params);
+    if (!cmd)
+      return "ERR BUZZ SET wanted PATTERN or OFF";
+
+    if (strcasecmp(cmd, "OFF") == 0) {
+      buzz_stop();
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "PATTERN") == 0) {
+      value = params ? pop_token(params, NULL) : NULL;
+      if (!value)
+        return "ERR BUZZ PATTERN wanted a pattern number";
+
+      pattern = atoi(value);
+      if (pattern < 0 || pattern >= (int)BUZZ_PATTERN_COUNT)
+        return "ERR BUZZ PATTERN out of range";
+
+      buzz_play(pattern);
+      return "ACK";
+    }
+
+    return "ERR BUZZ SET wanted PATTERN or OFF";
+  }
+
+  // Patterns run from the timer interrupt
+  void update() {}
+
+  void getMessage(char* buf) {
+    uint8_t pattern = BUZZ_PATTERN;
+
+    if (pattern == BUZZ_NONE)
+      sprintf(buf, "%s\t%s\tOFF", id, getCTypeName(type));
+    else
+      sprintf(buf, "%s\t%s\tPATTERN\t%hhu", id, getCTypeName(type), pattern);
+  }
+
+  bool setup() {
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+
+    BUZZ_PORT = portOutputRegister(digitalPinToPort(_pin));
+    BUZZ_MASK = digitalPinToBitMask(_pin);
+
+    return true;
+  }
+
+private:
+  uint8_t _pin;
+};
+
+#endif // #ifdef BUZZER_SUPPORT
+
+
+//
+// DS3231_SUPPORT
+// Time is kept in software and only read from the chip now and then.
+// With the chip's 1Hz square wave wired to an interrupt pin the
+// seconds are counted in the ISR, otherwise millis() carries the
+// clock between reads.
+//
+#ifdef DS3231_SUPPORT
+#ifdef TWI_SUPPORT
+#error "TWI_SUPPORT replaces Wire, which DS3231_SUPPORT depends on"
+#endif
+#include <DS3231M.h>
+
+#define DS3231_NO_SQW 0xFF
+
+// How often the software clock is checked against the chip
+#ifndef DS3231_RESYNC_MS
+#define DS3231_RESYNC_MS 600000UL
+#endif
+
+// Reads are only taken this soon after an edge, so they line up with it
+#define DS3231_SYNC_WINDOW_MS 100
+
+// No edge for this long means the square wave isn't there
+#define DS3231_SQW_LOST_MS 1500
+
+/*
+ * Software clock, seconds since the epoch as of the last 1Hz edge and
+ * the millis() it came at. Without the square wave RTC_EDGE_MS is the
+ * time of the last read from the chip instead.
+ */
+volatile uint32_t RTC_SECONDS = 0;
+volatile uint32_t RTC_EDGE_MS = 0;
+
+void rtc_sqw_edge() {
+  RTC_SECONDS++;
+  RTC_EDGE_MS = millis();
+}
+
+// Current time, whole seconds past the last edge are carried over for
+// when the square wave is missing
+uint32_t rtc_now(uint16_t* ms = NULL) {
+  uint32_t seconds;
+  uint32_t since;
+
+  noInterrupts();
+  seconds = RTC_SECONDS;
+  since = millis() - RTC_EDGE_MS;
+  interrupts();
+
+  if (ms)
+    *ms = since % 1000;
+
+  return seconds + (since / 1000);
+}
+
+class Ds3231Component : public OutputComponent {
+public:
+  Ds3231Component(char* id, uint8_t clock_pin, uint8_t data_pin, uint8_t sqw_pin = DS3231_NO_SQW)
+    : OutputComponent(id, rtc_type) {
+      this->_rtc = new DS3231M_Class();
+      this->_sqw_pin = sqw_pin;
+  }
+
+  char* set(char* args) {
+    char* new_time_str;
+    uint32_t new_time_int = 0;
+    char* params;
+
+    new_time_str = pop_token(args, &params);
+    if (!new_time_str)
+      return "ERR\tSET needs new time value (in secs)";
+
+    new_time_int = atol(new_time_str);
+    if(!new_time_int)
+      return "ERR\tcouldn't parse new time value to int";
+    
+    DateTime new_time = DateTime(new_time_int);
+    _rtc->adjust(new_time);
+
+    // Writing the seconds restarts the square wave, so start over
+    restart();
+
+    return "ACK";
+  }
+
+  void update() {
+    if (!is_tc_alert(_resync))
+      return;
+
+    // Wait for the next edge to come by
+    if (sqw_running() && (millis() - RTC_EDGE_MS) > DS3231_SYNC_WINDOW_MS)
+      return;
+
+    sync(sqw_running());
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%lu", id, getCTypeName(type), get_unixtime());
+  }
+
+  bool setup() {
+    uint16_t fail_count = 0;
+    
+    // Handle RTC init
+    while(!_rtc->begin()) {
+      // serial_output("RTC", "Init Failing");
+      delay(1600);
+      fail_count++;
+
+      if(fail_count > 3)
+        return false;
+    }
+
+    // Set time if it hasn't already been set
+    DateTime now = _rtc->now();
+    if(!now.hour() && !now.minute()) { // Only reset internal clock if we think it's wrong.
+      // Change to compile time
+      _rtc->adjust();
+    }
+
+    if (_sqw_pin != DS3231_NO_SQW && digitalPinToInterrupt(_sqw_pin) != NOT_AN_INTERRUPT) {
+      _rtc->pinSquareWave();
+      pinMode(_sqw_pin, INPUT_PULLUP);  // Open drain
+      attachInterrupt(digitalPinToInterrupt(_sqw_pin), rtc_sqw_edge, FALLING);
+    } else
+      _sqw_pin = DS3231_NO_SQW;
+
+    restart();
+
+    return true;
+  }
+
+  // Return seconds since UNIX EPOCH
+  uint32_t get_unixtime() {
+    return rtc_now();
+  }
+
+  // Return "clock time"
+  // Ex. 16:01 -> 1601 as uint16_t
+  uint16_t get_clock_time() {
+    DateTime now = DateTime(rtc_now());
+    return (now.hour() * 100) + now.minute();
+  }
+
+private:
+  DS3231M_Class* _rtc;
+  uint8_t _sqw_pin;
+  tick _resync = 0;
+
+  // Load the chip's time into the software clock. on_edge keeps the
+  // edge time, otherwise the read becomes the new reference.
+  void sync(bool on_edge) {
+    uint32_t now = _rtc->now().unixtime();
+
+    noInterrupts();
+    RTC_SECONDS = now;
+    if (!on_edge)
+      RTC_EDGE_MS = millis();
+    interrupts();
+
+    _resync = get_tc_alert(DS3231_RESYNC_MS);
+  }
+
+  // Take the time whenever, then line it up with the square wave once
+  // an edge has come by
+  void restart() {
+    sync(false);
+
+    if (_sqw_pin != DS3231_NO_SQW)
+      _resync = get_tc_alert(DS3231_SQW_LOST_MS);
+  }
+
+  bool sqw_running() {
+    return _sqw_pin != DS3231_NO_SQW && (millis() - RTC_EDGE_MS) < DS3231_SQW_LOST_MS;
+  }
+};
+
+#endif // #ifdef DS3231_SUPPORT
+
+
+//
+// ALARM_SUPPORT
+// Any number of alarms (up to ALARM_MAX) on a hierarchical timer
+// wheel, each reported as an EVENT when it goes off.
+//
+#ifdef ALARM_SUPPORT
+
+#ifndef ALARM_MAX
+#define ALARM_MAX 8
+#endif
+
+// Wheel resolution
+#ifndef ALARM_TICK_MS
+#define ALARM_TICK_MS 100
+#endif
+
+// Levels of 32 slots, a slot on one level spans a whole turn of the
+// level below, so 4 levels reach 2^20 ticks (29 hours at 100ms).
+// Alarms further out sit on the top level and are placed again each
+// time it comes round.
+#define ALARM_WHEEL_BITS 5
+#define ALARM_WHEEL_SLOTS (1 << ALARM_WHEEL_BITS)
+#define ALARM_WHEEL_MASK (ALARM_WHEEL_SLOTS - 1)
+#define ALARM_LEVELS 4
+
+#define ALARM_NIL 0xFF
+
+typedef struct alarm_entry {
+  uint32_t expires;  // Wheel tick it goes off on
+  uint8_t id;        // Id given by the host, ALARM_NIL when free
+  uint8_t slot;      // Wheel slot it's listed in
+  uint8_t next;
+  uint8_t prev;
+} alarm_entry_t;
+
+/*
+ * Alarm scheduler
+ *
+ * Adding or removing an alarm is constant time, it's linked into the
+ * slot for its expiry on the lowest level that reaches it. Every tick
+ * only looks at one slot of the bottom level, and whenever a level
+ * completes a turn the next slot of the level above is spread back
+ * down, so the cost per tick doesn't grow with the number of alarms.
+ *
+ * SET <id> ADD <n> <ms>, or ADD <n> AT <unixtime> with DS3231_SUPPORT,
+ * SET <id> DEL <n>, SET <id> LIST
+ */
+class AlarmComponent : public InputComponent {
+public:
+  AlarmComponent(char* id)
+    : InputComponent(id, alarm_type) {
+      // Do nothing
+  }
+
+  bool poll() {
+    uint8_t i;
+
+    _event = ALARM_NIL;
+
+    // Catch the wheel up with the clock
+    while ((GLOBAL_TC - _last) >= ALARM_TICK_MS) {
+      _last += ALARM_TICK_MS;
+      advance();
+    }
+
+    // Report one alarm per poll()
+    if (!_fired_count)
+      return false;
+
+    _event = _fired[0];
+    _fired_count--;
+    for (i = 0; i < _fired_count; i++)
+      _fired[i] = _fired[i + 1];
+
+    return true;
+  }
+
+  void getMessage(char* buf) {
+    if (_event != ALARM_NIL)
+      sprintf(buf, "%s\t%s\tFIRE\t%hhu", id, getCTypeName(type), _event);
+    else
+      sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), _count);
+  }
+
+  char* set(char* args) {
+    char* cmd;
+    char* params;
+    char* id_str;
+    char* value;
+    uint8_t n;
+
+    cmd = pop_token(args, &params);
+    if (!cmd)
+      return "ERR\tSET wanted ADD, DEL or LIST";
+
+    if (strcasecmp(cmd, "LIST") == 0) {
+      list();
+      return "ACK";
+    }
+
+    id_str = params ? pop_token(params, &params) : NULL;
+    if (!id_str || atoi(id_str) < 0 || atoi(id_str) >= ALARM_NIL)
+      return "ERR\tSET wanted an alarm id, 0-254";
+    n = atoi(id_str);
+
+    if (strcasecmp(cmd, "DEL") == 0)
+      return remove(n) ? "ACK" : "ERR\tALARM DEL alarm not found";
+
+    if (strcasecmp(cmd, "ADD") != 0)
+      return "ERR\tSET wanted ADD, DEL or LIST";
+
+    value = params ? pop_token(params, &params) : NULL;
+    if (!value)
+      return "ERR\tALARM ADD wanted ms or AT <unixtime>";
+
+#ifdef DS3231_SUPPORT
+    if (strcasecmp(value, "AT") == 0) {
+      uint16_t ms;
+      uint32_t now = rtc_now(&ms);
+      uint32_t at;
+
+      value = params ? pop_token(params, NULL) : NULL;
+      at = value ? atol(value) : 0;
+      if (at <= now)
+        return "ERR\tALARM ADD AT is in the past";
+
+      // Out past about 49 days won't fit
+      if ((at - now) > 4000000UL)
+        return "ERR\tALARM ADD AT is too far off";
+
+      return add(n, ((at - now) * 1000) - ms) ? "ACK" : "ERR\tALARM ADD no free alarms";
+    }
+#endif
+
+    if (atol(value) <= 0)
+      return "ERR\tALARM ADD wanted a positive ms";
+
+    return add(n, atol(value)) ? "ACK" : "ERR\tALARM ADD no free alarms";
+  }
+
+  bool setup() {
+    uint8_t i;
+
+    for (i = 0; i < ALARM_MAX; i++)
+      _alarms[i].id = ALARM_NIL;
+    memset(_wheel, ALARM_NIL, sizeof(_wheel));
+
+    _last = GLOBAL_TC;
+    return true;
+  }
+
+  // Schedule alarm n to go off in ms, replacing any alarm n already set
+  bool add(uint8_t n, uint32_t ms) {
+    uint8_t e;
+
+    remove(n);
+
+    for (e = 0; e < ALARM_MAX; e++)
+      if (_alarms[e].id == ALARM_NIL)
+        break;
+
+    if (e >= ALARM_MAX)
+      return false;
+
+    // The next tick runs within ALARM_TICK_MS, count from when it would
+    _alarms[e].id = n;
+    _alarms[e].expires = _now + ((GLOBAL_TC - _last) + ms + ALARM_TICK_MS - 1) / ALARM_TICK_MS;
+    if (_alarms[e].expires != _now)
+      _alarms[e].expires--;
+
+    schedule(e);
+    _count++;
+
+    return true;
+  }
+
+  bool remove(uint8_t n) {
+    uint8_t e = find(n);
+
+    if (e == ALARM_NIL)
+      return false;
+
+    unlink(e);
+    _alarms[e].id = ALARM_NIL;
+    _count--;
+
+    return true;
+  }
+
+  void set_alarm(uint32_t millis) {
+    add(0, millis);
+  }
+
+private:
+  alarm_entry_t _alarms[ALARM_MAX];
+  uint8_t _wheel[ALARM_LEVELS * ALARM_WHEEL_SLOTS];
+  uint32_t _now = 0;  // Next wheel tick to run
+  tick _last = 0;     // GLOBAL_TC that tick was due at
+  uint8_t _count = 0;
+  uint8_t _fired[ALARM_MAX];
+  uint8_t _fired_count = 0;
+  uint8_t _event = ALARM_NIL;
+
+  uint8_t find(uint8_t n) {
+    uint8_t e;
+
+    for (e = 0; e < ALARM_MAX; e++)
+      if (_alarms[e].id == n)
+        return e;
+
+    return ALARM_NIL;
+  }
+
+  void list() {
+    char buf[SERIAL_BUFFER_SIZE];
+    uint32_t left;
+    uint8_t e;
+
+    for (e = 0; e < ALARM_MAX; e++) {
+      if (_alarms[e].id == ALARM_NIL)
+        continue;
+
+      left = (_alarms[e].expires - _now + 1) * ALARM_TICK_MS - (GLOBAL_TC - _last);
+      snprintf(buf, (SERIAL_BUFFER_SIZE-3), "%s\t%hhu\t%lu", id, _alarms[e].id, left);
+      Serial.println(buf);
+      Serial.flush();
+    }
+  }
+
+  // Link an alarm into the lowest level that reaches its expiry
+  void schedule(uint8_t e) {
+    alarm_entry_t* a = &_alarms[e];
+    uint32_t delta = a->expires - _now;
+    uint8_t level;
+    uint8_t slot;
+
+    for (level = 0; level < ALARM_LEVELS - 1; level++)
+      if (delta < (1UL << ((level + 1) * ALARM_WHEEL_BITS)))
+        break;
+
+    slot = (level * ALARM_WHEEL_SLOTS) + ((a->expires >> (level * ALARM_WHEEL_BITS)) & ALARM_WHEEL_MASK);
+
+    a->slot = slot;
+    a->prev = ALARM_NIL;
+    a->next = _wheel[slot];
+    if (a->next != ALARM_NIL)
+      _alarms[a->next].prev = e;
+    _wheel[slot] = e;
+  }
+
+  void unlink(uint8_t e) {
+    alarm_entry_t* a = &_alarms[e];
+
+    if (a->prev != ALARM_NIL)
+      _alarms[a->prev].next = a->next;
+    else
+      _wheel[a->slot] = a->next;
+
+    if (a->next != ALARM_NIL)
+      _alarms[a->next].prev = a->prev;
+  }
+
+  // Spread a slot of an upper level back down, returns the slot index
+  uint8_t cascade(uint8_t level) {
+    uint8_t index = (_now >> (level * ALARM_WHEEL_BITS)) & ALARM_WHEEL_MASK;
+    uint8_t slot = (level * ALARM_WHEEL_SLOTS) + index;
+    uint8_t e = _wheel[slot];
+    uint8_t next;
+
+    _wheel[slot] = ALARM_NIL;
+    for (; e != ALARM_NIL; e = next) {
+      next = _alarms[e].next;
+      schedule(e);
+    }
+
+    return index;
+  }
+
+  void advance() {
+    uint8_t index = _now & ALARM_WHEEL_MASK;
+    uint8_t level;
+    uint8_t e;
+    uint8_t next;
+
+    if (!index)
+      for (level = 1; level < ALARM_LEVELS; level++)
+        if (cascade(level))
+          break;
+
+    e = _wheel[index];
+    _wheel[index] = ALARM_NIL;
+    for (; e != ALARM_NIL; e = next) {
+      next = _alarms[e].next;
+
+      // Never go off early
+      if (_alarms[e].expires != _now) {
+        schedule(e);
+        continue;
+      }
+
+      if (_fired_count < ALARM_MAX)
+        _fired[_fired_count++] = _alarms[e].id;
+      _alarms[e].id = ALARM_NIL;
+      _count--;
+    }
+
+    _now++;
+  }
+};
+
+#endif // #ifdef ALARM_SUPPORT
+
+//
+// MOTION_SUPPORT
+// A pair of steppers driving one load from either side, the second
+// turning the opposite way. Steps come from Timer1, so like
+// BUZZER_SUPPORT it rules out analogWrite() on pins 9 and 10 and the
+// Servo library.
+//
+#ifdef MOTION_SUPPORT
+#ifdef BUZZER_SUPPORT
+#error "MOTION_SUPPORT and BUZZER_SUPPORT both need Timer1"
+#endif
+
+#include <avr/interrupt.h>
+
+// Stored positions, slot 0 is home
+#ifndef MOTION_SLOTS
+#define MOTION_SLOTS 4
+#endif
+
+// Target for moves that run until STOP or a limit switch
+#define MOTION_JOG_STEPS 1000000L
+
+// Speed levels in the acceleration profile, up to 127
+#ifndef STEP_LEVELS
+#define STEP_LEVELS 64
+#endif
+
+// Default profile, in steps/s, steps/s/s and steps/s/s/s
+#ifndef STEP_TOP_SPEED
+#define STEP_TOP_SPEED 8000
+#endif
+#ifndef STEP_ACCEL
+#define STEP_ACCEL 16000
+#endif
+#ifndef STEP_JERK
+#define STEP_JERK 100000UL
+#endif
+
+// Timer1 runs at F_CPU / 8
+#define STEP_TICK_HZ (F_CPU / 8)
+
+/*
+ * Step generator
+ *
+ * The profile splits 0 to the top speed into STEP_LEVELS even levels.
+ * Each level has its step interval in timer ticks, and how many steps
+ * to dwell there before moving on, which sets the acceleration. The
+ * ISR only counts.
+ *
+ * At the end of each level the ISR climbs one level if there's still
+ * room to come back down, stays if there's room to stay, and otherwise
+ * drops one. STEP_BRAKE keeps the steps it takes to get from the
+ * current level back to a stop, so a move never has to be planned
+ * step by step, and can be cut short or lengthened on the fly.
+ *
+ * STEP_CAP is the level count the ISR may climb to. The dwells are
+ * shaped for it as an S-curve: acceleration builds up at the jerk
+ * limit leaving the bottom, and eases off the same way nearing the
+ * cap, so the motors never see a step change in acceleration.
+ *
+ * Everything is integer. The interval and the acceleration k levels
+ * from either end of a ramp are worked out once by step_profile().
+ * Shaping for a new cap only redoes the dwells, into the spare one of
+ * two buffers, which is swapped in between steps. That's how the
+ * speed can change mid-move, and how a move too short to reach the
+ * requested speed gets a gentle peak of its own.
+ *
+ * loop() only hands over targets, and the step rate doesn't depend
+ * on it at all.
+ */
+uint16_t STEP_INTERVAL[STEP_LEVELS];
+uint16_t STEP_RATE[STEP_LEVELS];  // Acceleration k levels from an end
+uint16_t STEP_SHAPES[2][STEP_LEVELS];
+uint16_t* STEP_DWELL = STEP_SHAPES[0];
+uint16_t STEP_DV16 = 0;           // Speed between levels, 1/16 steps/s
+
+uint8_t STEP_SPEED_CAP = STEP_LEVELS;  // From the requested speed
+uint8_t STEP_MOVE_CAP = STEP_LEVELS;   // Highest the move can peak at
+uint8_t STEP_SHAPED = 0xFF;            // Cap STEP_DWELL is shaped for
+
+volatile uint8_t* STEP_PORT_L = NULL;
+volatile uint8_t* STEP_PORT_R = NULL;
+uint8_t STEP_MASK_L = 0;
+uint8_t STEP_MASK_R = 0;
+
+volatile int32_t STEP_POS = 0;    // Position, left motor's way round
+volatile uint32_t STEP_LEFT = 0;  // Steps to go, 0 when idle
+volatile uint32_t STEP_BRAKE = 0;
+volatile uint8_t STEP_CAP = 0;    // Highest level + 1, 0 to hold
+int8_t STEP_DIR = 1;
+uint8_t STEP_LEVEL = 0;
+uint16_t STEP_COUNT = 0;          // Steps taken on this level
+
+void step_timer_off() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+}
+
+void step_timer_on() {
+  OCR1A = STEP_INTERVAL[STEP_LEVEL];
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A);
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11);
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+bool step_paused() {
+  return !(TIMSK1 & _BV(OCIE1A));
+}
+
+uint16_t step_isqrt(uint32_t x) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > x)
+    bit >>= 2;
+
+  while (bit) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+// Acceleration at v steps/s, starting from rest at the jerk limit.
+// v = a^2 / (2 * jerk) until a reaches accel, so a = sqrt(2 * jerk * v)
+uint16_t step_accel(uint16_t accel, uint32_t jerk, uint32_t v) {
+  if (v >= (((uint32_t)accel * accel) >> 1) / jerk)
+    return accel;
+
+  return max(step_isqrt(2 * jerk * v), 1);
+}
+
+// Steps to spend on level i, when climbing to cap
+uint16_t step_dwell(uint8_t i, uint8_t cap) {
+  uint16_t rate = STEP_RATE[i];
+  uint32_t v = ((uint32_t)STEP_DV16 * (i + 1)) >> 4;
+  uint32_t n;
+
+  // Easing into the cap from below, or back down onto it from above
+  if (i + 1 < cap)
+    rate = min(rate, STEP_RATE[cap - 2 - i]);
+  else if (i >= cap)
+    rate = min(rate, STEP_RATE[i - cap]);
+
+  // Gaining one level takes dv / rate seconds, at v steps/s
+  // setProfile() turns down profiles that won't fit
+  n = (((v * STEP_DV16) >> 4) + (rate >> 1)) / rate;
+  return constrain(n, 1, 0xFFFF);
+}
+
+// Steps to climb from a stop to the top of cap, and so to come back
+uint32_t step_climb(uint8_t cap) {
+  uint32_t steps = 0;
+  uint8_t i;
+
+  for (i = 0; i + 1 < cap; i++)
+    steps += step_dwell(i, cap);
+
+  return steps;
+}
+
+// Shape the spare dwells for cap and swap them in
+void step_shape(uint8_t cap) {
+  uint16_t* dwell;
+  uint8_t sreg;
+  uint32_t brake = 0;
+  uint8_t i;
+
+  if (cap == STEP_SHAPED)
+    return;
+
+  dwell = (STEP_DWELL == STEP_SHAPES[0]) ? STEP_SHAPES[1] : STEP_SHAPES[0];
+  for (i = 0; i < STEP_LEVELS; i++)
+    dwell[i] = step_dwell(i, cap);
+
+  // The way down from the current level changed along with it
+  sreg = SREG;
+  cli();
+  for (i = 0; i < STEP_LEVEL; i++)
+    brake += dwell[i];
+
+  STEP_DWELL = dwell;
+  STEP_BRAKE = brake;
+  STEP_CAP = cap;
+  SREG = sreg;
+
+  STEP_SHAPED = cap;
+}
+
+// Integer only, must be called while idle
+void step_profile(uint16_t accel, uint16_t top, uint32_t jerk) {
+  uint32_t x;
+  uint8_t i;
+
+  STEP_DV16 = ((uint32_t)top << 4) / STEP_LEVELS;
+
+  for (i = 0; i < STEP_LEVELS; i++) {
+    x = (STEP_TICK_HZ << 4) / ((uint32_t)STEP_DV16 * (i + 1));
+    STEP_INTERVAL[i] = min(x, 0xFFFFUL);
+
+    // At the speed half way through level k
+    x = ((uint32_t)STEP_DV16 * (2 * i + 1)) >> 5;
+    STEP_RATE[i] = step_accel(accel, jerk, x);
+  }
+
+  STEP_SHAPED = 0xFF;
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+}
+
+// Highest speed to climb to, 0 ramps down and holds the move
+void step_speed(uint16_t speed) {
+  uint32_t fastest;
+  uint8_t level = 0;
+
+  if (speed) {
+    fastest = STEP_TICK_HZ / speed;
+
+    // Every level no quicker than speed, and at least the first
+    while ((level < STEP_LEVELS) && (STEP_INTERVAL[level] >= fastest))
+      level++;
+
+    if (!level)
+      level = 1;
+  }
+
+  STEP_SPEED_CAP = level;
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+
+  if (STEP_CAP && STEP_LEFT && step_paused())
+    step_timer_on();
+}
+
+// Highest cap a move of dist steps can climb to and still stop
+uint8_t step_peak(uint32_t dist) {
+  uint8_t lo = 1;
+  uint8_t hi = STEP_SPEED_CAP ? STEP_SPEED_CAP : STEP_LEVELS;
+  uint8_t mid;
+
+  if ((2 * step_climb(hi)) <= dist)
+    return STEP_LEVELS;
+
+  while (lo + 1 < hi) {
+    mid = (lo + hi) / 2;
+    if ((2 * step_climb(mid)) <= dist)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+// Steps it takes to stop from here, call with interrupts off
+uint32_t step_brake() {
+  return STEP_BRAKE + STEP_DWELL[STEP_LEVEL] - STEP_COUNT;
+}
+
+// Ramp down to a stop as soon as possible
+void step_stop() {
+  uint8_t sreg = SREG;
+  uint32_t brake;
+
+  cli();
+  if (step_paused()) {
+    STEP_LEFT = 0;
+  } else {
+    brake = step_brake();
+    if (STEP_LEFT > brake)
+      STEP_LEFT = brake;
+  }
+  SREG = sreg;
+}
+
+// Stop dead, safe to call from another interrupt
+void step_halt() {
+  step_timer_off();
+  STEP_LEFT = 0;
+
+  *STEP_PORT_L &= ~STEP_MASK_L;
+  *STEP_PORT_R &= ~STEP_MASK_R;
+}
+
+int32_t step_position() {
+  uint8_t sreg = SREG;
+  int32_t pos;
+
+  cli();
+  pos = STEP_POS;
+  SREG = sreg;
+
+  return pos;
+}
+
+void step_zero() {
+  uint8_t sreg = SREG;
+
+  cli();
+  STEP_POS = 0;
+  SREG = sreg;
+}
+
+bool step_running() {
+  uint8_t sreg = SREG;
+  bool running;
+
+  cli();
+  running = (STEP_LEFT != 0);
+  SREG = sreg;
+
+  return running;
+}
+
+// Head for target, false when the motors must stop first because
+// they're going the other way, or can't stop in time
+bool step_move(int32_t target, uint8_t dir_l, uint8_t dir_r) {
+  uint8_t sreg = SREG;
+  int32_t dist;
+  int8_t dir;
+
+  cli();
+  dist = target - STEP_POS;
+  dir = (dist < 0) ? -1 : 1;
+  if (dist < 0)
+    dist = -dist;
+
+  if (STEP_LEFT) {
+    if (step_paused())
+      STEP_LEFT = 0;
+    else if ((dir != STEP_DIR) || ((uint32_t)dist < step_brake())) {
+      SREG = sreg;
+      step_stop();
+      return false;
+    } else {
+      STEP_LEFT = dist;
+      SREG = sreg;
+
+      // Already on its way, the ISR keeps it able to stop
+      STEP_MOVE_CAP = STEP_LEVELS;
+      step_shape(STEP_SPEED_CAP);
+      return true;
+    }
+  }
+  SREG = sreg;
+
+  if (!dist)
+    return true;
+
+  // Mirrored, so the right motor's DIR is the opposite level
+  digitalWrite(dir_l, (dir > 0) ? HIGH : LOW);
+  digitalWrite(dir_r, (dir > 0) ? LOW : HIGH);
+
+  STEP_DIR = dir;
+  STEP_LEVEL = 0;
+  STEP_COUNT = 0;
+  STEP_BRAKE = 0;
+
+  STEP_MOVE_CAP = step_peak(dist);
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+  STEP_LEFT = dist;
+
+  if (STEP_CAP)
+    step_timer_on();
+
+  return true;
+}
+
+ISR(TIMER1_COMPA_vect) {
+  uint8_t level = STEP_LEVEL;
+
+  // Pins go low again at the end, the work in between
+  // is longer than the pulse drivers need
+  *STEP_PORT_L |= STEP_MASK_L;
+  *STEP_PORT_R |= STEP_MASK_R;
+
+  STEP_POS += STEP_DIR;
+
+  if (!--STEP_LEFT) {
+    step_timer_off();
+    delayMicroseconds(2);
+
+  } else if (++STEP_COUNT >= STEP_DWELL[level]) {
+    STEP_COUNT = 0;
+
+    if (level >= STEP_CAP) {
+      // Over the cap, or holding
+      if (level) {
+        level--;
+        STEP_BRAKE -= STEP_DWELL[level];
+      } else {
+        step_timer_off();
+      }
+    } else if ((level + 1 < STEP_CAP)
+               && (STEP_LEFT >= (uint32_t)STEP_BRAKE + STEP_DWELL[level] + STEP_DWELL[level + 1])) {
+      STEP_BRAKE += STEP_DWELL[level];
+      level++;
+    } else if ((STEP_LEFT < (uint32_t)STEP_BRAKE + STEP_DWELL[level]) && level) {
+      level--;
+      STEP_BRAKE -= STEP_DWELL[level];
+    }
+
+    STEP_LEVEL = level;
+    OCR1A = STEP_INTERVAL[level];
+  }
+
+  *STEP_PORT_L &= ~STEP_MASK_L;
+  *STEP_PORT_R &= ~STEP_MASK_R;
+}
+
+
+enum MotionState {
+  motion_idle,
+  motion_moving,
+  motion_homing,
+  motion_limit
+};
+
+class MotionComponent : public OutputComponent {
+public:
+  MotionComponent(char* id, uint8_t step_l, uint8_t dir_l, uint8_t step_r, uint8_t dir_r)
+    : OutputComponent(id, motion_type) {
+    this->_step_l = step_l;
+    this->_dir_l = dir_l;
+    this->_step_r = step_r;
+    this->_dir_r = dir_r;
+    this->_state = motion_idle;
+    this->_hit = false;
+    this->_pending = false;
+    this->_target = 0;
+    memset(this->_slots, 0, sizeof(this->_slots));
+  }
+
+  // MOVE FWD|BACK|<steps>, STOP, GOTO <slot>, or SAVE <slot>
+  char* set(char* args) {
+    char* cmd;
+    char* params = NULL;
+    char* value;
+
+    cmd = args ? pop_token(args, &params) : NULL;
+    if (!cmd)
+      return "ERR MOTION SET wanted MOVE, STOP, GOTO or SAVE";
+
+    if (strcasecmp(cmd, "STOP") == 0) {
+      stop();
+      return "ACK";
+    }
+
+    value = params ? pop_token(params, NULL) : NULL;
+
+    if (strcasecmp(cmd, "MOVE") == 0) {
+      if (!value)
+        return "ERR MOTION MOVE wanted FWD, BACK or steps";
+
+      if (strcasecmp(value, "FWD") == 0)
+        jog(1);
+      else if (strcasecmp(value, "BACK") == 0)
+        jog(-1);
+      else
+        moveTo(position() + atol(value));
+
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "GOTO") == 0) {
+      if (!value)
+        return "ERR MOTION GOTO wanted a slot";
+
+      if (!gotoSlot(atoi(value)))
+        return "ERR MOTION GOTO slot out of range";
+
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "SAVE") == 0) {
+      if (!value)
+        return "ERR MOTION SAVE wanted a slot";
+
+      if (!saveSlot(atoi(value)))
+        return "ERR MOTION SAVE slot out of range";
+
+      return "ACK";
+    }
+
+    return "ERR MOTION SET wanted MOVE, STOP, GOTO or SAVE";
+  }
+
+  // Steps come from the timer, this only follows up on them
+  void update() {
+    if (_hit) {
+      _hit = false;
+      _pending = false;
+      _state = motion_limit;
+      return;
+    }
+
+    if (((_state != motion_moving) && (_state != motion_homing))
+        || step_running())
+      return;
+
+    // Stopped to turn round, now head for the real target
+    if (_pending) {
+      _pending = false;
+      step_move(_target, _dir_l, _dir_r);
+      return;
+    }
+
+    _state = motion_idle;
+  }
+
+  void getMessage(char* buf) {
+    const char* state;
+
+    switch (_state) {
+      case motion_moving:
+        state = "MOVE";
+        break;
+      case motion_homing:
+        state = "HOME";
         break;
-      case '4':
-        pos_num = 3;
+      case motion_limit:
+        state = "LIMIT";
         break;
       default:
-        return "ERR SET invalid pos num";
+        state = "IDLE";
     }
 
-    pos = pop_token(params, &output);
-    if (!pos)
-      return "ERR SET needs value after pos num";
+    sprintf(buf, "%s\t%s\t%s\t%ld", id, getCTypeName(type), state, position());
+  }
 
-    display_digit(pos_num, pos[0]);
-    
-    return "ACK";
+  bool setup() {
+#ifdef CONFIG_SUPPORT
+    uint8_t n;
+
+    for (n = 1; n < MOTION_SLOTS; n++)
+      restore(&_slots[n], n);
+#endif
+
+    pinMode(_step_l, OUTPUT);
+    pinMode(_dir_l, OUTPUT);
+    pinMode(_step_r, OUTPUT);
+    pinMode(_dir_r, OUTPUT);
+    digitalWrite(_step_l, LOW);
+    digitalWrite(_step_r, LOW);
+
+    STEP_PORT_L = portOutputRegister(digitalPinToPort(_step_l));
+    STEP_MASK_L = digitalPinToBitMask(_step_l);
+    STEP_PORT_R = portOutputRegister(digitalPinToPort(_step_r));
+    STEP_MASK_R = digitalPinToBitMask(_step_r);
+
+    step_profile(STEP_ACCEL, STEP_TOP_SPEED, STEP_JERK);
+    return true;
   }
 
-  void update() {
-    // We do nothing on update()
+  // Called from the limit switch interrupt, which also marks zero
+  void limit() {
+    step_halt();
+    STEP_POS = 0;
+    _hit = true;
   }
 
-  void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), _brightness);
+  void moveTo(int32_t pos) {
+    _target = pos;
+    _state = motion_moving;
+    _pending = !step_move(pos, _dir_l, _dir_r);
   }
 
-  bool setup() {
-    _tm1637->init();
-    _tm1637->point(false);
-    _tm1637->set(_brightness);
+  // Run one way until stop() or a limit switch
+  void jog(int8_t dir) {
+    moveTo((dir > 0) ? MOTION_JOG_STEPS : -MOTION_JOG_STEPS);
+  }
+
+  // Ramps down, update() goes idle once it's done
+  void stop() {
+    _pending = false;
+    step_stop();
+  }
 
+  // Steps per second per second, steps per second and steps per
+  // second per second per second, for motors that can do better
+  // than the defaults. Follow with setSpeed().
+  bool setProfile(uint16_t accel, uint16_t top, uint32_t jerk) {
+    uint16_t dv16 = ((uint32_t)top << 4) / STEP_LEVELS;
+
+    if (step_running() || !accel || (top < STEP_LEVELS) || !jerk)
+      return false;
+
+    // The longest dwell is easing into the top level, at the first
+    // level's acceleration. Too long to count and the ramp gets cut.
+    if ((((uint32_t)top * dv16) >> 4) / step_accel(accel, jerk, dv16 >> 5) > 0xFFFF)
+      return false;
+
+    step_profile(accel, top, jerk);
     return true;
   }
 
-  // Display a single character at a given position
-  // Supports numbers and a limited number of characters
-  void display_digit(uint8_t pos, int8_t data) {
-    _tm1637->display(pos, data);
+  // Steps per second, takes effect mid-move
+  void setSpeed(uint16_t speed) {
+    step_speed(speed);
   }
 
-  // Call with nolead = 0 to have in skip leading zeros
-  void display_digits(uint16_t num, uint8_t nolead=1) {
-    uint8_t i=0;
-    uint16_t base=1000;
+  int32_t position() {
+    return step_position();
+  }
 
-    for(i=0; i<4; i++) {
-      int8_t digit = ((num / base) % 10);
+  // Slot 0 homes against the limit switch
+  bool gotoSlot(uint8_t n) {
+    if (n >= MOTION_SLOTS)
+      return false;
 
-      if (digit || nolead) {
-        display_digit(i, digit);
-        nolead=1;
-      }
-      base = base / 10;
+    if (n == 0) {
+      jog(-1);
+      _state = motion_homing;
+    } else {
+      moveTo(_slots[n]);
     }
+    return true;
+  }
+
+  int32_t getSlot(uint8_t n) {
+    return (n < MOTION_SLOTS) ? _slots[n] : 0;
+  }
+
+  void setSlot(uint8_t n, int32_t pos) {
+    if (n < MOTION_SLOTS)
+      _slots[n] = pos;
+  }
+
+  // Store the current position in a slot, kept over a reboot
+  // with CONFIG_SUPPORT
+  bool saveSlot(uint8_t n) {
+    if (!n || (n >= MOTION_SLOTS))
+      return false;
+
+    _slots[n] = position();
+#ifdef CONFIG_SUPPORT
+    persist(_slots[n], n);
+#endif
+    return true;
   }
 
 private:
-  TM1637* _tm1637;
-  uint8_t _brightness; // Value is 0-7
+  uint8_t _step_l;
+  uint8_t _dir_l;
+  uint8_t _step_r;
+  uint8_t _dir_r;
+  MotionState _state;
+  volatile bool _hit;
+  bool _pending;
+  int32_t _target;
+  int32_t _slots[MOTION_SLOTS];
 };
 
+#endif // #ifdef MOTION_SUPPORT
 
-#endif // #ifdef SSFD_SUPPORT
+// Microseconds a display may spend flushing its framebuffer per update(),
+// at least one cell is always sent so a repaint can't stall.
+// Shared by LCD20X4 and ST7920.
+#ifndef DISPLAY_FLUSH_BUDGET_US
+#define DISPLAY_FLUSH_BUDGET_US 1000
+#endif
 
 //
 // LCD20X4_SUPPORT
@@ -592,11 +4182,24 @@ private:
 #include <LiquidCrystal_I2C.h>
 
 
+// Size of the LCD20X4 display, and of its shadow framebuffer
+#define LCD20X4_COLS 20
+#define LCD20X4_ROWS 4
+#define LCD20X4_CELLS (LCD20X4_COLS * LCD20X4_ROWS)
+
+// No known cursor position, forces a setCursor() on the next write
+#define LCD20X4_NO_CURSOR 0xFF
+
+// Separates lines in SET <lcd> SCREEN <line1>|<line2>|<line3>|<line4>
+#define LCD20X4_LINE_SEP '|'
+
 class LCD20X4Component : public OutputComponent {
 public:
   LCD20X4Component(char* id, uint8_t i2c_address)
     : OutputComponent(id, loglcd_type) {
-      this->_lcd = new LiquidCrystal_I2C(i2c_address, 20, 4);
+      this->_lcd = new LiquidCrystal_I2C(i2c_address, LCD20X4_COLS, LCD20X4_ROWS);
+      this->_cursor = LCD20X4_NO_CURSOR;
+      this->_dirty = false;
   }
 
   char* set(char* args) {
@@ -606,17 +4209,46 @@ public:
     uint8_t lcd_line;
     char* params;
     char* output;
+    bool sync = false;
 
     line_num = pop_token(args, &params);
     if (!line_num)
       return "ERR SET wanted line num";
 
+    // Writes are normally flushed from update(), SYNC sends them before
+    // returning for callers that need the display to be current
+    if(strcasecmp(line_num, "SYNC") == 0) 
+    {
+      sync = true;
+      line_num = params ? pop_token(params, &params) : NULL;
+      if (!line_num)
+        return "ERR SET wanted line num";
+    }
+
     // Clear the entire screen
     if(strcasecmp(line_num, "CLR") == 0) 
     {
-      _lcd->clear();
+      memset(_buf, ' ', LCD20X4_CELLS);
 
-      return "ACK";
+      return queued(sync);
+    }
+
+    // Replace the entire screen, lines are separated by LCD20X4_LINE_SEP,
+    // and anything not given is blanked
+    if(strcasecmp(line_num, "SCREEN") == 0) 
+    {
+      printScreen(params);
+
+      return queued(sync);
+    }
+
+    // Append a line at the bottom, scrolling the rest up. There is no
+    // hardware scroll, the shadow diff sends only the cells that change.
+    if(strcasecmp(line_num, "LOG") == 0) 
+    {
+      appendLog(params);
+
+      return queued(sync);
     }
 
     // Handle backlight
@@ -639,6 +4271,10 @@ public:
         _lcd->noBacklight();
       }
 
+#ifdef CONFIG_SUPPORT
+      persist(_backlight);
+#endif
+
       return "ACK";
     }
 
@@ -667,23 +4303,23 @@ public:
     // Clear the entire line
     if(strcasecmp(pos, "CLR") == 0) 
     {
-      printTxt(lcd_line, 0, "                    "); // Write 20 spaces
+      memset(_buf + (lcd_line * LCD20X4_COLS), ' ', LCD20X4_COLS);
 
-      return "ACK";
+      return queued(sync);
     }
 
     // Determine position (by 2) in the line
     pos_num = atoi(pos);
-    if (!((pos_num >= 0) && (pos_num < 20)))
+    if (!((pos_num >= 0) && (pos_num < LCD20X4_COLS)))
       return "ERR SET line pos not between 0-19";
 
     printTxt(lcd_line, pos_num, output);
 
-    return "ACK";
+    return queued(sync);
   }
 
   void update() {
-    // We do nothing on update()
+    flush(DISPLAY_FLUSH_BUDGET_US);
   }
 
   void getMessage(char* buf) {
@@ -691,96 +4327,525 @@ public:
   }
 
   bool setup() {
-    _lcd->init();
+    _lcd->init(); // Also clears the display
     // _lcd->backlight(); // Enable backlight by default?
     _backlight = true;  
 
+#ifdef CONFIG_SUPPORT
+    int32_t backlight;
+
+    if (restore(&backlight)) {
+      _backlight = backlight;
+      if (_backlight)
+        _lcd->backlight();
+      else
+        _lcd->noBacklight();
+    }
+#endif
+
+    memset(_buf, ' ', LCD20X4_CELLS);
+    memset(_shadow, ' ', LCD20X4_CELLS);
+    _cursor = LCD20X4_NO_CURSOR;
+    _dirty = false;
+
+    return true;
+  }
+
+private:
+  LiquidCrystal_I2C* _lcd;
+  bool _backlight;
+
+  // What we want on the display, and what we last sent to it
+  char _buf[LCD20X4_CELLS];
+  char _shadow[LCD20X4_CELLS];
+  uint8_t _cursor; // Cell the LCD's address counter points at
+  bool _dirty;
+
+  // Copy str into the framebuffer, clipped at the end of the line
+  void printTxt(uint8_t line, uint8_t pos, char* str) {
+    char* cell = _buf + (line * LCD20X4_COLS);
+    uint8_t i;
+
+    for (i = pos; i < LCD20X4_COLS; i++) {
+      if (!str[i - pos] || str[i - pos] == '\r' || str[i - pos] == '\n')
+        break;
+      cell[i] = str[i - pos];
+    }
+  }
+
+  void printScreen(char* str) {
+    char* cell;
+    uint8_t line;
+    uint8_t i;
+
+    memset(_buf, ' ', LCD20X4_CELLS);
+
+    for (line = 0; str && line < LCD20X4_ROWS; line++) {
+      cell = _buf + (line * LCD20X4_COLS);
+
+      for (i = 0; *str && *str != LCD20X4_LINE_SEP && *str != '\r' && *str != '\n'; str++)
+        if (i < LCD20X4_COLS)
+          cell[i++] = *str;
+
+      if (*str != LCD20X4_LINE_SEP)
+        break;
+      str++;
+    }
+  }
+
+  void appendLog(char* str) {
+    char* line = _buf + (LCD20X4_CELLS - LCD20X4_COLS);
+    uint8_t i;
+
+    memmove(_buf, _buf + LCD20X4_COLS, LCD20X4_CELLS - LCD20X4_COLS);
+
+    for (i = 0; i < LCD20X4_COLS; i++)
+      line[i] = (str && *str && *str != '\r' && *str != '\n') ? *str++ : ' ';
+  }
+
+  // Mark the framebuffer for flushing, or flush it now if sync
+  char* queued(bool sync) {
+    _dirty = true;
+    if (sync)
+      flush(0);
+
+    return "ACK";
+  }
+
+  // Send only the cells that differ from what is on the display.
+  // The LCD advances its address after each write, so a run of dirty
+  // cells on one line only needs a single setCursor().
+  // Stops once budget_us is spent, the rest goes out on a later update(),
+  // a budget_us of 0 flushes everything.
+  void flush(uint16_t budget_us) {
+    uint32_t start = micros();
+    uint8_t i;
+
+    if (!_dirty)
+      return;
+
+    for (i = 0; i < LCD20X4_CELLS; i++) {
+      if (_buf[i] == _shadow[i])
+        continue;
+
+      if (_cursor != i)
+        _lcd->setCursor(i % LCD20X4_COLS, i / LCD20X4_COLS);
+
+      _lcd->write(_buf[i]);
+      _shadow[i] = _buf[i];
+
+      // DDRAM lines aren't contiguous, so wrapping past a line end
+      // leaves the cursor somewhere we don't want
+      _cursor = ((i + 1) % LCD20X4_COLS) ? (i + 1) : LCD20X4_NO_CURSOR;
+
+      if (budget_us && (micros() - start) >= budget_us)
+        return;
+    }
+
+    _dirty = false;
+  }
+};
+
+
+#endif // #ifdef LCD20X4_SUPPORT
+
+
+//
+// Pin change edge capture
+// Used by sensors that time their pulses in the background. Every
+// level change on a watched pin is handed to its EdgeListener, along
+// with a micros() timestamp, from the pin change interrupt. The
+// PCINT vectors belong to the capture, so SoftwareSerial can't be
+// used alongside it.
+//
+#if defined(MHZ19_SUPPORT) && !defined(MHZ19_UART_SUPPORT)
+#define EDGE_SUPPORT
+#endif
+#ifdef DHT_SUPPORT
+#define EDGE_SUPPORT
+#endif
+
+#ifdef EDGE_SUPPORT
+#include <avr/interrupt.h>
+
+// Maximum number of pins being watched
+#ifndef EDGE_MAX_PINS
+#define EDGE_MAX_PINS 4
+#endif
+
+class EdgeListener {
+public:
+  // Called from the interrupt, so keep it short
+  virtual void edge(bool level, uint32_t us) = 0;
+};
+
+typedef struct edge_pin {
+  volatile uint8_t* in;
+  uint8_t mask;
+  uint8_t group;  // PCICR bit, which vector the pin raises
+  uint8_t last;
+  EdgeListener* listener;
+} edge_pin_t;
+
+edge_pin_t EDGE_PINS[EDGE_MAX_PINS];
+volatile uint8_t EDGE_COUNT = 0;
+
+// Start watching a pin, false if it has no pin change interrupt or
+// we're full
+bool edge_watch(uint8_t pin, EdgeListener* listener) {
+  edge_pin_t* p;
+  volatile uint8_t* pcicr = digitalPinToPCICR(pin);
+
+  if (!pcicr || EDGE_COUNT >= EDGE_MAX_PINS)
+    return false;
+
+  p = &EDGE_PINS[EDGE_COUNT];
+  p->in = portInputRegister(digitalPinToPort(pin));
+  p->mask = digitalPinToBitMask(pin);
+  p->group = digitalPinToPCICRbit(pin);
+  p->last = *p->in & p->mask;
+  p->listener = listener;
+
+  noInterrupts();
+  EDGE_COUNT++;
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCIFR = _BV(p->group);
+  *pcicr |= _BV(p->group);
+  interrupts();
+
+  return true;
+}
+
+void edge_dispatch(uint8_t group) {
+  uint32_t now = micros();
+  edge_pin_t* p;
+  uint8_t level;
+  uint8_t i;
+
+  for (i = 0; i < EDGE_COUNT; i++) {
+    p = &EDGE_PINS[i];
+    if (p->group != group)
+      continue;
+
+    level = *p->in & p->mask;
+    if (level != p->last) {
+      p->last = level;
+      p->listener->edge(level, now);
+    }
+  }
+}
+
+ISR(PCINT0_vect) {
+  edge_dispatch(0);
+}
+
+ISR(PCINT1_vect) {
+  edge_dispatch(1);
+}
+
+ISR(PCINT2_vect) {
+  edge_dispatch(2);
+}
+
+#endif // #ifdef EDGE_SUPPORT
+
+
+//
+// MHZ19 (CO2) Sensor support
+// Read through the PWM output by default, or with MHZ19_UART_SUPPORT
+// through the serial interface on a Stream the sketch has started at
+// 9600 baud (SoftwareSerial, or a spare hardware UART).
+//
+#ifdef MHZ19_SUPPORT
+
+// Full scale the sensor is configured for
+#ifndef MHZ19_RANGE
+#define MHZ19_RANGE 5000
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+
+// Every command and reply is 9 bytes, 0xFF, command, data, checksum
+#define MHZ19_FRAME_LEN 9
+#define MHZ19_START 0xFF
+#define MHZ19_SENSOR 0x01
+
+#define MHZ19_CMD_READ 0x86
+#define MHZ19_CMD_ABC 0x79
+#define MHZ19_CMD_RANGE 0x99
+
+#define MHZ19_ABC_ONN 0xA0
+#define MHZ19_ABC_OFF 0x00
+
+#else
+
+// PWM output cycle is 1004ms, a 2ms high start, the reading, and a
+// 2ms low end; anything too far off that is a glitch
+#define MHZ19_PWM_CYCLE_MIN_US 900000UL
+#define MHZ19_PWM_CYCLE_MAX_US 1100000UL
+#define MHZ19_PWM_EDGE_US 2000UL
+
+#endif // #ifdef MHZ19_UART_SUPPORT
+
+/*
+ * PWM: the output is timed from pin change interrupts, each rising edge
+ * completes a cycle and the high time is kept, so poll() only has to
+ * turn the last complete cycle into ppm.
+ *
+ * UART: poll() sends a read command every interval, and picks the
+ * reply up a byte at a time as it arrives, dropping any frame that
+ * fails its checksum.
+ */
+#ifdef MHZ19_UART_SUPPORT
+class Mhz19Component : public InputComponent {
+public:
+  Mhz19Component(char* id, Stream* serial, uint32_t interval = 60000)
+    : InputComponent(id, mhz19_type) {
+      this->_serial = serial;
+      this->_interval = interval;
+      this->_co2 = 0;
+#ifdef HIST_SUPPORT
+      this->_hist = new History("CO2");
+#endif
+  }
+#else
+class Mhz19Component : public InputComponent, public EdgeListener {
+public:
+  Mhz19Component(char* id, uint8_t pin, uint32_t interval = 60000)
+    : InputComponent(id, mhz19_type) {
+      this->_pin = pin;
+      this->_interval = interval;
+      this->_co2 = 0;
+#ifdef HIST_SUPPORT
+      this->_hist = new History("CO2");
+#endif
+  }
+#endif
+
+  bool poll() {
+    bool rc = false;
+    uint16_t co2;
+
+#ifdef MHZ19_UART_SUPPORT
+    if (readCO2UART(&co2))
+      rc = reading(co2);
+
+    // Ask for the next reading, the reply turns up on a later poll()
+    if(is_tc_alert(_timer)) {
+      sendCommand(MHZ19_CMD_READ, 0, 0, 0);
+      _timer = get_tc_alert(_interval);
+    }
+#else
+    // Update system details if it's time. Nothing new from the sensor
+    // yet leaves the timer due, so the first cycle after boot is read
+    // as soon as it's captured
+    if(is_tc_alert(_timer) && readCO2PWM(&co2)) {
+      _timer = get_tc_alert(_interval);
+      rc = reading(co2);
+    }
+#endif
+
+    return rc;
+  }
+
+  // RANGE <ppm> sets the full scale, ABC ONN|OFF switches the sensor's
+  // automatic baseline correction (UART only)
+  char* set(char* args) {
+    char* cmd;
+    char* params;
+    char* value;
+
+    cmd = pop_token(args, &params);
+    value = params ? pop_token(params, NULL) : NULL;
+    if (!cmd || !value)
+      return "ERR MHZ19 SET wanted RANGE or ABC and a value";
+
+    if (strcasecmp(cmd, "RANGE") == 0) {
+      uint16_t range = atol(value);
+
+      if (range < 1000)
+        return "ERR MHZ19 RANGE too small";
+
+      _range = range;
+#ifdef MHZ19_UART_SUPPORT
+      sendCommand(MHZ19_CMD_RANGE, 0, range >> 8, range & 0xFF);
+#endif
+      return "ACK";
+    }
+
+#ifdef MHZ19_UART_SUPPORT
+    if (strcasecmp(cmd, "ABC") == 0) {
+      if (strcasecmp(value, "ONN") == 0)
+        sendCommand(MHZ19_CMD_ABC, MHZ19_ABC_ONN, 0, 0);
+      else if (strcasecmp(value, "OFF") == 0)
+        sendCommand(MHZ19_CMD_ABC, MHZ19_ABC_OFF, 0, 0);
+      else
+        return "ERR MHZ19 ABC wanted ONN or OFF";
+
+      return "ACK";
+    }
+#endif
+
+    return "ERR MHZ19 SET wanted RANGE or ABC";
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%u", id, getCTypeName(type), this->_co2);
+  }
+
+  uint16_t get_co2() {
+    return this->_co2;
+  }
+
+  // Takes a new reading, true if it changed
+  bool reading(uint16_t co2) {
+#ifdef HIST_SUPPORT
+    if (_hist->due())
+      _hist->add(co2);
+#endif
+
+    if (co2 == _co2)
+      return false;
+
+    _co2 = co2;
     return true;
   }
 
-private:
-   LiquidCrystal_I2C* _lcd;
-   bool _backlight;
+#ifdef HIST_SUPPORT
+  History* history(uint8_t i) {
+    return i ? NULL : _hist;
+  }
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+  uint8_t checksum(uint8_t* frame) {
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 1; i < MHZ19_FRAME_LEN - 1; i++)
+      sum += frame[i];
 
-  void printTxt(uint8_t line, uint8_t pos, char* str) {
-    _lcd->setCursor(pos, line);
-    _lcd->print(str);
+    return 0xFF - sum + 1;
   }
-};
 
+  // Data goes in bytes 3, 6 and 7, which is all the commands we use need
+  void sendCommand(uint8_t cmd, uint8_t b3, uint8_t b6, uint8_t b7) {
+    uint8_t frame[MHZ19_FRAME_LEN] = { MHZ19_START, MHZ19_SENSOR, cmd, b3, 0, 0, b6, b7, 0 };
 
-#endif // #ifdef LCD20X4_SUPPORT
+    frame[MHZ19_FRAME_LEN - 1] = checksum(frame);
 
+    // Anything half read belongs to an old command
+    _rx_len = 0;
+    _serial->write(frame, MHZ19_FRAME_LEN);
+  }
 
-//
-// MHZ19 (CO2) Sensor support
-//
-#ifdef MHZ19_SUPPORT
+  // Works through whatever has arrived, true once a read reply passes
+  // its checksum
+  bool readCO2UART(uint16_t* ppm) {
+    bool rc = false;
 
-class Mhz19Component : public InputComponent {
-public:
-  Mhz19Component(char* id, uint8_t pin, uint32_t interval = 60000)
-    : InputComponent(id, mhz19_type) {
-      this->_pin = pin;
-      this->_interval = interval;
-      this->_co2 = 0;
-  }
+    while (_serial->available()) {
+      uint8_t c = _serial->read();
 
-  bool poll() {
+      // Hunt for the start of a frame
+      if (!_rx_len && c != MHZ19_START)
+        continue;
 
-    // Update system details if it's time
-    if(is_tc_alert(_timer)) {
-      bool rc = false;
-      uint16_t co2 = readCO2PWM();
+      _rx[_rx_len++] = c;
+      if (_rx_len < MHZ19_FRAME_LEN)
+        continue;
 
-      // Update state if something changed
-      if(co2 != _co2) {
-        _co2 = co2;
+      _rx_len = 0;
+      if (_rx[MHZ19_FRAME_LEN - 1] != checksum(_rx))
+        continue;
+
+      if (_rx[1] == MHZ19_CMD_READ) {
+        *ppm = (_rx[2] << 8) | _rx[3];
         rc = true;
       }
-
-      // Reset timer
-      _timer = get_tc_alert(_interval);
-
-      return rc;
     }
 
-    // No update
-    return false;
+    return rc;
   }
 
-  void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), this->_co2);
+  bool setup() {
+    _timer = 0;
+    _rx_len = 0;
+
+    return true;
   }
+#else
+  // ppm from the last complete PWM cycle, false if there hasn't been
+  // one since the last call
+  bool readCO2PWM(uint16_t* ppm) {
+    uint32_t th, cycle;
+
+    noInterrupts();
+    th = _high_us;
+    cycle = _cycle_us;
+    _cycle_us = 0;
+    interrupts();
+
+    if (!cycle)
+      return false;
 
-  uint16_t get_co2() {
-    return this->_co2;
+    th = constrain(th, MHZ19_PWM_EDGE_US, cycle - MHZ19_PWM_EDGE_US);
+    *ppm = ((th - MHZ19_PWM_EDGE_US) * (_range / 10)) / ((cycle - 2 * MHZ19_PWM_EDGE_US) / 10);
+
+    return true;
   }
 
-  uint16_t readCO2PWM() {
-    uint32_t th, tl, ppm_pwm = 0;
-    do {
-      th = pulseIn(this->_pin, HIGH, 1004000) / 1000;
-      tl = 1004 - th;
-      // ppm_pwm = 5000 * (th - 2) / (th + tl - 4); // Assumes max of 5000 with PWM mode
-      ppm_pwm = 2000 * (th - 2) / (th + tl - 4); // Assumes max of 2000 with PWM mode
-    } while (th == 0);
+  void edge(bool level, uint32_t us) {
+    if (!level) {
+      _fall_us = us;
+      _fallen = true;
+      return;
+    }
+
+    if (_fallen) {
+      uint32_t cycle = us - _rise_us;
+
+      if (cycle >= MHZ19_PWM_CYCLE_MIN_US && cycle <= MHZ19_PWM_CYCLE_MAX_US) {
+        _high_us = _fall_us - _rise_us;
+        _cycle_us = cycle;
+      }
+    }
 
-    return (uint16_t)(ppm_pwm*2); // Multiplied by two, cause that seems more realistic
+    _rise_us = us;
+    _fallen = false;
   }
 
   bool setup() {
     pinMode(this->_pin, INPUT);
     _timer = 0;
 
-    return true;
+    return edge_watch(_pin, this);
   }
+#endif
 
 private:
-  uint8_t _pin;
   uint32_t _interval;
   tick _timer;
   uint16_t _co2;
+  uint16_t _range = MHZ19_RANGE;
+#ifdef HIST_SUPPORT
+  History* _hist;
+#endif
+
+#ifdef MHZ19_UART_SUPPORT
+  Stream* _serial;
+  uint8_t _rx[MHZ19_FRAME_LEN];
+  uint8_t _rx_len = 0;
+#else
+  uint8_t _pin;
+
+  // Written by the pin change interrupt
+  uint32_t _rise_us = 0;
+  uint32_t _fall_us = 0;
+  bool _fallen = false;
+  volatile uint32_t _high_us = 0;
+  volatile uint32_t _cycle_us = 0;
+#endif
 };
 
 #endif // #ifdef MHZ19_SUPPORT 
@@ -790,44 +4855,78 @@ private:
 // DHT Sensor support
 // 
 #ifdef DHT_SUPPORT
-#include <DHT.h>
 
-class DhtComponent : public InputComponent {
+// Sensor types, same values as the Adafruit DHT library
+#ifndef DHT11
+#define DHT11 11
+#define DHT21 21
+#define DHT22 22
+#endif
+
+// Start pulse, DHT11 wants at least 18ms, the others about 1ms
+#define DHT11_START_MS 20
+#define DHT_START_US 1100
+
+// Bits are a 50us low then a 26us (0) or 70us (1) high, so the time
+// between falling edges tells them apart
+#define DHT_BIT_THRESHOLD_US 100
+
+// Falling edges in a reply, the response, one per bit, and the end
+#define DHT_FALLS 42
+#define DHT_BITS 40
+
+// A reply takes under 5ms, give up on it after this
+#define DHT_TIMEOUT_MS 10
+
+// Wait before trying again after a failed read
+#define DHT_RETRY_MS 2000
+
+enum DhtState {
+  dht_idle,
+  dht_start,     // Holding the start pulse
+  dht_receive,   // Reply coming in through edge()
+  dht_done       // All bits in, waiting for poll() to decode them
+};
+
+/*
+ * Reads the sensor without stopping the loop. poll() pulls the line
+ * low for the start pulse and lets it go on a later call, then the
+ * pin change interrupt times every falling edge of the reply, and once
+ * all 40 bits are in poll() checks the CRC and takes both values from
+ * the one transaction.
+ */
+class DhtComponent : public InputComponent, public EdgeListener {
 public:
   // type is either DHT11 or DHT22
   DhtComponent(char* id, uint8_t pin, uint8_t type, uint32_t interval = 60000)
     : InputComponent(id, dht_type) {
-      this->_dht = new DHT(pin, type);
+      this->_pin = pin;
+      this->_dht_type = type;
       this->_interval = interval;
       this->_t = 0;
       this->_h = 0;
+#ifdef HIST_SUPPORT
+      this->_hist_t = new History("T");
+      this->_hist_h = new History("H");
+#endif
   }
 
   bool poll() {
+    DhtState state = _state;
 
-    // Update system details if it's time
-    if(is_tc_alert(_timer)) {
-      bool rc = false;
-      uint16_t t = (uint16_t)_dht->readTemperature();
-      uint16_t h = (uint16_t)_dht->readHumidity();
-
-      // Update state if something changed
-      if(t != _t) {
-        _t = t;
-        rc = true;
-      }
-      if(h != _h) {
-        _h = h;
-        rc = true;
-      }
+    if (state == dht_done)
+      return decode();
 
-      // Reset timer
-      _timer = get_tc_alert(_interval);
+    if (!is_tc_alert(_timer))
+      return false;
 
-      return rc;
-    }
+    if (state == dht_idle)
+      start();
+    else if (state == dht_start)
+      release();
+    else
+      retry();  // Reply never finished
 
-    // No update
     return false;
   }
 
@@ -843,19 +4942,130 @@ public:
     return _h;
   }
 
+#ifdef HIST_SUPPORT
+  History* history(uint8_t i) {
+    if (i == 0)
+      return _hist_t;
+    if (i == 1)
+      return _hist_h;
+    return NULL;
+  }
+#endif
+
+  void edge(bool level, uint32_t us) {
+    uint8_t n;
+
+    if (level || _state != dht_receive)
+      return;
+
+    // Each falling edge ends the bit before it
+    n = _falls++;
+    if (n >= DHT_FALLS - DHT_BITS && (us - _last_fall) > DHT_BIT_THRESHOLD_US) {
+      n -= DHT_FALLS - DHT_BITS;
+      _data[n >> 3] |= 0x80 >> (n & 7);
+    }
+    _last_fall = us;
+
+    if (_falls >= DHT_FALLS)
+      _state = dht_done;
+  }
+
   bool setup() {
-    _dht->begin();
+    pinMode(_pin, INPUT_PULLUP);
     _timer = 0;
 
-    return true;
+    return edge_watch(_pin, this);
   }
 
 private:
-  DHT* _dht;
+  void start() {
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+
+    // Short enough to just wait out
+    if (_dht_type != DHT11) {
+      delayMicroseconds(DHT_START_US);
+      release();
+      return;
+    }
+
+    _state = dht_start;
+    _timer = get_tc_alert(DHT11_START_MS);
+  }
+
+  void release() {
+    memset((void*)_data, 0, sizeof(_data));
+    _falls = 0;
+    _state = dht_receive;
+    _timer = get_tc_alert(DHT_TIMEOUT_MS);
+
+    pinMode(_pin, INPUT_PULLUP);
+  }
+
+  void retry() {
+    _state = dht_idle;
+    _timer = get_tc_alert(DHT_RETRY_MS);
+  }
+
+  bool decode() {
+    bool rc = false;
+    uint8_t sum = _data[0] + _data[1] + _data[2] + _data[3];
+    int16_t t, h;
+
+    if (sum != _data[4]) {
+      retry();
+      return false;
+    }
+
+    if (_dht_type == DHT11) {
+      h = _data[0];
+      t = _data[2];
+    } else {
+      h = ((_data[0] << 8) | _data[1]) / 10;
+      t = (((_data[2] & 0x7F) << 8) | _data[3]) / 10;
+      if (_data[2] & 0x80)
+        t = -t;
+    }
+
+    _state = dht_idle;
+    _timer = get_tc_alert(_interval);
+
+#ifdef HIST_SUPPORT
+    if (_hist_t->due()) {
+      _hist_t->add(t);
+      _hist_h->add(h);
+    }
+#endif
+
+    // Update state if something changed
+    if((uint16_t)t != _t) {
+      _t = t;
+      rc = true;
+    }
+    if((uint16_t)h != _h) {
+      _h = h;
+      rc = true;
+    }
+
+    return rc;
+  }
+
+  uint8_t _pin;
+  uint8_t _dht_type;
   uint32_t _interval;
   tick _timer;
   uint16_t _t;
   uint16_t _h;
+#ifdef HIST_SUPPORT
+  History* _hist_t;
+  History* _hist_h;
+#endif
+
+  // Written by the pin change interrupt
+  volatile DhtState _state = dht_idle;
+  volatile uint8_t _falls = 0;
+  volatile uint8_t _data[5];
+  uint32_t _last_fall = 0;
 };
 
 #endif // #ifdef DHT_SUPPORT
@@ -889,16 +5099,219 @@ private:
 #define LCD_LINE2 0x88
 #define LCD_LINE3 0x98
 
-// #define SPI_SPEED (1000000UL)
-// Much more reliable at half speed!
-#define SPI_SPEED (500000UL)
+// Serial clock. 1MHz was unreliable when every character was its own
+// transaction, 500kHz has been solid on the StatusPanel. The controller
+// is rated to 2.5MHz at 5V, the limit is the wiring.
+#ifndef ST7920_SPI_SPEED
+#define ST7920_SPI_SPEED (500000UL)
+#endif
+
+// Each command or data write takes the controller 72us to execute
+#define ST7920_EXEC_US 72
+
+// A data byte is sent as two nibble bytes, so once streaming only the
+// part of the execution time not already covered by the wire is waited
+#define ST7920_WIRE_US ((16 * 1000000UL) / ST7920_SPI_SPEED)
+#if ST7920_WIRE_US < ST7920_EXEC_US
+#define ST7920_DATA_DELAY_US (ST7920_EXEC_US - ST7920_WIRE_US)
+#else
+#define ST7920_DATA_DELAY_US 0
+#endif
+
+
+// Text mode is 4 lines of 16 half-width characters, held in DDRAM order.
+// Each DDRAM address holds 2 characters, and 0x80-0x9F covers the
+// display as line 1, line 3, line 2, line 4.
+#define ST7920_COLS 16
+#define ST7920_ROWS 4
+#define ST7920_CELLS (ST7920_COLS * ST7920_ROWS)
+#define ST7920_WORDS (ST7920_CELLS / 2)
+
+// DDRAM has two more rows than are shown, 0xA0 and 0xB0, which are
+// scrolled into view for LOG. Scrolling is in pixel rows, 16 per row.
+#define ST7920_DDRAM_ROWS 4
+#define ST7920_ROW_WORDS 16
+#define ST7920_SCROLL_ROWS 64
+
+// No known DDRAM address, forces an address command on the next write
+#define ST7920_NO_CURSOR 0xFF
+
+#ifdef ST7920_GFX_SUPPORT
+
+// Graphics mode is 128x64 at 1bpp. GDRAM is 32 rows of 16 words, the
+// bottom half of the display being words 8-15 of rows 0-31.
+#define ST7920_GFX_WIDTH 128
+#define ST7920_GFX_HEIGHT 64
+#define ST7920_GFX_ROW_BYTES (ST7920_GFX_WIDTH / 8)
+#define ST7920_GFX_ROW_WORDS (ST7920_GFX_WIDTH / 16)
+
+// Pixel rows rendered at a time, must divide ST7920_GFX_HEIGHT. A Nano
+// can't spare the 1KB for a full framebuffer, so the screen is kept as a
+// list of drawing ops and rendered a band at a time. Boards with the RAM
+// can set this to ST7920_GFX_HEIGHT to render once per change.
+#ifndef ST7920_GFX_BAND_ROWS
+#define ST7920_GFX_BAND_ROWS 8
+#endif
+#define ST7920_GFX_BANDS (ST7920_GFX_HEIGHT / ST7920_GFX_BAND_ROWS)
+
+#ifndef ST7920_GFX_MAX_OPS
+#define ST7920_GFX_MAX_OPS 12
+#endif
+
+#ifndef ST7920_GFX_TEXT_MAX
+#define ST7920_GFX_TEXT_MAX 10
+#endif
+
+// Characters are 5x7 in a 6x8 cell
+#define ST7920_FONT_WIDTH 5
+#define ST7920_FONT_HEIGHT 7
+#define ST7920_FONT_CELL_WIDTH 6
+#define ST7920_FONT_CELL_HEIGHT 8
+#define ST7920_FONT_FIRST 0x20
+#define ST7920_FONT_LAST 0x7E
+
+// Column major, LSB at the top, for 0x20-0x7E
+const uint8_t ST7920_FONT[] PROGMEM = {
+  0x00, 0x00, 0x00, 0x00, 0x00,  // ' '
+  0x00, 0x00, 0x5F, 0x00, 0x00,  // !
+  0x00, 0x07, 0x00, 0x07, 0x00,  // "
+  0x14, 0x7F, 0x14, 0x7F, 0x14,  // #
+  0x24, 0x2A, 0x7F, 0x2A, 0x12,  // $
+  0x23, 0x13, 0x08, 0x64, 0x62,  // %
+  0x36, 0x49, 0x55, 0x22, 0x50,  // &
+  0x00, 0x05, 0x03, 0x00, 0x00,  // '
+  0x00, 0x1C, 0x22, 0x41, 0x00,  // (
+  0x00, 0x41, 0x22, 0x1C, 0x00,  // )
+  0x14, 0x08, 0x3E, 0x08, 0x14,  // *
+  0x08, 0x08, 0x3E, 0x08, 0x08,  // +
+  0x00, 0x50, 0x30, 0x00, 0x00,  // ,
+  0x08, 0x08, 0x08, 0x08, 0x08,  // -
+  0x00, 0x60, 0x60, 0x00, 0x00,  // .
+  0x20, 0x10, 0x08, 0x04, 0x02,  // /
+  0x3E, 0x51, 0x49, 0x45, 0x3E,  // 0
+  0x00, 0x42, 0x7F, 0x40, 0x00,  // 1
+  0x42, 0x61, 0x51, 0x49, 0x46,  // 2
+  0x21, 0x41, 0x45, 0x4B, 0x31,  // 3
+  0x18, 0x14, 0x12, 0x7F, 0x10,  // 4
+  0x27, 0x45, 0x45, 0x45, 0x39,  // 5
+  0x3C, 0x4A, 0x49, 0x49, 0x30,  // 6
+  0x01, 0x71, 0x09, 0x05, 0x03,  // 7
+  0x36, 0x49, 0x49, 0x49, 0x36,  // 8
+  0x06, 0x49, 0x49, 0x29, 0x1E,  // 9
+  0x00, 0x36, 0x36, 0x00, 0x00,  // :
+  0x00, 0x56, 0x36, 0x00, 0x00,  // ;
+  0x08, 0x14, 0x22, 0x41, 0x00,  // <
+  0x14, 0x14, 0x14, 0x14, 0x14,  // =
+  0x00, 0x41, 0x22, 0x14, 0x08,  // >
+  0x02, 0x01, 0x51, 0x09, 0x06,  // ?
+  0x32, 0x49, 0x79, 0x41, 0x3E,  // @
+  0x7E, 0x11, 0x11, 0x11, 0x7E,  // A
+  0x7F, 0x49, 0x49, 0x49, 0x36,  // B
+  0x3E, 0x41, 0x41, 0x41, 0x22,  // C
+  0x7F, 0x41, 0x41, 0x22, 0x1C,  // D
+  0x7F, 0x49, 0x49, 0x49, 0x41,  // E
+  0x7F, 0x09, 0x09, 0x09, 0x01,  // F
+  0x3E, 0x41, 0x49, 0x49, 0x7A,  // G
+  0x7F, 0x08, 0x08, 0x08, 0x7F,  // H
+  0x00, 0x41, 0x7F, 0x41, 0x00,  // I
+  0x20, 0x40, 0x41, 0x3F, 0x01,  // J
+  0x7F, 0x08, 0x14, 0x22, 0x41,  // K
+  0x7F, 0x40, 0x40, 0x40, 0x40,  // L
+  0x7F, 0x02, 0x0C, 0x02, 0x7F,  // M
+  0x7F, 0x04, 0x08, 0x10, 0x7F,  // N
+  0x3E, 0x41, 0x41, 0x41, 0x3E,  // O
+  0x7F, 0x09, 0x09, 0x09, 0x06,  // P
+  0x3E, 0x41, 0x51, 0x21, 0x5E,  // Q
+  0x7F, 0x09, 0x19, 0x29, 0x46,  // R
+  0x46, 0x49, 0x49, 0x49, 0x31,  // S
+  0x01, 0x01, 0x7F, 0x01, 0x01,  // T
+  0x3F, 0x40, 0x40, 0x40, 0x3F,  // U
+  0x1F, 0x20, 0x40, 0x20, 0x1F,  // V
+  0x3F, 0x40, 0x38, 0x40, 0x3F,  // W
+  0x63, 0x14, 0x08, 0x14, 0x63,  // X
+  0x07, 0x08, 0x70, 0x08, 0x07,  // Y
+  0x61, 0x51, 0x49, 0x45, 0x43,  // Z
+  0x00, 0x7F, 0x41, 0x41, 0x00,  // [
+  0x02, 0x04, 0x08, 0x10, 0x20,  // backslash
+  0x00, 0x41, 0x41, 0x7F, 0x00,  // ]
+  0x04, 0x02, 0x01, 0x02, 0x04,  // ^
+  0x40, 0x40, 0x40, 0x40, 0x40,  // _
+  0x00, 0x01, 0x02, 0x04, 0x00,  // `
+  0x20, 0x54, 0x54, 0x54, 0x78,  // a
+  0x7F, 0x48, 0x44, 0x44, 0x38,  // b
+  0x38, 0x44, 0x44, 0x44, 0x20,  // c
+  0x38, 0x44, 0x44, 0x48, 0x7F,  // d
+  0x38, 0x54, 0x54, 0x54, 0x18,  // e
+  0x08, 0x7E, 0x09, 0x01, 0x02,  // f
+  0x0C, 0x52, 0x52, 0x52, 0x3E,  // g
+  0x7F, 0x08, 0x04, 0x04, 0x78,  // h
+  0x00, 0x44, 0x7D, 0x40, 0x00,  // i
+  0x20, 0x40, 0x44, 0x3D, 0x00,  // j
+  0x7F, 0x10, 0x28, 0x44, 0x00,  // k
+  0x00, 0x41, 0x7F, 0x40, 0x00,  // l
+  0x7C, 0x04, 0x18, 0x04, 0x78,  // m
+  0x7C, 0x08, 0x04, 0x04, 0x78,  // n
+  0x38, 0x44, 0x44, 0x44, 0x38,  // o
+  0x7C, 0x14, 0x14, 0x14, 0x08,  // p
+  0x08, 0x14, 0x14, 0x18, 0x7C,  // q
+  0x7C, 0x08, 0x04, 0x04, 0x08,  // r
+  0x48, 0x54, 0x54, 0x54, 0x20,  // s
+  0x04, 0x3F, 0x44, 0x40, 0x20,  // t
+  0x3C, 0x40, 0x40, 0x20, 0x7C,  // u
+  0x1C, 0x20, 0x40, 0x20, 0x1C,  // v
+  0x3C, 0x40, 0x30, 0x40, 0x3C,  // w
+  0x44, 0x28, 0x10, 0x28, 0x44,  // x
+  0x0C, 0x50, 0x50, 0x50, 0x3C,  // y
+  0x44, 0x64, 0x54, 0x4C, 0x44,  // z
+  0x00, 0x08, 0x36, 0x41, 0x00,  // {
+  0x00, 0x00, 0x7F, 0x00, 0x00,  // |
+  0x00, 0x41, 0x36, 0x08, 0x00,  // }
+  0x08, 0x04, 0x08, 0x10, 0x08   // ~
+};
+
+enum ST7920GfxOp {
+  gfx_none,
+  gfx_text,
+  gfx_hline,
+  gfx_vline,
+  gfx_bar
+};
+
+// One retained drawing op, a and b are its width and height where it
+// has them, and c the bar fill in percent
+typedef struct st7920_gfx_op {
+  uint8_t op;
+  uint8_t x;
+  uint8_t y;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  char text[ST7920_GFX_TEXT_MAX + 1];
+} st7920_gfx_op_t;
 
+#endif // #ifdef ST7920_GFX_SUPPORT
 
 class ST7920Component : public OutputComponent {
 public:
   ST7920Component(char* id, uint8_t cs_pin)
     : OutputComponent(id, loglcd_type) {
       this->_cs_pin = cs_pin;
+      this->_cursor = ST7920_NO_CURSOR;
+      this->_dirty = false;
+      this->_log = false;
+      this->_log_full = false;
+      this->_log_busy = false;
+      this->_log_count = 0;
+      this->_log_shown = 0;
+      this->_log_top = 0;
+#ifdef ST7920_GFX_SUPPORT
+      this->_gfx = false;
+      this->_gfx_band = 0;
+      this->_gfx_rendered = false;
+      this->_gfx_pending = false;
+      memset(this->_ops, 0, sizeof(this->_ops));
+      memset(this->_gfx_dirty, 0, sizeof(this->_gfx_dirty));
+#endif
       // 12, // clock
       // 11, // data
       // 10, // CS
@@ -912,11 +5325,48 @@ public:
     uint8_t lcd_pos;
     char* params;
     char* output;
+    bool sync = false;
+    bool clear;
 
     line_num = pop_token(args, &params);
     if (!line_num)
       return "ERR SET wanted line num";
 
+    // Writes are normally flushed from update(), SYNC sends them before
+    // returning for callers that need the display to be current
+    if(strcasecmp(line_num, "SYNC") == 0) 
+    {
+      sync = true;
+      line_num = params ? pop_token(params, &params) : NULL;
+      if (!line_num)
+        return "ERR SET wanted line num";
+    }
+
+#ifdef ST7920_GFX_SUPPORT
+    // Graphics mode drawing
+    if(strcasecmp(line_num, "GFX") == 0) 
+    {
+      output = setGfx(params);
+      if (output)
+        return output;
+
+      return queued(sync);
+    }
+#endif
+
+    // Append a line to the scrolling log
+    if(strcasecmp(line_num, "LOG") == 0) 
+    {
+#ifdef ST7920_GFX_SUPPORT
+      // Scrolling moves the graphics too
+      if (_gfx)
+        return "ERR SET LOG needs GFX OFF";
+#endif
+      appendLog(params);
+
+      return queued(sync);
+    }
+
     switch (line_num[0]) {
       case '1':
         lcd_pos = LCD_LINE0;
@@ -930,100 +5380,630 @@ public:
       case '4':
         lcd_pos = LCD_LINE3;
         break;
-      default:
-        return "ERR SET invalid line num";
+      default:
+        return "ERR SET invalid line num";
+    }
+
+    pos = pop_token(params, &output);
+    if (!pos)
+      return "ERR SET needs line pos after line num";
+
+    // Determine position (by 2) in the line, CLR clears all of it
+    clear = (strcasecmp(pos, "CLR") == 0);
+    pos_num = clear ? 0 : atoi(pos);
+    if (!((pos_num >= 0) && (pos_num < 16)))
+      return "ERR SET line pos not between 0-15";
+
+    // Only a valid line write leaves LOG mode
+    if (_log)
+      endLog();
+
+    printTxt((lcd_pos + pos_num), clear ? (char*)"                " : output);
+
+    return queued(sync);
+  }
+
+  void update() {
+    flush(DISPLAY_FLUSH_BUDGET_US);
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s", id, getCTypeName(type));
+  }
+
+  bool setup() {
+    pinMode(_cs_pin, OUTPUT);
+    digitalWrite(_cs_pin, LOW);
+    SPI.begin();
+    sendCmd(LCD_BASIC);
+    sendCmd(LCD_BASIC);
+    sendCmd(LCD_CLS);
+    delay(2);
+    sendCmd(LCD_ADDRINC);
+    sendCmd(LCD_DISPLAYON);
+
+    // Enable TEXT mode, graphics are turned on with SET <lcd> GFX ONN
+    sendCmd(LCD_EXTEND);
+    sendCmd(LCD_TXTMODE);
+
+    // LCD_CLS fills DDRAM with spaces
+    memset(_buf, ' ', ST7920_CELLS);
+    memset(_shadow, ' ', ST7920_CELLS);
+    _cursor = ST7920_NO_CURSOR;
+    _dirty = false;
+
+    return true;
+  }
+
+private:
+  uint8_t _cs_pin;
+
+  // What we want on the display, and what we last sent to it
+  char _buf[ST7920_CELLS];
+  char _shadow[ST7920_CELLS];
+  uint8_t _cursor; // DDRAM word the address counter points at
+  bool _dirty;
+
+  // LOG mode borrows _buf as a ring of the last ST7920_ROWS lines, and
+  // _shadow as the staging area for the DDRAM rows being written
+  bool _log;
+  bool _log_full;        // Next step repaints both rows, not just one
+  bool _log_busy;        // A step is staged and being sent
+  uint16_t _log_count;   // Lines appended
+  uint16_t _log_shown;   // Lines the display reflects
+  uint16_t _log_target;  // Lines the staged step reflects
+  uint8_t _log_top;      // DDRAM row at the top of the display
+  uint8_t _log_new_top;  // Where the staged step scrolls to
+  uint8_t _log_row;      // First DDRAM row the staged step writes
+  uint8_t _log_words;    // Words staged
+  uint8_t _log_sent;     // Words of the staged step sent
+
+  void appendLog(char* str) {
+    char* line = _buf + ((_log_count % ST7920_ROWS) * ST7920_COLS);
+    uint8_t i;
+
+    if (!_log) {
+      // The ring replaces whatever text was on the display
+      _log = true;
+      _log_full = true;
+      _log_busy = false;
+      memset(_buf, ' ', ST7920_CELLS);
+    }
+
+    for (i = 0; i < ST7920_COLS; i++)
+      line[i] = (str && *str && *str != '\r' && *str != '\n') ? *str++ : ' ';
+
+    _log_count++;
+  }
+
+  // Back to plain text, which starts from a blank screen
+  void endLog() {
+    _log = false;
+    _log_busy = false;
+    memset(_buf, ' ', ST7920_CELLS);
+    memset(_shadow, 0, ST7920_CELLS); // Force every word to be resent
+    _cursor = ST7920_NO_CURSOR;
+    _dirty = true;
+  }
+
+  // Copy visible lines left and right (0 being the oldest) into both
+  // halves of the staged DDRAM row out
+  void stageLogRow(uint8_t out, uint8_t left, uint8_t right) {
+    char* row = _shadow + (out * ST7920_COLS * 2);
+    int32_t line;
+
+    line = (int32_t)_log_count - ST7920_ROWS + left;
+    if (line >= 0)
+      memcpy(row, _buf + ((line % ST7920_ROWS) * ST7920_COLS), ST7920_COLS);
+    else
+      memset(row, ' ', ST7920_COLS);
+
+    line = (int32_t)_log_count - ST7920_ROWS + right;
+    if (line >= 0)
+      memcpy(row + ST7920_COLS, _buf + ((line % ST7920_ROWS) * ST7920_COLS), ST7920_COLS);
+    else
+      memset(row + ST7920_COLS, ' ', ST7920_COLS);
+  }
+
+  // Move the display to start at DDRAM row top
+  void setScroll(uint8_t top) {
+    sendCmd(LCD_EXTEND);
+    sendCmd(LCD_SCROLL);
+    sendCmd(LCD_SCROLLADDR | ((top * 16) % ST7920_SCROLL_ROWS));
+  }
+
+  // The display shows DDRAM rows top and top+1, with the left halves
+  // above the right halves, so visible lines 0-3 sit at
+  // L(top), L(top+1), R(top), R(top+1).
+  // An append writes L(top+2) = line 1 and R(top+2) = line 3 while
+  // that row is hidden, then scrolls down one row: one row of traffic.
+  // If appends outran the flush, both hidden rows are written and
+  // scrolled to instead.
+  // Returns false if budget_us ran out.
+  bool flushLog(uint32_t start, uint16_t budget_us) {
+    bool basic = false;
+
+    // Leaving LOG mode puts the scroll back for plain text
+    if (!_log) {
+      if (_log_top) {
+        setScroll(0);
+        _log_top = 0;
+      }
+      return true;
+    }
+
+    while (_log_busy || _log_shown != _log_count) {
+      if (!_log_busy) {
+        _log_row = (_log_top + 2) % ST7920_DDRAM_ROWS;
+        _log_target = _log_count;
+        _log_sent = 0;
+
+        if (_log_full || (uint16_t)(_log_count - _log_shown) > 1) {
+          stageLogRow(0, 0, 2);
+          stageLogRow(1, 1, 3);
+          _log_words = ST7920_ROW_WORDS * 2;
+          _log_new_top = _log_row;
+        } else {
+          stageLogRow(0, 1, 3);
+          _log_words = ST7920_ROW_WORDS;
+          _log_new_top = (_log_top + 1) % ST7920_DDRAM_ROWS;
+        }
+
+        _log_full = false;
+        _log_busy = true;
+      }
+
+      if (_log_sent < _log_words) {
+        if (!basic) {
+          sendCmd(LCD_BASIC);
+          basic = true;
+        }
+
+        // Half a row, one line, at a time
+        sendCmd(LCD_ADDR
+          + (((_log_row + (_log_sent / ST7920_ROW_WORDS)) % ST7920_DDRAM_ROWS) * ST7920_ROW_WORDS)
+          + (_log_sent % ST7920_ROW_WORDS));
+        sendData(_shadow + (_log_sent * 2), ST7920_COLS);
+        _log_sent += ST7920_COLS / 2;
+      } else {
+        setScroll(_log_new_top);
+        basic = false;
+        _log_top = _log_new_top;
+        _log_shown = _log_target;
+        _log_busy = false;
+      }
+
+      if (budget_us && (micros() - start) >= budget_us)
+        return false;
+    }
+
+    return true;
+  }
+
+#ifdef ST7920_GFX_SUPPORT
+  // Retained drawing ops, and the band they're rendered into
+  st7920_gfx_op_t _ops[ST7920_GFX_MAX_OPS];
+  uint8_t _band[ST7920_GFX_BAND_ROWS * ST7920_GFX_ROW_BYTES];
+  uint8_t _gfx_dirty[ST7920_GFX_HEIGHT]; // Bit per 16 pixel word of a row
+  uint8_t _gfx_band;     // Band the flush is working through
+  bool _gfx_rendered;    // _band holds _gfx_band's current pixels
+  bool _gfx_pending;     // Some of _gfx_dirty is set
+  bool _gfx;
+
+  // GFX ON|OFF|CLR, or GFX TEXT|HLINE|VLINE|BAR <x> <y> ...
+  // Returns NULL once the op is queued, or an error
+  char* setGfx(char* args) {
+    st7920_gfx_op_t op;
+    char* op_name;
+    uint8_t i;
+
+    op_name = args ? pop_token(args, &args) : NULL;
+    if (!op_name)
+      return "ERR SET GFX wanted ONN, OFF, CLR, TEXT, HLINE, VLINE or BAR";
+
+    if(strcasecmp(op_name, "ONN") == 0) {
+      // Blank the text layer, it's drawn over the graphics
+      if (_log)
+        endLog();
+      memset(_buf, ' ', ST7920_CELLS);
+      // RE and G can't change in the same instruction
+      sendCmd(LCD_EXTEND);
+      sendCmd(LCD_GFXMODE);
+      _gfx = true;
+      clearGfx();
+      return NULL;
+    }
+
+    if(strcasecmp(op_name, "OFF") == 0) {
+      sendCmd(LCD_TXTMODE);
+      _gfx = false;
+      memset(_ops, 0, sizeof(_ops));
+      memset(_gfx_dirty, 0, sizeof(_gfx_dirty));
+      _gfx_pending = false;
+      return NULL;
+    }
+
+    if (!_gfx)
+      return "ERR SET GFX is OFF";
+
+    if(strcasecmp(op_name, "CLR") == 0) {
+      clearGfx();
+      return NULL;
+    }
+
+    memset(&op, 0, sizeof(op));
+    if(strcasecmp(op_name, "TEXT") == 0)
+      op.op = gfx_text;
+    if(strcasecmp(op_name, "HLINE") == 0)
+      op.op = gfx_hline;
+    if(strcasecmp(op_name, "VLINE") == 0)
+      op.op = gfx_vline;
+    if(strcasecmp(op_name, "BAR") == 0)
+      op.op = gfx_bar;
+
+    if (op.op == gfx_none)
+      return "ERR SET GFX unknown op";
+
+    if (!popNum(&args, &op.x) || !popNum(&args, &op.y))
+      return "ERR SET GFX wanted x and y";
+
+    switch (op.op) {
+      case gfx_text:
+        for (i = 0; args && args[i] && args[i] != '\r' && args[i] != '\n' && i < ST7920_GFX_TEXT_MAX; i++)
+          op.text[i] = args[i];
+        op.text[i] = '\0';
+        break;
+      case gfx_hline:
+      case gfx_vline:
+        if (!popNum(&args, &op.a))
+          return "ERR SET GFX wanted length";
+        break;
+      case gfx_bar:
+        if (!popNum(&args, &op.a) || !popNum(&args, &op.b) || !popNum(&args, &op.c))
+          return "ERR SET GFX BAR wanted w h percent";
+        if (op.c > 100)
+          op.c = 100;
+        break;
+    }
+
+    return addOp(&op);
+  }
+
+  // Pop a number off args, false if there isn't one
+  bool popNum(char** args, uint8_t* num) {
+    char* token = *args ? pop_token(*args, args) : NULL;
+
+    if (!token)
+      return false;
+
+    *num = atoi(token);
+    return true;
+  }
+
+  // An op at the same place and of the same type replaces the old one,
+  // so values and labels can be updated in place
+  char* addOp(st7920_gfx_op_t* op) {
+    st7920_gfx_op_t* slot = NULL;
+    uint8_t i;
+
+    for (i = 0; i < ST7920_GFX_MAX_OPS; i++) {
+      if (_ops[i].op == op->op && _ops[i].x == op->x && _ops[i].y == op->y) {
+        slot = &_ops[i];
+        break;
+      }
+      if (!slot && _ops[i].op == gfx_none)
+        slot = &_ops[i];
+    }
+
+    if (!slot)
+      return "ERR SET GFX display list full";
+
+    if (slot->op != gfx_none)
+      markOp(slot);
+
+    memcpy(slot, op, sizeof(st7920_gfx_op_t));
+    markOp(slot);
+
+    return NULL;
+  }
+
+  void clearGfx() {
+    memset(_ops, 0, sizeof(_ops));
+    markDirty(0, 0, ST7920_GFX_WIDTH, ST7920_GFX_HEIGHT);
+  }
+
+  void markOp(st7920_gfx_op_t* op) {
+    switch (op->op) {
+      case gfx_text:
+        markDirty(op->x, op->y, strlen(op->text) * ST7920_FONT_CELL_WIDTH, ST7920_FONT_CELL_HEIGHT);
+        break;
+      case gfx_hline:
+        markDirty(op->x, op->y, op->a, 1);
+        break;
+      case gfx_vline:
+        markDirty(op->x, op->y, 1, op->a);
+        break;
+      case gfx_bar:
+        markDirty(op->x, op->y, op->a, op->b);
+        break;
     }
+  }
 
-    pos = pop_token(params, &output);
-    if (!pos)
-      return "ERR SET needs line pos after line num";
+  // Flag the words covering a rectangle as needing a re-render and send
+  void markDirty(uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    uint8_t words = 0;
+    uint8_t x1;
+    uint8_t i;
 
-    // Clear the entire line
-    if(strcasecmp(pos, "CLR") == 0) 
-    {
-      printTxt(lcd_pos, "                ");
+    if (!w || !h || x >= ST7920_GFX_WIDTH || y >= ST7920_GFX_HEIGHT)
+      return;
 
-      return "ACK";
-    }
+    x1 = ((x + w) > ST7920_GFX_WIDTH) ? ST7920_GFX_WIDTH : (x + w);
+    for (i = x / 16; i <= (x1 - 1) / 16; i++)
+      words |= _BV(i);
 
-    // Determine position (by 2) in the line
-    pos_num = atoi(pos);
-    if (!((pos_num >= 0) && (pos_num < 16)))
-      return "ERR SET line pos not between 0-15";
+    for (i = y; i < (y + h) && i < ST7920_GFX_HEIGHT; i++)
+      _gfx_dirty[i] |= words;
 
-    printTxt((lcd_pos + pos_num), output);
+    _gfx_rendered = false;
+    _gfx_pending = true;
+  }
 
-    return "ACK";
+  // Fill a rectangle, clipped to the band starting at row top
+  void fillRect(uint8_t top, uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    uint8_t row;
+    uint8_t col;
+
+    for (row = y; row < (y + h) && row < ST7920_GFX_HEIGHT; row++) {
+      if (row < top || row >= (top + ST7920_GFX_BAND_ROWS))
+        continue;
+
+      for (col = x; col < (x + w) && col < ST7920_GFX_WIDTH; col++)
+        _band[((row - top) * ST7920_GFX_ROW_BYTES) + (col / 8)] |= (0x80 >> (col & 7));
+    }
   }
 
-  void update() {
-    // We do nothing on update()
+  void renderText(uint8_t top, st7920_gfx_op_t* op) {
+    uint8_t row;
+    uint8_t col;
+    uint8_t x;
+    uint8_t bits;
+    char* c;
+
+    for (row = 0; row < ST7920_FONT_HEIGHT; row++) {
+      if ((op->y + row) < top || (op->y + row) >= (top + ST7920_GFX_BAND_ROWS))
+        continue;
+
+      x = op->x;
+      for (c = op->text; *c; c++, x += ST7920_FONT_CELL_WIDTH - ST7920_FONT_WIDTH) {
+        for (col = 0; col < ST7920_FONT_WIDTH; col++, x++) {
+          if (*c < ST7920_FONT_FIRST || *c > ST7920_FONT_LAST)
+            continue;
+
+          bits = pgm_read_byte(&ST7920_FONT[((*c - ST7920_FONT_FIRST) * ST7920_FONT_WIDTH) + col]);
+          if (bits & _BV(row))
+            fillRect(top, x, op->y + row, 1, 1);
+        }
+      }
+    }
   }
 
-  void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s", id, getCTypeName(type));
+  // Draw every op that touches the band starting at row top
+  void renderBand(uint8_t top) {
+    st7920_gfx_op_t* op;
+    uint8_t fill;
+    uint8_t i;
+
+    memset(_band, 0, sizeof(_band));
+
+    for (i = 0; i < ST7920_GFX_MAX_OPS; i++) {
+      op = &_ops[i];
+      switch (op->op) {
+        case gfx_text:
+          renderText(top, op);
+          break;
+        case gfx_hline:
+          fillRect(top, op->x, op->y, op->a, 1);
+          break;
+        case gfx_vline:
+          fillRect(top, op->x, op->y, 1, op->a);
+          break;
+        case gfx_bar:
+          // Outline, then fill from the left
+          fillRect(top, op->x, op->y, op->a, 1);
+          fillRect(top, op->x, op->y + op->b - 1, op->a, 1);
+          fillRect(top, op->x, op->y, 1, op->b);
+          fillRect(top, op->x + op->a - 1, op->y, 1, op->b);
+          if (op->a > 2 && op->b > 2) {
+            fill = ((uint16_t)(op->a - 2) * op->c) / 100;
+            fillRect(top, op->x + 1, op->y + 1, fill, op->b - 2);
+          }
+          break;
+      }
+    }
   }
 
-  bool setup() {
-    pinMode(_cs_pin, OUTPUT);
-    digitalWrite(_cs_pin, LOW);
-    SPI.begin();
-    sendCmd(LCD_BASIC);
-    sendCmd(LCD_BASIC);
-    sendCmd(LCD_CLS);
-    delay(2);
-    sendCmd(LCD_ADDRINC);
-    sendCmd(LCD_DISPLAYON);
+  // Render each band holding dirty words and send just those words,
+  // resuming where the last call ran out of budget.
+  // Returns false if budget_us ran out.
+  bool flushGfx(uint32_t start, uint16_t budget_us) {
+    bool extended = false;
+    uint8_t* dirty;
+    uint8_t top;
+    uint8_t row;
+    uint8_t w;
+    uint8_t end;
+
+    if (!_gfx_pending)
+      return true;
 
-    // setGfxMode(true);
+    for (; _gfx_band < ST7920_GFX_BANDS; _gfx_band++, _gfx_rendered = false) {
+      top = _gfx_band * ST7920_GFX_BAND_ROWS;
 
-    // Enable TEXT mode
-    sendCmd(LCD_EXTEND);
-    sendCmd(LCD_TXTMODE);
+      for (row = top; row < (top + ST7920_GFX_BAND_ROWS); row++) {
+        dirty = &_gfx_dirty[row];
+
+        while (*dirty) {
+          if (!_gfx_rendered) {
+            renderBand(top);
+            _gfx_rendered = true;
+          }
+
+          for (w = 0; !(*dirty & _BV(w)); w++);
+          for (end = w + 1; end < ST7920_GFX_ROW_WORDS && (*dirty & _BV(end)); end++);
+
+          // GDRAM is addressed in the extended instruction set
+          if (!extended) {
+            sendCmd(LCD_EXTEND);
+            sendCmd(LCD_GFXMODE);
+            extended = true;
+          }
+
+          sendCmd(LCD_ADDR | (row % 32));
+          sendCmd(LCD_ADDR | ((row / 32) * ST7920_GFX_ROW_WORDS + w));
+          sendData((char*)&_band[((row - top) * ST7920_GFX_ROW_BYTES) + (w * 2)], (end - w) * 2);
+
+          for (; w < end; w++)
+            *dirty &= ~_BV(w);
+
+          if (budget_us && (micros() - start) >= budget_us)
+            return false;
+        }
+      }
+    }
+
+    // Ops added during the pass may have dirtied bands already done
+    _gfx_band = 0;
+    _gfx_pending = false;
+    for (row = 0; row < ST7920_GFX_HEIGHT; row++)
+      if (_gfx_dirty[row])
+        _gfx_pending = true;
 
     return true;
   }
-
-private:
-  uint8_t _cs_pin;
+#endif // #ifdef ST7920_GFX_SUPPORT
 
   void sendCmd(byte b) {
-    SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE3));
+    SPI.beginTransaction(SPISettings(ST7920_SPI_SPEED, MSBFIRST, SPI_MODE3));
     digitalWrite(_cs_pin, HIGH);
     SPI.transfer(0xF8);
     SPI.transfer(b & 0xF0);
     SPI.transfer(b << 4);
+    delayMicroseconds(ST7920_DATA_DELAY_US);
     digitalWrite(_cs_pin, LOW);
     SPI.endTransaction();
   }
   // ----------------------------------------------------------------
 
-  void sendData(byte b) {
-    SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE3));
+  // Stream a run of data bytes in one transaction, the ST7920 keeps
+  // taking data after a single sync byte
+  void sendData(char* data, uint8_t len) {
+    SPI.beginTransaction(SPISettings(ST7920_SPI_SPEED, MSBFIRST, SPI_MODE3));
     digitalWrite(_cs_pin, HIGH);
     SPI.transfer(0xFA);
-    SPI.transfer(b & 0xF0);
-    SPI.transfer(b << 4);
+    while (len--) {
+      SPI.transfer(*data & 0xF0);
+      SPI.transfer(*data << 4);
+      data++;
+      delayMicroseconds(ST7920_DATA_DELAY_US);
+    }
     digitalWrite(_cs_pin, LOW);
     SPI.endTransaction();
   }
 
+  // Copy str into the framebuffer from DDRAM address pos
   void printTxt(uint8_t pos, char* str) {
-    sendCmd(LCD_BASIC);
-    sendCmd(pos);
-    while (*str) sendData(*str++);
+    uint8_t i = (pos - LCD_ADDR) * 2;
+
+    while (*str && *str != '\r' && *str != '\n' && i < ST7920_CELLS)
+      _buf[i++] = *str++;
   }
 
   // For supporting non-ASCII characters
   void printTxt(uint8_t pos, uint16_t* signs) {
-    sendCmd(LCD_BASIC);
-    sendCmd(pos);
-    while (*signs) {
-      sendData(*signs >> 8);
-      sendData(*signs & 0xff);
+    uint8_t i = (pos - LCD_ADDR) * 2;
+
+    while (*signs && i < ST7920_CELLS) {
+      _buf[i++] = *signs >> 8;
+      _buf[i++] = *signs & 0xff;
       signs++;
     }
   }
+
+  // Mark the framebuffer for flushing, or flush it now if sync
+  char* queued(bool sync) {
+    _dirty = true;
+    if (sync)
+      flush(0);
+
+    return "ACK";
+  }
+
+  bool isDirtyWord(uint8_t w) {
+    return (_buf[w * 2] != _shadow[w * 2])
+      || (_buf[(w * 2) + 1] != _shadow[(w * 2) + 1]);
+  }
+
+  // Send what changed in the text and graphics layers.
+  // Stops once budget_us is spent, the rest goes out on a later update(),
+  // a budget_us of 0 flushes everything.
+  void flush(uint16_t budget_us) {
+    uint32_t start = micros();
+
+    if (!flushLog(start, budget_us))
+      return;
+
+    if (!_log && !flushText(start, budget_us))
+      return;
+
+#ifdef ST7920_GFX_SUPPORT
+    flushGfx(start, budget_us);
+#endif
+  }
+
+  // Send only the DDRAM words that differ from what is on the display,
+  // each run of dirty words (up to a line) is one address command and
+  // one streamed transaction.
+  // Returns false if budget_us ran out.
+  bool flushText(uint32_t start, uint16_t budget_us) {
+    bool basic = false;
+    uint8_t w;
+    uint8_t end;
+
+    if (!_dirty)
+      return true;
+
+    for (w = 0; w < ST7920_WORDS; w = end) {
+      if (!isDirtyWord(w)) {
+        end = w + 1;
+        continue;
+      }
+
+      // Find the end of the run, capped to a line to bound a single burst
+      for (end = w + 1; end < ST7920_WORDS && (end - w) < (ST7920_COLS / 2); end++)
+        if (!isDirtyWord(end))
+          break;
+
+      // setup() leaves us in the extended instruction set
+      if (!basic) {
+        sendCmd(LCD_BASIC);
+        basic = true;
+      }
+
+      if (_cursor != w)
+        sendCmd(LCD_ADDR + w);
+
+      sendData(_buf + (w * 2), (end - w) * 2);
+      memcpy(_shadow + (w * 2), _buf + (w * 2), (end - w) * 2);
+      _cursor = (end < ST7920_WORDS) ? end : ST7920_NO_CURSOR;
+
+      if (budget_us && (micros() - start) >= budget_us)
+        return false;
+    }
+
+    _dirty = false;
+    return true;
+  }
 };
 
 #endif // #ifdef ST7920_SUPPORT
@@ -1049,18 +6029,43 @@ public:
       return "ERR SET wanted color name or OFF";
 
     if (strcasecmp(color_name, "OFF") == 0) {
-      _active->disable();
+      if (_active)
+        _active->disable();
       _active = NULL;
 
+#ifdef LEDPWM_SUPPORT
+      if (_mixed)
+        for (i = 0; leds[i]; i++)
+          leds[i]->disable();
+      _mixed = false;
+#endif
+
       return "ACK";
     }
 
+#ifdef LEDPWM_SUPPORT
+    if (strcasecmp(color_name, "COLOR") == 0)
+      return set_color(params);
+#endif
+
     /* Find the color */
     for (i = 0; leds[i]; i++)
       if (strcasecmp(color_name, leds[i]->id) == 0) {
         if (_active && _active != leds[i])
           _active->disable();
 
+#ifdef LEDPWM_SUPPORT
+        // Leaving a mixed color, the other channels go dark
+        if (_mixed) {
+          uint8_t j;
+          for (j = 0; leds[j]; j++)
+            if (j != i)
+              leds[j]->disable();
+          leds[i]->set_level(255);
+          _mixed = false;
+        }
+#endif
+
         _active = leds[i];
         return _active->set(params);
       }
@@ -1068,6 +6073,67 @@ public:
     return "ERR failed to find color indicated";
   }
 
+#ifdef LEDPWM_SUPPORT
+  // COLOR <r> <g> <b> [BLINK|BREATHE|FADE [ms]]
+  // Mixes all three channels, each 0-255, optionally running an effect
+  // on the mixed color.
+  char* set_color(char* params) {
+    LedComponent* leds[] = { _red, _green, _blue };
+    uint8_t rgb[3];
+    LedEffect effect = ledfx_solid;
+    uint16_t period = 0;
+    char* value;
+    uint8_t i;
+
+    for (i = 0; i < 3; i++) {
+      if (!leds[i]->pwm())
+        return "ERR RGBLED COLOR needs every channel on a PWM pin";
+
+      value = params ? pop_token(params, &params) : NULL;
+      if (!value)
+        return "ERR RGBLED COLOR wanted <r> <g> <b> [BLINK|BREATHE|FADE [ms]]";
+
+      rgb[i] = constrain(atoi(value), 0, 255);
+    }
+
+    value = params ? pop_token(params, &params) : NULL;
+    if (value) {
+      if (strcasecmp(value, "BLINK") == 0) {
+        effect = ledfx_blink;
+        period = 1000;
+      } else if (strcasecmp(value, "BREATHE") == 0) {
+        effect = ledfx_breathe;
+        period = 3000;
+      } else if (strcasecmp(value, "FADE") == 0) {
+        effect = ledfx_fade;
+        period = 1000;
+      } else
+        return "ERR RGBLED COLOR effect wanted BLINK, BREATHE or FADE";
+
+      value = params ? pop_token(params, NULL) : NULL;
+      if (value && atoi(value))
+        period = atoi(value);
+    }
+
+    if (_active)
+      _active->disable();
+    _active = NULL;
+
+    // Start the channels together, so their waveforms stay in step
+    noInterrupts();
+    for (i = 0; i < 3; i++) {
+      leds[i]->set_level(rgb[i]);
+      leds[i]->start_effect(effect, period);
+    }
+    interrupts();
+
+    memcpy(_color, rgb, sizeof(_color));
+    _mixed = true;
+
+    return "ACK";
+  }
+#endif
+
   void update() {
     if (_active)
       _active->update();
@@ -1075,6 +6141,14 @@ public:
 
   void getMessage(char* buf) {
 
+#ifdef LEDPWM_SUPPORT
+    if (_mixed) {
+      sprintf(buf, "%s\t%s\tCOLOR\t%u %u %u\t%s", id, getCTypeName(type),
+              _color[0], _color[1], _color[2], _red->get_state());
+      return;
+    }
+#endif
+
     // Early exit if nothing going on
     if (!_active) {
       sprintf(buf, "%s\t%s\t%s", id, getCTypeName(type), "OFF");
@@ -1092,83 +6166,268 @@ public:
     return true;
   }
 
-private:
-  LedComponent* _active = NULL;
+private:
+  LedComponent* _active = NULL;
+#ifdef LEDPWM_SUPPORT
+  bool _mixed = false;
+  uint8_t _color[3];
+#endif
+
+  LedComponent* _red;
+  LedComponent* _green;
+  LedComponent* _blue;
+};
+
+class EncoderComponent : public InputComponent {
+public:
+  EncoderComponent(char* id, IOMethod* clk, IOMethod* dt)
+    : InputComponent(id, encoder_type) {
+    this->_clk = clk;
+    this->_dt = dt;
+  }
+
+  bool poll() {
+    _dir = NULL;
+
+    _currentStateCLK = _clk->read();
+
+    if ((_currentStateCLK != _lastStateCLK)
+        && _currentStateCLK) {
+
+      if (_dt->read() != _currentStateCLK) {
+        _counter++;
+        _dir = "RIGHT";
+      } else {
+        _counter--;
+        _dir = "LEFT";
+      }
+
+#ifdef CONFIG_SUPPORT
+      persist(_counter);
+#endif
+    }
+    _lastStateCLK = _currentStateCLK;
+
+    return (_dir != NULL);
+  }
+
+  void getMessage(char* buf) {
+    sprintf(buf, "%s\t%s\t%s\t%d", id, getCTypeName(type), _dir, _counter);
+  }
+
+  bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t counter;
+
+    if (restore(&counter))
+      _counter = counter;
+#endif
+
+    _clk->setup();
+    _dt->setup();
+
+    return true;
+  }
+
+private:
+  IOMethod* _clk;
+  IOMethod* _dt;
+  bool _currentStateCLK = false;
+  bool _lastStateCLK = false;
+  int _counter = 0;
+  char* _dir = NULL;
+};
+
+class ToggleComponent : public InputComponent {
+public:
+  ToggleComponent(char* id, IOMethod* method)
+    : InputComponent(id, toggle_type) {
+    this->_method = method;
+  }
+
+  bool poll() {
+    bool new_state = _method->read();
+    if (_state != new_state) {
+      _state = new_state;
+      return true;
+    }
+    return false;
+  }
+
+  void getMessage(char* buf) {
+    char* state_string = _state ? "ONN" : "OFF";
+    sprintf(buf, "%s\t%s\t%s", id, getCTypeName(type), state_string);
+  }
+
+  bool setup() {
+    _method->setup();
+    return true;
+  }
+
+private:
+  IOMethod* _method;
+  bool _state;
+};
+
+
+// Default deadband, in 10-bit ADC steps
+#ifndef POT_THRESHOLD
+#define POT_THRESHOLD 3
+#endif
+
+enum PotFilter {
+  potf_none,
+  potf_ema,
+  potf_median
+};
+
+/*
+ * Analog input, run through a small pipeline before it's reported
+ *
+ *   filter   - NONE, EMA <shift> (new = old + (x - old) / 2^shift),
+ *              or MEDIAN of the last 3 samples
+ *   deadband - raw change needed before a new value is accepted,
+ *              so reversing direction has to cross the whole band
+ *   range    - fixed-point mapping of 0-ANALOG_MAX onto <min> <max>
+ *   interval - minimum milliseconds between EVENTs
+ *
+ * All are configurable at runtime, ex. "SET SPEED FILTER EMA 3"
+ */
+class PotComponent : public InputComponent {
+public:
+  PotComponent(char* id, IOMethod* method)
+    : InputComponent(id, pot_type) {
+    this->_method = method;
+    this->_filter = potf_none;
+    this->_ema_shift = 2;
+    this->_deadband = POT_THRESHOLD * ((ANALOG_MAX + 1) / 1024);
+    this->_interval = 0;
+    this->_timer = 0;
+    this->_primed = false;
+    this->_state = 0;
+    setRange(0, ANALOG_MAX);
+#ifdef HIST_SUPPORT
+    this->_hist = new History("POT");
+#endif
+  }
+
+  bool poll() {
+    int32_t mapped;
+    int new_state = filter(_method->readAnalog());
+
+#ifdef HIST_SUPPORT
+    if (_hist->due())
+      _hist->add(getMapped());
+#endif
+
+    if ((((_state - new_state) <= _deadband)
+         && ((new_state - _state) <= _deadband))
+        || (_interval && !is_tc_alert(_timer)))
+      return false;
+
+    _state = new_state;
+    _timer = get_tc_alert(_interval);
+
+    // Several raw values can land on the same output value
+    mapped = getMapped();
+    if (mapped == _mapped)
+      return false;
+
+    _mapped = mapped;
+    return true;
+  }
+
+  char* set(char* args) {
+    char* opt;
+    char* params = NULL;
+
+    if (!args || !(opt = pop_token(args, &params)))
+      return "ERR\tSET wanted FILTER, DEADBAND, RANGE or INTERVAL";
+
+    if (strcasecmp(opt, "FILTER") == 0) {
+      char* mode = params ? pop_token(params, &params) : NULL;
+
+      if (!mode)
+        return "ERR\tSET FILTER wanted NONE, EMA or MEDIAN";
+
+      if (strcasecmp(mode, "NONE") == 0) {
+        _filter = potf_none;
+      } else if (strcasecmp(mode, "MEDIAN") == 0) {
+        _filter = potf_median;
+      } else if (strcasecmp(mode, "EMA") == 0) {
+        if (params && *params)
+          _ema_shift = constrain(atoi(params), 1, 8);
+        _filter = potf_ema;
+      } else {
+        return "ERR\tSET FILTER wanted NONE, EMA or MEDIAN";
+      }
+
+      _primed = false;
+      return "ACK";
+    }
+
+    if (strcasecmp(opt, "DEADBAND") == 0) {
+      if (!params || !*params)
+        return "ERR\tSET DEADBAND wanted a value";
+
+      _deadband = atoi(params);
+      return "ACK";
+    }
 
-  LedComponent* _red;
-  LedComponent* _green;
-  LedComponent* _blue;
-};
+    if (strcasecmp(opt, "RANGE") == 0) {
+      char* min_str = params ? pop_token(params, &params) : NULL;
+      char* max_str = params ? pop_token(params, NULL) : NULL;
 
-class EncoderComponent : public InputComponent {
-public:
-  EncoderComponent(char* id, IOMethod* clk, IOMethod* dt)
-    : InputComponent(id, encoder_type) {
-    this->_clk = clk;
-    this->_dt = dt;
-  }
+      if (!min_str || !max_str)
+        return "ERR\tSET RANGE wanted min and max";
 
-  bool poll() {
-    _dir = NULL;
+      if (!setRange(atoi(min_str), atoi(max_str)))
+        return "ERR\tSET RANGE span must be under 32768";
 
-    _currentStateCLK = _clk->read();
+      _mapped = getMapped();
+      return "ACK";
+    }
 
-    if ((_currentStateCLK != _lastStateCLK)
-        && _currentStateCLK) {
+    if (strcasecmp(opt, "INTERVAL") == 0) {
+      if (!params || !*params)
+        return "ERR\tSET INTERVAL wanted milliseconds";
 
-      if (_dt->read() != _currentStateCLK) {
-        _counter++;
-        _dir = "RIGHT";
-      } else {
-        _counter--;
-        _dir = "LEFT";
-      }
+      _interval = atol(params);
+      return "ACK";
     }
-    _lastStateCLK = _currentStateCLK;
 
-    return (_dir != NULL);
+    return "ERR\tSET wanted FILTER, DEADBAND, RANGE or INTERVAL";
   }
 
   void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%s\t%d", id, getCTypeName(type), _dir, _counter);
+    sprintf(buf, "%s\t%s\t%ld", id, getCTypeName(type), _mapped);
   }
 
-  bool setup() {
-    _clk->setup();
-    _dt->setup();
+  // Map the output range onto min-max, in 16.16 fixed-point
+  bool setRange(int16_t out_min, int16_t out_max) {
+    int32_t span = (int32_t)out_max - out_min;
 
+    if ((span > 32767) || (span < -32767))
+      return false;
+
+    _out_min = out_min;
+    _scale = (span << 16) / ANALOG_MAX;
     return true;
   }
 
-private:
-  IOMethod* _clk;
-  IOMethod* _dt;
-  bool _currentStateCLK = false;
-  bool _lastStateCLK = false;
-  int _counter = 0;
-  char* _dir = NULL;
-};
-
-class ToggleComponent : public InputComponent {
-public:
-  ToggleComponent(char* id, IOMethod* method)
-    : InputComponent(id, toggle_type) {
-    this->_method = method;
+  int32_t getMapped() {
+    return _out_min + (((int32_t)_state * _scale) >> 16);
   }
 
-  bool poll() {
-    bool new_state = _method->read();
-    if (_state != new_state) {
-      _state = new_state;
-      return true;
-    }
-    return false;
+  float getValue() {
+    return (float)_state / (ANALOG_MAX + 1);
   }
 
-  void getMessage(char* buf) {
-    char* state_string = _state ? "ONN" : "OFF";
-    sprintf(buf, "%s\t%s\t%s", id, getCTypeName(type), state_string);
+#ifdef HIST_SUPPORT
+  History* history(uint8_t i) {
+    return i ? NULL : _hist;
   }
+#endif
 
   bool setup() {
     _method->setup();
@@ -1177,7 +6436,55 @@ public:
 
 private:
   IOMethod* _method;
-  bool _state;
+  int _state;
+  int32_t _mapped = 0;
+#ifdef HIST_SUPPORT
+  History* _hist;
+#endif
+
+  PotFilter _filter;
+  uint8_t _ema_shift;
+  int32_t _ema;  // 4 fractional bits
+  int _history[3];
+  bool _primed;
+
+  int _deadband;
+  int16_t _out_min;
+  int32_t _scale;
+  uint32_t _interval;
+  tick _timer;
+
+  int filter(int x) {
+    if (!_primed) {
+      _ema = (int32_t)x << 4;
+      _history[0] = _history[1] = _history[2] = x;
+      _primed = true;
+    }
+
+    if (_filter == potf_ema) {
+      _ema += (((int32_t)x << 4) - _ema) >> _ema_shift;
+      return (int)(_ema >> 4);
+    }
+
+    if (_filter == potf_median) {
+      int a;
+      int b;
+      int c;
+
+      _history[0] = _history[1];
+      _history[1] = _history[2];
+      _history[2] = x;
+      a = _history[0];
+      b = _history[1];
+      c = _history[2];
+
+      if (a > b) { int t = a; a = b; b = t; }
+      if (b > c) { b = c; }
+      return (a > b) ? a : b;
+    }
+
+    return x;
+  }
 };
 
 
@@ -1266,6 +6573,204 @@ private:
 };
 
 
+// Maximum rows in a key matrix, columns are limited to 8
+#ifndef MATRIX_MAX_ROWS
+#define MATRIX_MAX_ROWS 8
+#endif
+
+#if MATRIX_MAX_ROWS > 8
+#error "MATRIX_MAX_ROWS can't be more than 8, rows are tracked in a uint8_t mask"
+#endif
+
+// Key changes waiting to be reported, one goes out per poll()
+#ifndef MATRIX_QUEUE
+#define MATRIX_QUEUE 16
+#endif
+
+/*
+ * Key matrix, scanned one row per poll()
+ *
+ * Only the selected row is driven LOW, and columns are
+ * iomt_input_pullup inputs, so a pressed key reads true.
+ * Direct pin rows are released to INPUT_PULLUP when not selected,
+ * so two keys in one column can't short a HIGH row to the LOW one.
+ * PCF8575 rows are written HIGH, which only pulls up weakly.
+ * Each key is reported like a ButtonComponent; if names isn't
+ * provided keys are named <id>_<row>_<col>.
+ */
+class MatrixComponent : public InputComponent {
+public:
+  MatrixComponent(char* id, IOMethod** rows, IOMethod** cols, char** names = NULL)
+    : InputComponent(id, matrix_type) {
+    this->_rows = rows;
+    this->_cols = cols;
+    this->_names = names;
+  }
+
+  bool poll() {
+    uint8_t c;
+    uint8_t edge;
+
+    _event_row = 0xFF;
+
+    if (!_row_count)
+      return false;
+
+    // Read the row selected on the last tick, so it's had a
+    // full loop to settle, then move on to the next one
+    _scan[_row] = 0;
+    for (c = 0; c < _col_count; c++)
+      if (_cols[c]->read())
+        _scan[_row] |= (1 << c);
+
+    drive_row(_row, false);
+    _row++;
+    if (_row >= _row_count) {
+      _row = 0;
+      end_frame();
+    }
+    drive_row(_row, true);
+
+    // Report one change per poll()
+    if (!_queued)
+      return false;
+
+    edge = _queue[_queue_head];
+    _queue_head = (_queue_head + 1) % MATRIX_QUEUE;
+    _queued--;
+
+    _event_row = edge >> 4;
+    _event_col = (edge >> 1) & 0x07;
+    _event_on = edge & 0x01;
+    return true;
+  }
+
+  // The EVENT from the last poll() is only reported once,
+  // a GET after that gets the summary
+  void getMessage(char* buf) {
+    if (_event_row == 0xFF) {
+      sprintf(buf, "%s\t%s\t%u\t%u", id, getCTypeName(type), _ghosts, _row_count * _col_count);
+      return;
+    }
+
+    char* state_string = _event_on ? "ONN" : "OFF";
+
+    if (_names)
+      sprintf(buf, "%s\t%s\t%s", _names[(_event_row * _col_count) + _event_col],
+              getCTypeName(button_type), state_string);
+    else
+      sprintf(buf, "%s_%u_%u\t%s\t%s", id, _event_row, _event_col,
+              getCTypeName(button_type), state_string);
+
+    _event_row = 0xFF;
+  }
+
+  bool setup() {
+    uint8_t i;
+
+    for (i = 0; _cols[i] && (i < 8); i++)
+      _cols[i]->setup();
+    _col_count = i;
+
+    for (i = 0; _rows[i] && (i < MATRIX_MAX_ROWS); i++) {
+      _rows[i]->setup();
+      drive_row(i, false);
+    }
+    _row_count = i;
+
+    if (!_row_count || !_col_count)
+      return false;
+
+    drive_row(_row, true);
+    return true;
+  }
+
+private:
+  IOMethod** _rows;
+  IOMethod** _cols;
+  char** _names;
+  uint8_t _row_count = 0;
+  uint8_t _col_count = 0;
+  uint8_t _row = 0;
+  uint8_t _scan[MATRIX_MAX_ROWS] = { 0 };
+  uint8_t _state[MATRIX_MAX_ROWS] = { 0 };
+  uint8_t _queue[MATRIX_QUEUE];  // row << 4 | col << 1 | on
+  uint8_t _queue_head = 0;
+  uint8_t _queued = 0;
+  uint8_t _event_row = 0xFF;
+  uint8_t _event_col = 0;
+  bool _event_on = false;
+  uint16_t _ghosts = 0;
+
+  // Pull the selected row LOW, and let go of the others
+  void drive_row(uint8_t r, bool selected) {
+    int8_t pin = _rows[r]->directPin();
+
+    if (pin < 0) {
+      _rows[r]->write(!selected);
+      return;
+    }
+
+    if (selected) {
+      digitalWrite(pin, LOW);
+      pinMode(pin, OUTPUT);
+    } else {
+      pinMode(pin, INPUT_PULLUP);
+    }
+  }
+
+  // Queue a key change, false when the queue is full
+  bool push(uint8_t r, uint8_t c, bool on) {
+    if (_queued >= MATRIX_QUEUE)
+      return false;
+
+    _queue[(_queue_head + _queued++) % MATRIX_QUEUE] = (r << 4) | (c << 1) | (on ? 1 : 0);
+    return true;
+  }
+
+  // Without diodes, three keys on the corners of a rectangle make
+  // the fourth look pressed. Any two rows sharing two or more columns
+  // can't be trusted, so those rows keep their last state this frame.
+  // Each press and release is queued on its own, and a change that
+  // doesn't fit waits for the next frame.
+  void end_frame() {
+    uint8_t i;
+    uint8_t j;
+    uint8_t c;
+    uint8_t shared;
+    uint8_t changed;
+    uint8_t ghosted = 0;
+
+    for (i = 0; i < _row_count; i++)
+      for (j = i + 1; j < _row_count; j++) {
+        shared = _scan[i] & _scan[j];
+        if (shared & (shared - 1))
+          ghosted |= (1 << i) | (1 << j);
+      }
+
+    if (ghosted)
+      _ghosts++;
+
+    for (i = 0; i < _row_count; i++) {
+      if (ghosted & (1 << i))
+        continue;
+
+      changed = _scan[i] ^ _state[i];
+      for (c = 0; changed && (c < _col_count); c++) {
+        if (!(changed & (1 << c)))
+          continue;
+
+        if (!push(i, c, _scan[i] & (1 << c)))
+          return;
+
+        _state[i] ^= (1 << c);
+        changed &= ~(1 << c);
+      }
+    }
+  }
+};
+
+
 
 //
 // Define a panel
@@ -1276,10 +6781,14 @@ public:
   OutputComponent** outputs;
   char buf[SERIAL_BUFFER_SIZE];
 
+  // Optional binding, called with each input that raised an EVENT
+  void (*on_event)(InputComponent*);
+
   Panel(char* id, InputComponent** inputs, OutputComponent** outputs)
     : Component(id, panel_type) {
     this->inputs = inputs;
     this->outputs = outputs;
+    this->on_event = NULL;
   }
 
   void getMessage(char* buf) {
@@ -1289,6 +6798,11 @@ public:
   bool setup() {
     int i;
 
+#ifdef CONFIG_SUPPORT
+    // Components restore their settings in setup()
+    config_setup();
+#endif
+
     for (i = 0; inputs[i]; i++)
       if (!inputs[i]->setup())
         return false;
@@ -1320,6 +6834,18 @@ char* com_prot_desc(Panel*, char*);
 char* com_prot_ping(Panel*, char*);
 char* com_prot_set(Panel*, char*);
 char* com_prot_get(Panel*, char*);
+#ifdef HIST_SUPPORT
+char* com_prot_hist(Panel*, char*);
+#endif
+#ifdef TWI_SUPPORT
+char* com_prot_twi(Panel*, char*);
+#endif
+#ifdef DEBOUNCE_SUPPORT
+char* com_prot_bounce(Panel*, char*);
+#endif
+#ifdef CONFIG_SUPPORT
+char* com_prot_config(Panel*, char*);
+#endif
 
 /* List of commands */
 cmd_t command[] = {
@@ -1329,6 +6855,18 @@ cmd_t command[] = {
   { "DESC", com_prot_desc },
   { "SET", com_prot_set },
   { "GET", com_prot_get },
+#ifdef HIST_SUPPORT
+  { "HIST", com_prot_hist },
+#endif
+#ifdef TWI_SUPPORT
+  { "TWI", com_prot_twi },
+#endif
+#ifdef DEBOUNCE_SUPPORT
+  { "BOUNCE", com_prot_bounce },
+#endif
+#ifdef CONFIG_SUPPORT
+  { "CONFIG", com_prot_config },
+#endif
   { 0 }
 };
 
@@ -1370,6 +6908,16 @@ bool Panel::loop() {
   // Increment Tick counter
   tc_update();
 
+#ifdef TWI_SUPPORT
+  // Catch any hung I2C transactions
+  twi_poll();
+
+#ifdef PCF8575_SUPPORT
+  // Retry expander writes that didn't make it out
+  pcf8575_poll();
+#endif
+#endif
+
   // Check Inputs
   for (i = 0; inputs[i]; i++) {
     if (inputs[i]->poll()) {
@@ -1377,6 +6925,9 @@ bool Panel::loop() {
       inputs[i]->getMessage(buf + 6);
       Serial.println(buf);
       Serial.flush();
+
+      if (on_event)
+        on_event(inputs[i]);
     }
   }
 
@@ -1384,6 +6935,11 @@ bool Panel::loop() {
   for (i = 0; outputs[i]; i++)
     outputs[i]->update();
 
+#ifdef CONFIG_SUPPORT
+  // Write out settings that have stopped changing
+  config_flush();
+#endif
+
   // Check Serial
   if (Serial.available() > 0) {
     char* cmd;
@@ -1470,8 +7026,13 @@ char* com_prot_set(Panel* panel, char* args) {
 
   if (panel->outputs[i])
     return panel->outputs[i]->set(params);
-  else
-    return "ERR\tComponent not found in SET command";
+
+  // Inputs can take configuration too
+  for (i = 0; panel->inputs[i]; i++)
+    if (strcasecmp(comp_name, panel->inputs[i]->id) == 0)
+      return panel->inputs[i]->set(params);
+
+  return "ERR\tComponent not found in SET command";
 }
 
 char* com_prot_get(Panel* panel, char* args) {
@@ -1499,4 +7060,222 @@ char* com_prot_get(Panel* panel, char* args) {
   return "ACK";
 }
 
+#ifdef HIST_SUPPORT
+// Report the last n samples (all by default) of each history an input
+// keeps, oldest first, as seconds ago and value. Each history ends
+// with the count, min, max and mean of the samples reported.
+char* com_prot_hist(Panel* panel, char* args) {
+  uint8_t i;
+  uint8_t j;
+  uint8_t n;
+  uint8_t skip;
+  uint32_t dt;
+  int16_t value;
+  int16_t lo;
+  int16_t hi;
+  int32_t sum;
+  uint32_t age;
+  char* comp_name = NULL;
+  char* count_str = NULL;
+  char* params = NULL;
+  InputComponent* comp = NULL;
+  History* hist;
+
+  comp_name = args ? pop_token(args, &params) : NULL;
+  if (!comp_name)
+    return "ERR\tComponent name not found in HIST command";
+  count_str = params ? pop_token(params, NULL) : NULL;
+
+  for (i = 0; panel->inputs[i]; i++)
+    if (strcasecmp(comp_name, panel->inputs[i]->id) == 0)
+      comp = panel->inputs[i];
+
+  if (!comp)
+    return "ERR\tComponent not found in HIST command";
+
+  if (!comp->history(0))
+    return "ERR\tComponent doesn't keep a history";
+
+  for (i = 0; (hist = comp->history(i)); i++) {
+    n = hist->count();
+    if (count_str && atoi(count_str) > 0 && atoi(count_str) < n)
+      n = atoi(count_str);
+
+    if (!n) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\tSTATS\t0", comp->id, hist->name);
+      Serial.println(panel->buf);
+      Serial.flush();
+      continue;
+    }
+
+    skip = hist->count() - n;
+    age = hist->age() + hist->span(n);
+    lo = 0x7FFF;
+    hi = -0x7FFF - 1;
+    sum = 0;
+
+    hist->rewind();
+    for (j = 0; hist->next(&value, &dt); j++) {
+      if (j < skip)
+        continue;
+      if (j > skip)
+        age -= dt;
+
+      lo = min(lo, value);
+      hi = max(hi, value);
+      sum += value;
+
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\t%lu\t%d", comp->id, hist->name, age, value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "HIST\t%s\t%s\tSTATS\t%hhu\t%d\t%d\t%d",
+             comp->id, hist->name, n, lo, hi, (int16_t)(sum / n));
+    Serial.println(panel->buf);
+    Serial.flush();
+  }
+
+  return "ACK";
+}
+#endif
+
+#ifdef TWI_SUPPORT
+// Report I2C counters, or reset them with "TWI CLR"
+char* com_prot_twi(Panel* panel, char* args) {
+  char* opt = NULL;
+
+  if (args)
+    opt = pop_token(args, NULL);
+
+  if (opt && (strcasecmp(opt, "CLR") == 0)) {
+    noInterrupts();
+    TWI_STATS.txns = 0;
+    TWI_STATS.nacks = 0;
+    TWI_STATS.errors = 0;
+    TWI_STATS.timeouts = 0;
+    TWI_STATS.recoveries = 0;
+    interrupts();
+
+    return "ACK";
+  }
+
+  noInterrupts();
+  snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "TWI\t%lu\t%u\t%u\t%u\t%u",
+           TWI_STATS.txns, TWI_STATS.nacks, TWI_STATS.errors,
+           TWI_STATS.timeouts, TWI_STATS.recoveries);
+  interrupts();
+
+  Serial.println(panel->buf);
+  Serial.flush();
+  return "ACK";
+}
+#endif
+
+#ifdef DEBOUNCE_SUPPORT
+// Report bounce counts per debounced input, in the order they were
+// created. "BOUNCE CLR" resets them, "BOUNCE SET <input> <ms>"
+// changes the debounce time of an input.
+char* com_prot_bounce(Panel* panel, char* args) {
+  uint8_t i;
+  char* opt = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (opt && (strcasecmp(opt, "CLR") == 0)) {
+    DEBOUNCER.clear();
+    return "ACK";
+  }
+
+  if (opt && (strcasecmp(opt, "SET") == 0)) {
+    char* input_str;
+    char* ms_str;
+
+    input_str = params ? pop_token(params, &params) : NULL;
+    ms_str = params ? pop_token(params, NULL) : NULL;
+    if (!input_str || !ms_str)
+      return "ERR\tBOUNCE SET needs input and ms";
+
+    i = atoi(input_str);
+    if (i >= DEBOUNCER.count())
+      return "ERR\tBOUNCE SET input not found";
+
+    if (!DEBOUNCER.set_time(i, atoi(ms_str)))
+      return "ERR\tBOUNCE SET too many debounce times";
+
+    return "ACK";
+  }
+
+  snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "BOUNCE\t%lu", DEBOUNCER.bounces());
+  Serial.println(panel->buf);
+  Serial.flush();
+
+  for (i = 0; i < DEBOUNCER.count(); i++) {
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "BOUNCE\t%hhu\t%u", i, DEBOUNCER.bounces(i));
+    Serial.println(panel->buf);
+    Serial.flush();
+  }
+
+  return "ACK";
+}
+#endif
+
+#ifdef CONFIG_SUPPORT
+// "CONFIG LIST" (or just CONFIG) prints every stored key and value,
+// "CONFIG GET <key>" one of them, and "CONFIG SET <key> <value>"
+// stores a value without waiting for it to settle. Components read
+// theirs in setup(), so a SET reaches them on the next boot.
+char* com_prot_config(Panel* panel, char* args) {
+  uint8_t i;
+  int32_t value;
+  char* opt = NULL;
+  char* key = NULL;
+  char* value_str = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (!opt || (strcasecmp(opt, "LIST") == 0)) {
+    for (i = 0; i < CONFIG_COUNT; i++) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", CONFIG[i].key, CONFIG[i].value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    return "ACK";
+  }
+
+  key = params ? pop_token(params, &params) : NULL;
+
+  if (strcasecmp(opt, "GET") == 0) {
+    if (!key)
+      return "ERR\tCONFIG GET needs a key";
+
+    if (!config_get(key, &value))
+      return "ERR\tCONFIG key not found";
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", key, value);
+    Serial.println(panel->buf);
+    Serial.flush();
+    return "ACK";
+  }
+
+  if (strcasecmp(opt, "SET") == 0) {
+    value_str = params ? pop_token(params, NULL) : NULL;
+    if (!key || !value_str)
+      return "ERR\tCONFIG SET needs key and value";
+
+    if (!config_set(key, atol(value_str), true))
+      return "ERR\tCONFIG SET key too long or store full";
+
+    return "ACK";
+  }
+
+  return "ERR\tCONFIG wanted LIST, GET or SET";
+}
+#endif
+
 #endif
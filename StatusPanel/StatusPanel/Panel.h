@@ -233,6 +233,277 @@ private:
 
 
 
+//
+// CONFIG_SUPPORT
+// Small key/value store in EEPROM, for settings that should survive
+// a reboot. Values are read from a RAM cache, and writes are spread
+// over the whole area.
+//
+#ifdef CONFIG_SUPPORT
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+// EEPROM area, in 16 byte records, all of a 328P's 1KB by default
+#ifndef CONFIG_BASE
+#define CONFIG_BASE 0
+#endif
+#ifndef CONFIG_SLOTS
+#define CONFIG_SLOTS 64
+#endif
+
+// Keys kept, each takes 20 bytes of RAM
+#ifndef CONFIG_MAX
+#define CONFIG_MAX 8
+#endif
+
+// Milliseconds a changed value has to stay put before it's written,
+// so something like an encoder being spun costs one write, not dozens.
+// Each key settles on its own, so a busy one can't hold up the rest.
+#ifndef CONFIG_SETTLE_MS
+#define CONFIG_SETTLE_MS 5000
+#endif
+
+#if CONFIG_MAX >= CONFIG_SLOTS
+#error "CONFIG_SLOTS must be more than CONFIG_MAX"
+#endif
+
+#define CONFIG_KEY_LEN 9
+
+// Writes a record may fall behind before it's rewritten, well inside
+// the 32768 the sequence numbers can be compared over
+#define CONFIG_REFRESH 8192
+
+#define CONFIG_NIL 0xFF
+
+typedef struct config_record {
+  int32_t value;
+  uint16_t seq;
+  char key[CONFIG_KEY_LEN];  // NUL padded, not terminated when full
+  uint8_t crc;
+} config_record_t;
+
+typedef struct config_entry {
+  char key[CONFIG_KEY_LEN + 1];
+  int32_t value;
+  uint8_t slot;  // Record holding the value, CONFIG_NIL until written
+  bool dirty;
+  tick due;      // When a dirty value has settled
+} config_entry_t;
+
+/*
+ * Log structured store
+ *
+ * Every write is a whole new record, put in the next slot round the
+ * area that doesn't hold the current record of any key, so the cells
+ * wear evenly and a write cut short by a power loss (caught by the
+ * CRC) still leaves the previous value. The newest sequence number
+ * tells setup where writing left off, and which record of a key is
+ * current. A record skipped over for too long is rewritten, to keep
+ * the sequence numbers in range of each other.
+ */
+config_entry_t CONFIG[CONFIG_MAX];
+uint8_t CONFIG_COUNT = 0;
+uint8_t CONFIG_HEAD = 0;  // Next slot to try
+uint16_t CONFIG_SEQ = 0;
+
+int config_addr(uint8_t slot) {
+  return CONFIG_BASE + (slot * sizeof(config_record_t));
+}
+
+uint8_t config_crc(config_record_t* r) {
+  uint8_t* p = (uint8_t*)r;
+  uint8_t crc = 0;
+  uint8_t i;
+
+  for (i = 0; i < offsetof(config_record_t, crc); i++)
+    crc = _crc8_ccitt_update(crc, p[i]);
+
+  return crc;
+}
+
+bool config_read(uint8_t slot, config_record_t* r) {
+  EEPROM.get(config_addr(slot), *r);
+
+  // Erased cells read 0xFF
+  return (r->key[0] != '\0') && ((uint8_t)r->key[0] != 0xFF)
+         && (config_crc(r) == r->crc);
+}
+
+uint16_t config_seq(uint8_t slot) {
+  uint16_t seq;
+
+  EEPROM.get(config_addr(slot) + offsetof(config_record_t, seq), seq);
+  return seq;
+}
+
+uint8_t config_find(const char* key) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (strncmp(CONFIG[i].key, key, CONFIG_KEY_LEN) == 0)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+// Key whose current record is in slot
+uint8_t config_owner(uint8_t slot) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (CONFIG[i].slot == slot)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+uint8_t config_add(const char* key) {
+  config_entry_t* e;
+
+  if ((CONFIG_COUNT >= CONFIG_MAX) || (strlen(key) > CONFIG_KEY_LEN))
+    return CONFIG_NIL;
+
+  e = &CONFIG[CONFIG_COUNT];
+  memset(e, 0, sizeof(config_entry_t));
+  strncpy(e->key, key, CONFIG_KEY_LEN);
+  e->slot = CONFIG_NIL;
+
+  return CONFIG_COUNT++;
+}
+
+// Fill the cache, called by Panel::setup() before any component
+void config_setup() {
+  config_record_t r;
+  uint8_t newest = CONFIG_NIL;
+  uint8_t slot;
+  uint8_t i;
+
+  for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!config_read(slot, &r))
+      continue;
+
+    if ((newest == CONFIG_NIL) || ((int16_t)(r.seq - CONFIG_SEQ) > 0)) {
+      newest = slot;
+      CONFIG_SEQ = r.seq;
+    }
+
+    // Several records of a key, the newest is the one
+    i = config_find(r.key);
+    if (i == CONFIG_NIL) {
+      char key[CONFIG_KEY_LEN + 1];
+
+      memcpy(key, r.key, CONFIG_KEY_LEN);
+      key[CONFIG_KEY_LEN] = '\0';
+      i = config_add(key);
+      if (i == CONFIG_NIL)
+        continue;
+
+    } else if ((int16_t)(r.seq - config_seq(CONFIG[i].slot)) < 0) {
+      continue;
+    }
+
+    CONFIG[i].value = r.value;
+    CONFIG[i].slot = slot;
+  }
+
+  if (newest != CONFIG_NIL) {
+    CONFIG_HEAD = (newest + 1) % CONFIG_SLOTS;
+    CONFIG_SEQ++;
+  }
+}
+
+void config_write(uint8_t i) {
+  config_record_t r;
+  uint8_t* p = (uint8_t*)&r;
+  uint8_t slot;
+  uint8_t owner;
+  uint8_t b;
+  int addr;
+
+  // There's always a free slot, CONFIG_MAX is under CONFIG_SLOTS
+  for (;;) {
+    slot = CONFIG_HEAD;
+    CONFIG_HEAD = (CONFIG_HEAD + 1) % CONFIG_SLOTS;
+
+    owner = config_owner(slot);
+    if (owner == CONFIG_NIL)
+      break;
+
+    if ((uint16_t)(CONFIG_SEQ - config_seq(slot)) > CONFIG_REFRESH) {
+      CONFIG[owner].dirty = true;
+      CONFIG[owner].due = GLOBAL_TC;
+    }
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.seq = CONFIG_SEQ++;
+  strncpy(r.key, CONFIG[i].key, CONFIG_KEY_LEN);
+  r.value = CONFIG[i].value;
+  r.crc = config_crc(&r);
+
+  addr = config_addr(slot);
+  for (b = 0; b < sizeof(r); b++)
+    EEPROM.update(addr + b, p[b]);
+
+  CONFIG[i].slot = slot;
+  CONFIG[i].dirty = false;
+}
+
+// Write out one changed value that has settled. A record is 16
+// blocking EEPROM writes, about 55ms, so each loop() only pays for one.
+void config_flush() {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (CONFIG[i].dirty && is_tc_alert(CONFIG[i].due)) {
+      config_write(i);
+      return;
+    }
+  }
+}
+
+bool config_get(const char* key, int32_t* value) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL)
+    return false;
+
+  *value = CONFIG[i].value;
+  return true;
+}
+
+// False when the key is too long, or there's no room for it.
+// now skips the settle time, the value goes out on the next loop().
+bool config_set(const char* key, int32_t value, bool now = false) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL) {
+    i = config_add(key);
+    if (i == CONFIG_NIL)
+      return false;
+
+  } else if ((CONFIG[i].value == value) && !CONFIG[i].dirty) {
+    return true;
+  }
+
+  CONFIG[i].value = value;
+  CONFIG[i].dirty = true;
+  CONFIG[i].due = now ? GLOBAL_TC : get_tc_alert(CONFIG_SETTLE_MS);
+
+  return true;
+}
+
+#endif // #ifdef CONFIG_SUPPORT
+
+
 /*
  * Components
  */
@@ -283,6 +554,36 @@ public:
     this->id = id;
     this->type = type;
   }
+
+#ifdef CONFIG_SUPPORT
+  // Keep a value over a reboot, under the component's id, or
+  // "<id>.<n>" for one of several. Written once it has settled.
+  bool persist(int32_t value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_set(key, value);
+  }
+
+  // Value persisted before the last reboot, false if there isn't one
+  bool restore(int32_t* value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_get(key, value);
+  }
+
+private:
+  // False when the key would be too long
+  bool config_key(char* key, size_t len, int8_t n) {
+    int used;
+
+    if (n < 0)
+      used = snprintf(key, len, "%s", id);
+    else
+      used = snprintf(key, len, "%s.%d", id, n);
+
+    return used <= CONFIG_KEY_LEN;
+  }
+#endif
 };
 
 class InputComponent : public Component {
@@ -439,16 +740,225 @@ private:
 #define LCD_LINE2 0x88
 #define LCD_LINE3 0x98
 
-// #define SPI_SPEED (1000000UL)
-// Much more reliable at half speed!
-#define SPI_SPEED (500000UL)
+// Serial clock. 1MHz was unreliable when every character was its own
+// transaction, 500kHz has been solid on the StatusPanel. The controller
+// is rated to 2.5MHz at 5V, the limit is the wiring.
+#ifndef ST7920_SPI_SPEED
+#define ST7920_SPI_SPEED (500000UL)
+#endif
 
+// Each command or data write takes the controller 72us to execute
+#define ST7920_EXEC_US 72
+
+// A data byte is sent as two nibble bytes, so once streaming only the
+// part of the execution time not already covered by the wire is waited
+#define ST7920_WIRE_US ((16 * 1000000UL) / ST7920_SPI_SPEED)
+#if ST7920_WIRE_US < ST7920_EXEC_US
+#define ST7920_DATA_DELAY_US (ST7920_EXEC_US - ST7920_WIRE_US)
+#else
+#define ST7920_DATA_DELAY_US 0
+#endif
+
+
+// Text mode is 4 lines of 16 half-width characters, held in DDRAM order.
+// Each DDRAM address holds 2 characters, and 0x80-0x9F covers the
+// display as line 1, line 3, line 2, line 4.
+#define ST7920_COLS 16
+#define ST7920_ROWS 4
+#define ST7920_CELLS (ST7920_COLS * ST7920_ROWS)
+#define ST7920_WORDS (ST7920_CELLS / 2)
+
+// DDRAM has two more rows than are shown, 0xA0 and 0xB0, which are
+// scrolled into view for LOG. Scrolling is in pixel rows, 16 per row.
+#define ST7920_DDRAM_ROWS 4
+#define ST7920_ROW_WORDS 16
+#define ST7920_SCROLL_ROWS 64
+
+// No known DDRAM address, forces an address command on the next write
+#define ST7920_NO_CURSOR 0xFF
+
+// Microseconds a display may spend flushing its framebuffer per update(),
+// at least one cell is always sent so a repaint can't stall
+#ifndef DISPLAY_FLUSH_BUDGET_US
+#define DISPLAY_FLUSH_BUDGET_US 1000
+#endif
+
+#ifdef ST7920_GFX_SUPPORT
+
+// Graphics mode is 128x64 at 1bpp. GDRAM is 32 rows of 16 words, the
+// bottom half of the display being words 8-15 of rows 0-31.
+#define ST7920_GFX_WIDTH 128
+#define ST7920_GFX_HEIGHT 64
+#define ST7920_GFX_ROW_BYTES (ST7920_GFX_WIDTH / 8)
+#define ST7920_GFX_ROW_WORDS (ST7920_GFX_WIDTH / 16)
+
+// Pixel rows rendered at a time, must divide ST7920_GFX_HEIGHT. A Nano
+// can't spare the 1KB for a full framebuffer, so the screen is kept as a
+// list of drawing ops and rendered a band at a time. Boards with the RAM
+// can set this to ST7920_GFX_HEIGHT to render once per change.
+#ifndef ST7920_GFX_BAND_ROWS
+#define ST7920_GFX_BAND_ROWS 8
+#endif
+#define ST7920_GFX_BANDS (ST7920_GFX_HEIGHT / ST7920_GFX_BAND_ROWS)
+
+#ifndef ST7920_GFX_MAX_OPS
+#define ST7920_GFX_MAX_OPS 12
+#endif
+
+#ifndef ST7920_GFX_TEXT_MAX
+#define ST7920_GFX_TEXT_MAX 10
+#endif
+
+// Characters are 5x7 in a 6x8 cell
+#define ST7920_FONT_WIDTH 5
+#define ST7920_FONT_HEIGHT 7
+#define ST7920_FONT_CELL_WIDTH 6
+#define ST7920_FONT_CELL_HEIGHT 8
+#define ST7920_FONT_FIRST 0x20
+#define ST7920_FONT_LAST 0x7E
+
+// Column major, LSB at the top, for 0x20-0x7E
+const uint8_t ST7920_FONT[] PROGMEM = {
+  0x00, 0x00, 0x00, 0x00, 0x00,  // ' '
+  0x00, 0x00, 0x5F, 0x00, 0x00,  // !
+  0x00, 0x07, 0x00, 0x07, 0x00,  // "
+  0x14, 0x7F, 0x14, 0x7F, 0x14,  // #
+  0x24, 0x2A, 0x7F, 0x2A, 0x12,  // $
+  0x23, 0x13, 0x08, 0x64, 0x62,  // %
+  0x36, 0x49, 0x55, 0x22, 0x50,  // &
+  0x00, 0x05, 0x03, 0x00, 0x00,  // '
+  0x00, 0x1C, 0x22, 0x41, 0x00,  // (
+  0x00, 0x41, 0x22, 0x1C, 0x00,  // )
+  0x14, 0x08, 0x3E, 0x08, 0x14,  // *
+  0x08, 0x08, 0x3E, 0x08, 0x08,  // +
+  0x00, 0x50, 0x30, 0x00, 0x00,  // ,
+  0x08, 0x08, 0x08, 0x08, 0x08,  // -
+  0x00, 0x60, 0x60, 0x00, 0x00,  // .
+  0x20, 0x10, 0x08, 0x04, 0x02,  // /
+  0x3E, 0x51, 0x49, 0x45, 0x3E,  // 0
+  0x00, 0x42, 0x7F, 0x40, 0x00,  // 1
+  0x42, 0x61, 0x51, 0x49, 0x46,  // 2
+  0x21, 0x41, 0x45, 0x4B, 0x31,  // 3
+  0x18, 0x14, 0x12, 0x7F, 0x10,  // 4
+  0x27, 0x45, 0x45, 0x45, 0x39,  // 5
+  0x3C, 0x4A, 0x49, 0x49, 0x30,  // 6
+  0x01, 0x71, 0x09, 0x05, 0x03,  // 7
+  0x36, 0x49, 0x49, 0x49, 0x36,  // 8
+  0x06, 0x49, 0x49, 0x29, 0x1E,  // 9
+  0x00, 0x36, 0x36, 0x00, 0x00,  // :
+  0x00, 0x56, 0x36, 0x00, 0x00,  // ;
+  0x08, 0x14, 0x22, 0x41, 0x00,  // <
+  0x14, 0x14, 0x14, 0x14, 0x14,  // =
+  0x00, 0x41, 0x22, 0x14, 0x08,  // >
+  0x02, 0x01, 0x51, 0x09, 0x06,  // ?
+  0x32, 0x49, 0x79, 0x41, 0x3E,  // @
+  0x7E, 0x11, 0x11, 0x11, 0x7E,  // A
+  0x7F, 0x49, 0x49, 0x49, 0x36,  // B
+  0x3E, 0x41, 0x41, 0x41, 0x22,  // C
+  0x7F, 0x41, 0x41, 0x22, 0x1C,  // D
+  0x7F, 0x49, 0x49, 0x49, 0x41,  // E
+  0x7F, 0x09, 0x09, 0x09, 0x01,  // F
+  0x3E, 0x41, 0x49, 0x49, 0x7A,  // G
+  0x7F, 0x08, 0x08, 0x08, 0x7F,  // H
+  0x00, 0x41, 0x7F, 0x41, 0x00,  // I
+  0x20, 0x40, 0x41, 0x3F, 0x01,  // J
+  0x7F, 0x08, 0x14, 0x22, 0x41,  // K
+  0x7F, 0x40, 0x40, 0x40, 0x40,  // L
+  0x7F, 0x02, 0x0C, 0x02, 0x7F,  // M
+  0x7F, 0x04, 0x08, 0x10, 0x7F,  // N
+  0x3E, 0x41, 0x41, 0x41, 0x3E,  // O
+  0x7F, 0x09, 0x09, 0x09, 0x06,  // P
+  0x3E, 0x41, 0x51, 0x21, 0x5E,  // Q
+  0x7F, 0x09, 0x19, 0x29, 0x46,  // R
+  0x46, 0x49, 0x49, 0x49, 0x31,  // S
+  0x01, 0x01, 0x7F, 0x01, 0x01,  // T
+  0x3F, 0x40, 0x40, 0x40, 0x3F,  // U
+  0x1F, 0x20, 0x40, 0x20, 0x1F,  // V
+  0x3F, 0x40, 0x38, 0x40, 0x3F,  // W
+  0x63, 0x14, 0x08, 0x14, 0x63,  // X
+  0x07, 0x08, 0x70, 0x08, 0x07,  // Y
+  0x61, 0x51, 0x49, 0x45, 0x43,  // Z
+  0x00, 0x7F, 0x41, 0x41, 0x00,  // [
+  0x02, 0x04, 0x08, 0x10, 0x20,  // backslash
+  0x00, 0x41, 0x41, 0x7F, 0x00,  // ]
+  0x04, 0x02, 0x01, 0x02, 0x04,  // ^
+  0x40, 0x40, 0x40, 0x40, 0x40,  // _
+  0x00, 0x01, 0x02, 0x04, 0x00,  // `
+  0x20, 0x54, 0x54, 0x54, 0x78,  // a
+  0x7F, 0x48, 0x44, 0x44, 0x38,  // b
+  0x38, 0x44, 0x44, 0x44, 0x20,  // c
+  0x38, 0x44, 0x44, 0x48, 0x7F,  // d
+  0x38, 0x54, 0x54, 0x54, 0x18,  // e
+  0x08, 0x7E, 0x09, 0x01, 0x02,  // f
+  0x0C, 0x52, 0x52, 0x52, 0x3E,  // g
+  0x7F, 0x08, 0x04, 0x04, 0x78,  // h
+  0x00, 0x44, 0x7D, 0x40, 0x00,  // i
+  0x20, 0x40, 0x44, 0x3D, 0x00,  // j
+  0x7F, 0x10, 0x28, 0x44, 0x00,  // k
+  0x00, 0x41, 0x7F, 0x40, 0x00,  // l
+  0x7C, 0x04, 0x18, 0x04, 0x78,  // m
+  0x7C, 0x08, 0x04, 0x04, 0x78,  // n
+  0x38, 0x44, 0x44, 0x44, 0x38,  // o
+  0x7C, 0x14, 0x14, 0x14, 0x08,  // p
+  0x08, 0x14, 0x14, 0x18, 0x7C,  // q
+  0x7C, 0x08, 0x04, 0x04, 0x08,  // r
+  0x48, 0x54, 0x54, 0x54, 0x20,  // s
+  0x04, 0x3F, 0x44, 0x40, 0x20,  // t
+  0x3C, 0x40, 0x40, 0x20, 0x7C,  // u
+  0x1C, 0x20, 0x40, 0x20, 0x1C,  // v
+  0x3C, 0x40, 0x30, 0x40, 0x3C,  // w
+  0x44, 0x28, 0x10, 0x28, 0x44,  // x
+  0x0C, 0x50, 0x50, 0x50, 0x3C,  // y
+  0x44, 0x64, 0x54, 0x4C, 0x44,  // z
+  0x00, 0x08, 0x36, 0x41, 0x00,  // {
+  0x00, 0x00, 0x7F, 0x00, 0x00,  // |
+  0x00, 0x41, 0x36, 0x08, 0x00,  // }
+  0x08, 0x04, 0x08, 0x10, 0x08   // ~
+};
+
+enum ST7920GfxOp {
+  gfx_none,
+  gfx_text,
+  gfx_hline,
+  gfx_vline,
+  gfx_bar
+};
+
+// One retained drawing op, a and b are its width and height where it
+// has them, and c the bar fill in percent
+typedef struct st7920_gfx_op {
+  uint8_t op;
+  uint8_t x;
+  uint8_t y;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  char text[ST7920_GFX_TEXT_MAX + 1];
+} st7920_gfx_op_t;
+
+#endif // #ifdef ST7920_GFX_SUPPORT
 
 class ST7920Component : public OutputComponent {
 public:
   ST7920Component(char* id, uint8_t cs_pin)
     : OutputComponent(id, loglcd_type) {
       this->_cs_pin = cs_pin;
+      this->_cursor = ST7920_NO_CURSOR;
+      this->_dirty = false;
+      this->_log = false;
+      this->_log_full = false;
+      this->_log_busy = false;
+      this->_log_count = 0;
+      this->_log_shown = 0;
+      this->_log_top = 0;
+#ifdef ST7920_GFX_SUPPORT
+      this->_gfx = false;
+      this->_gfx_band = 0;
+      this->_gfx_rendered = false;
+      this->_gfx_pending = false;
+      memset(this->_ops, 0, sizeof(this->_ops));
+      memset(this->_gfx_dirty, 0, sizeof(this->_gfx_dirty));
+#endif
       // 12, // clock
       // 11, // data
       // 10, // CS
@@ -462,11 +972,48 @@ public:
     uint8_t lcd_pos;
     char* params;
     char* output;
+    bool sync = false;
+    bool clear;
 
     line_num = pop_token(args, &params);
     if (!line_num)
       return "ERR SET wanted line num";
 
+    // Writes are normally flushed from update(), SYNC sends them before
+    // returning for callers that need the display to be current
+    if(strcasecmp(line_num, "SYNC") == 0) 
+    {
+      sync = true;
+      line_num = params ? pop_token(params, &params) : NULL;
+      if (!line_num)
+        return "ERR SET wanted line num";
+    }
+
+#ifdef ST7920_GFX_SUPPORT
+    // Graphics mode drawing
+    if(strcasecmp(line_num, "GFX") == 0) 
+    {
+      output = setGfx(params);
+      if (output)
+        return output;
+
+      return queued(sync);
+    }
+#endif
+
+    // Append a line to the scrolling log
+    if(strcasecmp(line_num, "LOG") == 0) 
+    {
+#ifdef ST7920_GFX_SUPPORT
+      // Scrolling moves the graphics too
+      if (_gfx)
+        return "ERR SET LOG needs GFX OFF";
+#endif
+      appendLog(params);
+
+      return queued(sync);
+    }
+
     switch (line_num[0]) {
       case '1':
         lcd_pos = LCD_LINE0;
@@ -488,26 +1035,23 @@ public:
     if (!pos)
       return "ERR SET needs line pos after line num";
 
-    // Clear the entire line
-    if(strcasecmp(pos, "CLR") == 0) 
-    {
-      printTxt(lcd_pos, "                ");
-
-      return "ACK";
-    }
-
-    // Determine position (by 2) in the line
-    pos_num = atoi(pos);
+    // Determine position (by 2) in the line, CLR clears all of it
+    clear = (strcasecmp(pos, "CLR") == 0);
+    pos_num = clear ? 0 : atoi(pos);
     if (!((pos_num >= 0) && (pos_num < 16)))
       return "ERR SET line pos not between 0-15";
 
-    printTxt((lcd_pos + pos_num), output);
+    // Only a valid line write leaves LOG mode
+    if (_log)
+      endLog();
 
-    return "ACK";
+    printTxt((lcd_pos + pos_num), clear ? (char*)"                " : output);
+
+    return queued(sync);
   }
 
   void update() {
-    // We do nothing on update()
+    flush(DISPLAY_FLUSH_BUDGET_US);
   }
 
   void getMessage(char* buf) {
@@ -525,55 +1069,588 @@ public:
     sendCmd(LCD_ADDRINC);
     sendCmd(LCD_DISPLAYON);
 
-    // setGfxMode(true);
-
-    // Enable TEXT mode
+    // Enable TEXT mode, graphics are turned on with SET <lcd> GFX ONN
     sendCmd(LCD_EXTEND);
     sendCmd(LCD_TXTMODE);
 
+    // LCD_CLS fills DDRAM with spaces
+    memset(_buf, ' ', ST7920_CELLS);
+    memset(_shadow, ' ', ST7920_CELLS);
+    _cursor = ST7920_NO_CURSOR;
+    _dirty = false;
+
     return true;
   }
 
 private:
   uint8_t _cs_pin;
 
+  // What we want on the display, and what we last sent to it
+  char _buf[ST7920_CELLS];
+  char _shadow[ST7920_CELLS];
+  uint8_t _cursor; // DDRAM word the address counter points at
+  bool _dirty;
+
+  // LOG mode borrows _buf as a ring of the last ST7920_ROWS lines, and
+  // _shadow as the staging area for the DDRAM rows being written
+  bool _log;
+  bool _log_full;        // Next step repaints both rows, not just one
+  bool _log_busy;        // A step is staged and being sent
+  uint16_t _log_count;   // Lines appended
+  uint16_t _log_shown;   // Lines the display reflects
+  uint16_t _log_target;  // Lines the staged step reflects
+  uint8_t _log_top;      // DDRAM row at the top of the display
+  uint8_t _log_new_top;  // Where the staged step scrolls to
+  uint8_t _log_row;      // First DDRAM row the staged step writes
+  uint8_t _log_words;    // Words staged
+  uint8_t _log_sent;     // Words of the staged step sent
+
+  void appendLog(char* str) {
+    char* line = _buf + ((_log_count % ST7920_ROWS) * ST7920_COLS);
+    uint8_t i;
+
+    if (!_log) {
+      // The ring replaces whatever text was on the display
+      _log = true;
+      _log_full = true;
+      _log_busy = false;
+      memset(_buf, ' ', ST7920_CELLS);
+    }
+
+    for (i = 0; i < ST7920_COLS; i++)
+      line[i] = (str && *str && *str != '\r' && *str != '\n') ? *str++ : ' ';
+
+    _log_count++;
+  }
+
+  // Back to plain text, which starts from a blank screen
+  void endLog() {
+    _log = false;
+    _log_busy = false;
+    memset(_buf, ' ', ST7920_CELLS);
+    memset(_shadow, 0, ST7920_CELLS); // Force every word to be resent
+    _cursor = ST7920_NO_CURSOR;
+    _dirty = true;
+  }
+
+  // Copy visible lines left and right (0 being the oldest) into both
+  // halves of the staged DDRAM row out
+  void stageLogRow(uint8_t out, uint8_t left, uint8_t right) {
+    char* row = _shadow + (out * ST7920_COLS * 2);
+    int32_t line;
+
+    line = (int32_t)_log_count - ST7920_ROWS + left;
+    if (line >= 0)
+      memcpy(row, _buf + ((line % ST7920_ROWS) * ST7920_COLS), ST7920_COLS);
+    else
+      memset(row, ' ', ST7920_COLS);
+
+    line = (int32_t)_log_count - ST7920_ROWS + right;
+    if (line >= 0)
+      memcpy(row + ST7920_COLS, _buf + ((line % ST7920_ROWS) * ST7920_COLS), ST7920_COLS);
+    else
+      memset(row + ST7920_COLS, ' ', ST7920_COLS);
+  }
+
+  // Move the display to start at DDRAM row top
+  void setScroll(uint8_t top) {
+    sendCmd(LCD_EXTEND);
+    sendCmd(LCD_SCROLL);
+    sendCmd(LCD_SCROLLADDR | ((top * 16) % ST7920_SCROLL_ROWS));
+  }
+
+  // The display shows DDRAM rows top and top+1, with the left halves
+  // above the right halves, so visible lines 0-3 sit at
+  // L(top), L(top+1), R(top), R(top+1).
+  // An append writes L(top+2) = line 1 and R(top+2) = line 3 while
+  // that row is hidden, then scrolls down one row: one row of traffic.
+  // If appends outran the flush, both hidden rows are written and
+  // scrolled to instead.
+  // Returns false if budget_us ran out.
+  bool flushLog(uint32_t start, uint16_t budget_us) {
+    bool basic = false;
+
+    // Leaving LOG mode puts the scroll back for plain text
+    if (!_log) {
+      if (_log_top) {
+        setScroll(0);
+        _log_top = 0;
+      }
+      return true;
+    }
+
+    while (_log_busy || _log_shown != _log_count) {
+      if (!_log_busy) {
+        _log_row = (_log_top + 2) % ST7920_DDRAM_ROWS;
+        _log_target = _log_count;
+        _log_sent = 0;
+
+        if (_log_full || (uint16_t)(_log_count - _log_shown) > 1) {
+          stageLogRow(0, 0, 2);
+          stageLogRow(1, 1, 3);
+          _log_words = ST7920_ROW_WORDS * 2;
+          _log_new_top = _log_row;
+        } else {
+          stageLogRow(0, 1, 3);
+          _log_words = ST7920_ROW_WORDS;
+          _log_new_top = (_log_top + 1) % ST7920_DDRAM_ROWS;
+        }
+
+        _log_full = false;
+        _log_busy = true;
+      }
+
+      if (_log_sent < _log_words) {
+        if (!basic) {
+          sendCmd(LCD_BASIC);
+          basic = true;
+        }
+
+        // Half a row, one line, at a time
+        sendCmd(LCD_ADDR
+          + (((_log_row + (_log_sent / ST7920_ROW_WORDS)) % ST7920_DDRAM_ROWS) * ST7920_ROW_WORDS)
+          + (_log_sent % ST7920_ROW_WORDS));
+        sendData(_shadow + (_log_sent * 2), ST7920_COLS);
+        _log_sent += ST7920_COLS / 2;
+      } else {
+        setScroll(_log_new_top);
+        basic = false;
+        _log_top = _log_new_top;
+        _log_shown = _log_target;
+        _log_busy = false;
+      }
+
+      if (budget_us && (micros() - start) >= budget_us)
+        return false;
+    }
+
+    return true;
+  }
+
+#ifdef ST7920_GFX_SUPPORT
+  // Retained drawing ops, and the band they're rendered into
+  st7920_gfx_op_t _ops[ST7920_GFX_MAX_OPS];
+  uint8_t _band[ST7920_GFX_BAND_ROWS * ST7920_GFX_ROW_BYTES];
+  uint8_t _gfx_dirty[ST7920_GFX_HEIGHT]; // Bit per 16 pixel word of a row
+  uint8_t _gfx_band;     // Band the flush is working through
+  bool _gfx_rendered;    // _band holds _gfx_band's current pixels
+  bool _gfx_pending;     // Some of _gfx_dirty is set
+  bool _gfx;
+
+  // GFX ON|OFF|CLR, or GFX TEXT|HLINE|VLINE|BAR <x> <y> ...
+  // Returns NULL once the op is queued, or an error
+  char* setGfx(char* args) {
+    st7920_gfx_op_t op;
+    char* op_name;
+    uint8_t i;
+
+    op_name = args ? pop_token(args, &args) : NULL;
+    if (!op_name)
+      return "ERR SET GFX wanted ONN, OFF, CLR, TEXT, HLINE, VLINE or BAR";
+
+    if(strcasecmp(op_name, "ONN") == 0) {
+      // Blank the text layer, it's drawn over the graphics
+      if (_log)
+        endLog();
+      memset(_buf, ' ', ST7920_CELLS);
+      // RE and G can't change in the same instruction
+      sendCmd(LCD_EXTEND);
+      sendCmd(LCD_GFXMODE);
+      _gfx = true;
+      clearGfx();
+      return NULL;
+    }
+
+    if(strcasecmp(op_name, "OFF") == 0) {
+      sendCmd(LCD_TXTMODE);
+      _gfx = false;
+      memset(_ops, 0, sizeof(_ops));
+      memset(_gfx_dirty, 0, sizeof(_gfx_dirty));
+      _gfx_pending = false;
+      return NULL;
+    }
+
+    if (!_gfx)
+      return "ERR SET GFX is OFF";
+
+    if(strcasecmp(op_name, "CLR") == 0) {
+      clearGfx();
+      return NULL;
+    }
+
+    memset(&op, 0, sizeof(op));
+    if(strcasecmp(op_name, "TEXT") == 0)
+      op.op = gfx_text;
+    if(strcasecmp(op_name, "HLINE") == 0)
+      op.op = gfx_hline;
+    if(strcasecmp(op_name, "VLINE") == 0)
+      op.op = gfx_vline;
+    if(strcasecmp(op_name, "BAR") == 0)
+      op.op = gfx_bar;
+
+    if (op.op == gfx_none)
+      return "ERR SET GFX unknown op";
+
+    if (!popNum(&args, &op.x) || !popNum(&args, &op.y))
+      return "ERR SET GFX wanted x and y";
+
+    switch (op.op) {
+      case gfx_text:
+        for (i = 0; args && args[i] && args[i] != '\r' && args[i] != '\n' && i < ST7920_GFX_TEXT_MAX; i++)
+          op.text[i] = args[i];
+        op.text[i] = '\0';
+        break;
+      case gfx_hline:
+      case gfx_vline:
+        if (!popNum(&args, &op.a))
+          return "ERR SET GFX wanted length";
+        break;
+      case gfx_bar:
+        if (!popNum(&args, &op.a) || !popNum(&args, &op.b) || !popNum(&args, &op.c))
+          return "ERR SET GFX BAR wanted w h percent";
+        if (op.c > 100)
+          op.c = 100;
+        break;
+    }
+
+    return addOp(&op);
+  }
+
+  // Pop a number off args, false if there isn't one
+  bool popNum(char** args, uint8_t* num) {
+    char* token = *args ? pop_token(*args, args) : NULL;
+
+    if (!token)
+      return false;
+
+    *num = atoi(token);
+    return true;
+  }
+
+  // An op at the same place and of the same type replaces the old one,
+  // so values and labels can be updated in place
+  char* addOp(st7920_gfx_op_t* op) {
+    st7920_gfx_op_t* slot = NULL;
+    uint8_t i;
+
+    for (i = 0; i < ST7920_GFX_MAX_OPS; i++) {
+      if (_ops[i].op == op->op && _ops[i].x == op->x && _ops[i].y == op->y) {
+        slot = &_ops[i];
+        break;
+      }
+      if (!slot && _ops[i].op == gfx_none)
+        slot = &_ops[i];
+    }
+
+    if (!slot)
+      return "ERR SET GFX display list full";
+
+    if (slot->op != gfx_none)
+      markOp(slot);
+
+    memcpy(slot, op, sizeof(st7920_gfx_op_t));
+    markOp(slot);
+
+    return NULL;
+  }
+
+  void clearGfx() {
+    memset(_ops, 0, sizeof(_ops));
+    markDirty(0, 0, ST7920_GFX_WIDTH, ST7920_GFX_HEIGHT);
+  }
+
+  void markOp(st7920_gfx_op_t* op) {
+    switch (op->op) {
+      case gfx_text:
+        markDirty(op->x, op->y, strlen(op->text) * ST7920_FONT_CELL_WIDTH, ST7920_FONT_CELL_HEIGHT);
+        break;
+      case gfx_hline:
+        markDirty(op->x, op->y, op->a, 1);
+        break;
+      case gfx_vline:
+        markDirty(op->x, op->y, 1, op->a);
+        break;
+      case gfx_bar:
+        markDirty(op->x, op->y, op->a, op->b);
+        break;
+    }
+  }
+
+  // Flag the words covering a rectangle as needing a re-render and send
+  void markDirty(uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    uint8_t words = 0;
+    uint8_t x1;
+    uint8_t i;
+
+    if (!w || !h || x >= ST7920_GFX_WIDTH || y >= ST7920_GFX_HEIGHT)
+      return;
+
+    x1 = ((x + w) > ST7920_GFX_WIDTH) ? ST7920_GFX_WIDTH : (x + w);
+    for (i = x / 16; i <= (x1 - 1) / 16; i++)
+      words |= _BV(i);
+
+    for (i = y; i < (y + h) && i < ST7920_GFX_HEIGHT; i++)
+      _gfx_dirty[i] |= words;
+
+    _gfx_rendered = false;
+    _gfx_pending = true;
+  }
+
+  // Fill a rectangle, clipped to the band starting at row top
+  void fillRect(uint8_t top, uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    uint8_t row;
+    uint8_t col;
+
+    for (row = y; row < (y + h) && row < ST7920_GFX_HEIGHT; row++) {
+      if (row < top || row >= (top + ST7920_GFX_BAND_ROWS))
+        continue;
+
+      for (col = x; col < (x + w) && col < ST7920_GFX_WIDTH; col++)
+        _band[((row - top) * ST7920_GFX_ROW_BYTES) + (col / 8)] |= (0x80 >> (col & 7));
+    }
+  }
+
+  void renderText(uint8_t top, st7920_gfx_op_t* op) {
+    uint8_t row;
+    uint8_t col;
+    uint8_t x;
+    uint8_t bits;
+    char* c;
+
+    for (row = 0; row < ST7920_FONT_HEIGHT; row++) {
+      if ((op->y + row) < top || (op->y + row) >= (top + ST7920_GFX_BAND_ROWS))
+        continue;
+
+      x = op->x;
+      for (c = op->text; *c; c++, x += ST7920_FONT_CELL_WIDTH - ST7920_FONT_WIDTH) {
+        for (col = 0; col < ST7920_FONT_WIDTH; col++, x++) {
+          if (*c < ST7920_FONT_FIRST || *c > ST7920_FONT_LAST)
+            continue;
+
+          bits = pgm_read_byte(&ST7920_FONT[((*c - ST7920_FONT_FIRST) * ST7920_FONT_WIDTH) + col]);
+          if (bits & _BV(row))
+            fillRect(top, x, op->y + row, 1, 1);
+        }
+      }
+    }
+  }
+
+  // Draw every op that touches the band starting at row top
+  void renderBand(uint8_t top) {
+    st7920_gfx_op_t* op;
+    uint8_t fill;
+    uint8_t i;
+
+    memset(_band, 0, sizeof(_band));
+
+    for (i = 0; i < ST7920_GFX_MAX_OPS; i++) {
+      op = &_ops[i];
+      switch (op->op) {
+        case gfx_text:
+          renderText(top, op);
+          break;
+        case gfx_hline:
+          fillRect(top, op->x, op->y, op->a, 1);
+          break;
+        case gfx_vline:
+          fillRect(top, op->x, op->y, 1, op->a);
+          break;
+        case gfx_bar:
+          // Outline, then fill from the left
+          fillRect(top, op->x, op->y, op->a, 1);
+          fillRect(top, op->x, op->y + op->b - 1, op->a, 1);
+          fillRect(top, op->x, op->y, 1, op->b);
+          fillRect(top, op->x + op->a - 1, op->y, 1, op->b);
+          if (op->a > 2 && op->b > 2) {
+            fill = ((uint16_t)(op->a - 2) * op->c) / 100;
+            fillRect(top, op->x + 1, op->y + 1, fill, op->b - 2);
+          }
+          break;
+      }
+    }
+  }
+
+  // Render each band holding dirty words and send just those words,
+  // resuming where the last call ran out of budget.
+  // Returns false if budget_us ran out.
+  bool flushGfx(uint32_t start, uint16_t budget_us) {
+    bool extended = false;
+    uint8_t* dirty;
+    uint8_t top;
+    uint8_t row;
+    uint8_t w;
+    uint8_t end;
+
+    if (!_gfx_pending)
+      return true;
+
+    for (; _gfx_band < ST7920_GFX_BANDS; _gfx_band++, _gfx_rendered = false) {
+      top = _gfx_band * ST7920_GFX_BAND_ROWS;
+
+      for (row = top; row < (top + ST7920_GFX_BAND_ROWS); row++) {
+        dirty = &_gfx_dirty[row];
+
+        while (*dirty) {
+          if (!_gfx_rendered) {
+            renderBand(top);
+            _gfx_rendered = true;
+          }
+
+          for (w = 0; !(*dirty & _BV(w)); w++);
+          for (end = w + 1; end < ST7920_GFX_ROW_WORDS && (*dirty & _BV(end)); end++);
+
+          // GDRAM is addressed in the extended instruction set
+          if (!extended) {
+            sendCmd(LCD_EXTEND);
+            sendCmd(LCD_GFXMODE);
+            extended = true;
+          }
+
+          sendCmd(LCD_ADDR | (row % 32));
+          sendCmd(LCD_ADDR | ((row / 32) * ST7920_GFX_ROW_WORDS + w));
+          sendData((char*)&_band[((row - top) * ST7920_GFX_ROW_BYTES) + (w * 2)], (end - w) * 2);
+
+          for (; w < end; w++)
+            *dirty &= ~_BV(w);
+
+          if (budget_us && (micros() - start) >= budget_us)
+            return false;
+        }
+      }
+    }
+
+    // Ops added during the pass may have dirtied bands already done
+    _gfx_band = 0;
+    _gfx_pending = false;
+    for (row = 0; row < ST7920_GFX_HEIGHT; row++)
+      if (_gfx_dirty[row])
+        _gfx_pending = true;
+
+    return true;
+  }
+#endif // #ifdef ST7920_GFX_SUPPORT
+
   void sendCmd(byte b) {
-    SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE3));
+    SPI.beginTransaction(SPISettings(ST7920_SPI_SPEED, MSBFIRST, SPI_MODE3));
     digitalWrite(_cs_pin, HIGH);
     SPI.transfer(0xF8);
     SPI.transfer(b & 0xF0);
     SPI.transfer(b << 4);
+    delayMicroseconds(ST7920_DATA_DELAY_US);
     digitalWrite(_cs_pin, LOW);
     SPI.endTransaction();
   }
   // ----------------------------------------------------------------
 
-  void sendData(byte b) {
-    SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE3));
+  // Stream a run of data bytes in one transaction, the ST7920 keeps
+  // taking data after a single sync byte
+  void sendData(char* data, uint8_t len) {
+    SPI.beginTransaction(SPISettings(ST7920_SPI_SPEED, MSBFIRST, SPI_MODE3));
     digitalWrite(_cs_pin, HIGH);
     SPI.transfer(0xFA);
-    SPI.transfer(b & 0xF0);
-    SPI.transfer(b << 4);
+    while (len--) {
+      SPI.transfer(*data & 0xF0);
+      SPI.transfer(*data << 4);
+      data++;
+      delayMicroseconds(ST7920_DATA_DELAY_US);
+    }
     digitalWrite(_cs_pin, LOW);
     SPI.endTransaction();
   }
 
+  // Copy str into the framebuffer from DDRAM address pos
   void printTxt(uint8_t pos, char* str) {
-    sendCmd(LCD_BASIC);
-    sendCmd(pos);
-    while (*str) sendData(*str++);
+    uint8_t i = (pos - LCD_ADDR) * 2;
+
+    while (*str && *str != '\r' && *str != '\n' && i < ST7920_CELLS)
+      _buf[i++] = *str++;
   }
 
   // For supporting non-ASCII characters
   void printTxt(uint8_t pos, uint16_t* signs) {
-    sendCmd(LCD_BASIC);
-    sendCmd(pos);
-    while (*signs) {
-      sendData(*signs >> 8);
-      sendData(*signs & 0xff);
+    uint8_t i = (pos - LCD_ADDR) * 2;
+
+    while (*signs && i < ST7920_CELLS) {
+      _buf[i++] = *signs >> 8;
+      _buf[i++] = *signs & 0xff;
       signs++;
     }
   }
+
+  // Mark the framebuffer for flushing, or flush it now if sync
+  char* queued(bool sync) {
+    _dirty = true;
+    if (sync)
+      flush(0);
+
+    return "ACK";
+  }
+
+  bool isDirtyWord(uint8_t w) {
+    return (_buf[w * 2] != _shadow[w * 2])
+      || (_buf[(w * 2) + 1] != _shadow[(w * 2) + 1]);
+  }
+
+  // Send what changed in the text and graphics layers.
+  // Stops once budget_us is spent, the rest goes out on a later update(),
+  // a budget_us of 0 flushes everything.
+  void flush(uint16_t budget_us) {
+    uint32_t start = micros();
+
+    if (!flushLog(start, budget_us))
+      return;
+
+    if (!_log && !flushText(start, budget_us))
+      return;
+
+#ifdef ST7920_GFX_SUPPORT
+    flushGfx(start, budget_us);
+#endif
+  }
+
+  // Send only the DDRAM words that differ from what is on the display,
+  // each run of dirty words (up to a line) is one address command and
+  // one streamed transaction.
+  // Returns false if budget_us ran out.
+  bool flushText(uint32_t start, uint16_t budget_us) {
+    bool basic = false;
+    uint8_t w;
+    uint8_t end;
+
+    if (!_dirty)
+      return true;
+
+    for (w = 0; w < ST7920_WORDS; w = end) {
+      if (!isDirtyWord(w)) {
+        end = w + 1;
+        continue;
+      }
+
+      // Find the end of the run, capped to a line to bound a single burst
+      for (end = w + 1; end < ST7920_WORDS && (end - w) < (ST7920_COLS / 2); end++)
+        if (!isDirtyWord(end))
+          break;
+
+      // setup() leaves us in the extended instruction set
+      if (!basic) {
+        sendCmd(LCD_BASIC);
+        basic = true;
+      }
+
+      if (_cursor != w)
+        sendCmd(LCD_ADDR + w);
+
+      sendData(_buf + (w * 2), (end - w) * 2);
+      memcpy(_shadow + (w * 2), _buf + (w * 2), (end - w) * 2);
+      _cursor = (end < ST7920_WORDS) ? end : ST7920_NO_CURSOR;
+
+      if (budget_us && (micros() - start) >= budget_us)
+        return false;
+    }
+
+    _dirty = false;
+    return true;
+  }
 };
 
 #endif
@@ -780,6 +1857,10 @@ public:
         _counter--;
         _dir = "LEFT";
       }
+
+#ifdef CONFIG_SUPPORT
+      persist(_counter);
+#endif
     }
     _lastStateCLK = _currentStateCLK;
 
@@ -791,6 +1872,13 @@ public:
   }
 
   bool setup() {
+#ifdef CONFIG_SUPPORT
+    int32_t counter;
+
+    if (restore(&counter))
+      _counter = counter;
+#endif
+
     _clk->setup();
     _dt->setup();
 
@@ -946,6 +2034,11 @@ public:
   bool setup() {
     int i;
 
+#ifdef CONFIG_SUPPORT
+    // Components restore their settings in setup()
+    config_setup();
+#endif
+
     for (i = 0; inputs[i]; i++)
       if (!inputs[i]->setup())
         return false;
@@ -976,6 +2069,9 @@ char* com_prot_desc(Panel*, char*);
 char* com_prot_ping(Panel*, char*);
 char* com_prot_set(Panel*, char*);
 char* com_prot_get(Panel*, char*);
+#ifdef CONFIG_SUPPORT
+char* com_prot_config(Panel*, char*);
+#endif
 
 /* List of commands */
 cmd_t command[] = {
@@ -984,6 +2080,9 @@ cmd_t command[] = {
   { "DESC", com_prot_desc },
   { "SET", com_prot_set },
   { "GET", com_prot_get },
+#ifdef CONFIG_SUPPORT
+  { "CONFIG", com_prot_config },
+#endif
   { 0 }
 };
 
@@ -1039,6 +2138,11 @@ bool Panel::loop() {
   for (i = 0; outputs[i]; i++)
     outputs[i]->update();
 
+#ifdef CONFIG_SUPPORT
+  // Write out settings that have stopped changing
+  config_flush();
+#endif
+
   // Check Serial
   if (Serial.available() > 0) {
     char* cmd;
@@ -1128,4 +2232,60 @@ char* com_prot_get(Panel* panel, char* args) {
   return "ACK";
 }
 
+#ifdef CONFIG_SUPPORT
+// "CONFIG LIST" (or just CONFIG) prints every stored key and value,
+// "CONFIG GET <key>" one of them, and "CONFIG SET <key> <value>"
+// stores a value without waiting for it to settle. Components read
+// theirs in setup(), so a SET reaches them on the next boot.
+char* com_prot_config(Panel* panel, char* args) {
+  uint8_t i;
+  int32_t value;
+  char* opt = NULL;
+  char* key = NULL;
+  char* value_str = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (!opt || (strcasecmp(opt, "LIST") == 0)) {
+    for (i = 0; i < CONFIG_COUNT; i++) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", CONFIG[i].key, CONFIG[i].value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    return "ACK";
+  }
+
+  key = params ? pop_token(params, &params) : NULL;
+
+  if (strcasecmp(opt, "GET") == 0) {
+    if (!key)
+      return "ERR\tCONFIG GET needs a key";
+
+    if (!config_get(key, &value))
+      return "ERR\tCONFIG key not found";
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", key, value);
+    Serial.println(panel->buf);
+    Serial.flush();
+    return "ACK";
+  }
+
+  if (strcasecmp(opt, "SET") == 0) {
+    value_str = params ? pop_token(params, NULL) : NULL;
+    if (!key || !value_str)
+      return "ERR\tCONFIG SET needs key and value";
+
+    if (!config_set(key, atol(value_str), true))
+      return "ERR\tCONFIG SET key too long or store full";
+
+    return "ACK";
+  }
+
+  return "ERR\tCONFIG wanted LIST, GET or SET";
+}
+#endif
+
 #endif
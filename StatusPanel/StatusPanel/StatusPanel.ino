@@ -1,5 +1,7 @@
 #define ST7920_SUPPORT
+#define ST7920_GFX_SUPPORT
 #define PCF8575_SUPPORT
+#define CONFIG_SUPPORT // Keeps the dial counter over a reboot
 #include "Panel.h"
 
 
@@ -375,6 +375,7 @@ enum ComponentType {
   rtc_type,
   alarm_type,
   rgbled_type,
+  buzzer_type,
   loglcd_type,
   panel_type
 };
@@ -405,6 +406,8 @@ char* getCTypeName(ComponentType type) {
       return "ALARM";
     case rgbled_type:
       return "RGBLED";
+    case buzzer_type:
+      return "BUZZ";
     case loglcd_type:
       return "LOGLCD";
     case panel_type:
@@ -442,6 +445,12 @@ public:
   // Is called every iteration of loop()
   // if returns true, getMessage() is returned as an EVENT
   virtual bool poll() = 0;
+
+  // Optional runtime configuration, used by SET when
+  // no OutputComponent has a matching id
+  virtual char* set(char* args) {
+    return "ERR\tComponent doesn't support SET";
+  }
 };
 
 class OutputComponent : public Component {
@@ -654,15 +663,66 @@ private:
 
 //
 // DS3231_SUPPORT
+// Time is kept in software and only read from the chip now and then.
+// With the chip's 1Hz square wave wired to an interrupt pin the
+// seconds are counted in the ISR, otherwise millis() carries the
+// clock between reads.
 //
 #ifdef DS3231_SUPPORT
+#ifdef TWI_SUPPORT
+#error "TWI_SUPPORT replaces Wire, which DS3231_SUPPORT depends on"
+#endif
 #include <DS3231M.h>
 
+#define DS3231_NO_SQW 0xFF
+
+// How often the software clock is checked against the chip
+#ifndef DS3231_RESYNC_MS
+#define DS3231_RESYNC_MS 600000UL
+#endif
+
+// Reads are only taken this soon after an edge, so they line up with it
+#define DS3231_SYNC_WINDOW_MS 100
+
+// No edge for this long means the square wave isn't there
+#define DS3231_SQW_LOST_MS 1500
+
+/*
+ * Software clock, seconds since the epoch as of the last 1Hz edge and
+ * the millis() it came at. Without the square wave RTC_EDGE_MS is the
+ * time of the last read from the chip instead.
+ */
+volatile uint32_t RTC_SECONDS = 0;
+volatile uint32_t RTC_EDGE_MS = 0;
+
+void rtc_sqw_edge() {
+  RTC_SECONDS++;
+  RTC_EDGE_MS = millis();
+}
+
+// Current time, whole seconds past the last edge are carried over for
+// when the square wave is missing
+uint32_t rtc_now(uint16_t* ms = NULL) {
+  uint32_t seconds;
+  uint32_t since;
+
+  noInterrupts();
+  seconds = RTC_SECONDS;
+  since = millis() - RTC_EDGE_MS;
+  interrupts();
+
+  if (ms)
+    *ms = since % 1000;
+
+  return seconds + (since / 1000);
+}
+
 class Ds3231Component : public OutputComponent {
 public:
-  Ds3231Component(char* id, uint8_t clock_pin, uint8_t data_pin)
+  Ds3231Component(char* id, uint8_t clock_pin, uint8_t data_pin, uint8_t sqw_pin = DS3231_NO_SQW)
     : OutputComponent(id, rtc_type) {
       this->_rtc = new DS3231M_Class();
+      this->_sqw_pin = sqw_pin;
   }
 
   char* set(char* args) {
@@ -681,15 +741,25 @@ public:
     DateTime new_time = DateTime(new_time_int);
     _rtc->adjust(new_time);
 
+    // Writing the seconds restarts the square wave, so start over
+    restart();
+
     return "ACK";
   }
 
   void update() {
-    // We do nothing on update()
+    if (!is_tc_alert(_resync))
+      return;
+
+    // Wait for the next edge to come by
+    if (sqw_running() && (millis() - RTC_EDGE_MS) > DS3231_SYNC_WINDOW_MS)
+      return;
+
+    sync(sqw_running());
   }
 
   void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), get_unixtime());
+    sprintf(buf, "%s\t%s\t%lu", id, getCTypeName(type), get_unixtime());
   }
 
   bool setup() {
@@ -709,29 +779,67 @@ public:
     DateTime now = _rtc->now();
     if(!now.hour() && !now.minute()) { // Only reset internal clock if we think it's wrong.
       // Change to compile time
-      _rtc.adjust();
+      _rtc->adjust();
     }
 
+    if (_sqw_pin != DS3231_NO_SQW && digitalPinToInterrupt(_sqw_pin) != NOT_AN_INTERRUPT) {
+      _rtc->pinSquareWave();
+      pinMode(_sqw_pin, INPUT_PULLUP);  // Open drain
+      attachInterrupt(digitalPinToInterrupt(_sqw_pin), rtc_sqw_edge, FALLING);
+    } else
+      _sqw_pin = DS3231_NO_SQW;
+
+    restart();
+
     return true;
   }
 
   // Return seconds since UNIX EPOCH
   uint32_t get_unixtime() {
-    return _rtc->now().unixtime();
+    return rtc_now();
   }
 
   // Return "clock time"
   // Ex. 16:01 -> 1601 as uint16_t
   uint16_t get_clock_time() {
-    DateTime now = _rtc->now();
+    DateTime now = DateTime(rtc_now());
     return (now.hour() * 100) + now.minute();
   }
 
 private:
   DS3231M_Class* _rtc;
+  uint8_t _sqw_pin;
+  tick _resync = 0;
+
+  // Load the chip's time into the software clock. on_edge keeps the
+  // edge time, otherwise the read becomes the new reference.
+  void sync(bool on_edge) {
+    uint32_t now = _rtc->now().unixtime();
+
+    noInterrupts();
+    RTC_SECONDS = now;
+    if (!on_edge)
+      RTC_EDGE_MS = millis();
+    interrupts();
+
+    _resync = get_tc_alert(DS3231_RESYNC_MS);
+  }
+
+  // Take the time whenever, then line it up with the square wave once
+  // an edge has come by
+  void restart() {
+    sync(false);
+
+    if (_sqw_pin != DS3231_NO_SQW)
+      _resync = get_tc_alert(DS3231_SQW_LOST_MS);
+  }
+
+  bool sqw_running() {
+    return _sqw_pin != DS3231_NO_SQW && (millis() - RTC_EDGE_MS) < DS3231_SQW_LOST_MS;
+  }
 };
 
-#endif // #ifdef DS3231
+#endif // #ifdef DS3231_SUPPORT
 
 
 //
@@ -874,23 +982,191 @@ private:
 // SSED_SUPPORT
 //
 #ifdef SSED_SUPPORT
+#include <SPI.h>
 #include <LedControl.h>
 
+// MAX7219 registers, digit n is MAX7219_REG_DIGIT0 + n
+#define MAX7219_REG_NOOP 0x00
+#define MAX7219_REG_DIGIT0 0x01
+#define MAX7219_REG_DECODE 0x09
+#define MAX7219_REG_INTENSITY 0x0A
+#define MAX7219_REG_SCANLIMIT 0x0B
+#define MAX7219_REG_SHUTDOWN 0x0C
+#define MAX7219_REG_TEST 0x0F
+
+#define MAX7219_DIGITS 8
+
+#ifndef MAX7219_MAX_CHAIN
+#define MAX7219_MAX_CHAIN 4
+#endif
+
+// The MAX7219 is good to 10MHz
+#ifndef MAX7219_SPI_SPEED
+#define MAX7219_SPI_SPEED 8000000UL
+#endif
+
+// Segments are DP A B C D E F G, MSB first, as LedControl uses
+#define SSED_SEG_BLANK 0x00
+#define SSED_SEG_MINUS 0x01
+
+const uint8_t SSED_HEX_SEGS[] PROGMEM = {
+  0x7E, 0x30, 0x6D, 0x79, 0x33, 0x5B, 0x5F, 0x70,  // 0-7
+  0x7F, 0x7B, 0x77, 0x1F, 0x0D, 0x3D, 0x4F, 0x47   // 8-9, A-F
+};
+
+// Segments for 0-15, '0'-'9', 'A'-'F', '-' or anything else as blank
+uint8_t ssed_coding(int8_t data) {
+  if (data >= 0 && data < 16)
+    return pgm_read_byte(&SSED_HEX_SEGS[data]);
+  if (data >= '0' && data <= '9')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - '0']);
+  if (data >= 'A' && data <= 'F')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - 'A' + 10]);
+  if (data >= 'a' && data <= 'f')
+    return pgm_read_byte(&SSED_HEX_SEGS[data - 'a' + 10]);
+  if (data == '-')
+    return SSED_SEG_MINUS;
+
+  return SSED_SEG_BLANK;
+}
+
+/*
+ * A chain of MAX7219s sharing CS on the hardware SPI pins, DIN of the
+ * first on MOSI (D11) and CLK on SCK (D13).
+ * Digits are staged with setDigit() and flush() sends each changed
+ * digit register as one burst down the whole chain, devices with
+ * nothing to change for that digit getting a no-op.
+ */
+class MyMax7219 {
+public:
+  MyMax7219(uint8_t cs_pin, uint8_t count) {
+    this->_cs_pin = cs_pin;
+    this->_count = (count > MAX7219_MAX_CHAIN) ? MAX7219_MAX_CHAIN : count;
+    this->_ready = false;
+  }
+
+  bool setup() {
+    uint8_t i;
+
+    // Shared by every display on the chain
+    if (_ready)
+      return true;
+
+    pinMode(_cs_pin, OUTPUT);
+    digitalWrite(_cs_pin, HIGH);
+    SPI.begin();
+
+    for (i = 0; i < _count; i++) {
+      write(i, MAX7219_REG_TEST, 0);
+      write(i, MAX7219_REG_SCANLIMIT, MAX7219_DIGITS - 1);
+      write(i, MAX7219_REG_DECODE, 0); // Raw segments
+      write(i, MAX7219_REG_SHUTDOWN, 1);
+    }
+
+    // Digit RAM is undefined at power up, blank all of it on first flush
+    memset(_digits, SSED_SEG_BLANK, sizeof(_digits));
+    memset(_dirty, (1 << _count) - 1, sizeof(_dirty));
+    _ready = true;
+
+    flush();
+
+    return true;
+  }
+
+  void setDigit(uint8_t device, uint8_t pos, uint8_t segs) {
+    if (device >= _count || pos >= MAX7219_DIGITS)
+      return;
+
+    if (_digits[device][pos] == segs)
+      return;
+
+    _digits[device][pos] = segs;
+    _dirty[pos] |= _BV(device);
+  }
+
+  // Register writes other than digits go out straight away
+  void write(uint8_t device, uint8_t reg, uint8_t value) {
+    int8_t i;
+
+    SPI.beginTransaction(SPISettings(MAX7219_SPI_SPEED, MSBFIRST, SPI_MODE0));
+    digitalWrite(_cs_pin, LOW);
+    // The last device in the chain is shifted out first
+    for (i = _count - 1; i >= 0; i--) {
+      SPI.transfer((i == device) ? reg : MAX7219_REG_NOOP);
+      SPI.transfer((i == device) ? value : 0);
+    }
+    digitalWrite(_cs_pin, HIGH);
+    SPI.endTransaction();
+  }
+
+  // Send every digit register that changed, one burst per register
+  void flush() {
+    uint8_t pos;
+    int8_t i;
+
+    if (!_ready)
+      return;
+
+    for (pos = 0; pos < MAX7219_DIGITS; pos++) {
+      if (!_dirty[pos])
+        continue;
+
+      SPI.beginTransaction(SPISettings(MAX7219_SPI_SPEED, MSBFIRST, SPI_MODE0));
+      digitalWrite(_cs_pin, LOW);
+      for (i = _count - 1; i >= 0; i--) {
+        if (_dirty[pos] & _BV(i)) {
+          SPI.transfer(MAX7219_REG_DIGIT0 + pos);
+          SPI.transfer(_digits[i][pos]);
+        } else {
+          SPI.transfer(MAX7219_REG_NOOP);
+          SPI.transfer(0);
+        }
+      }
+      digitalWrite(_cs_pin, HIGH);
+      SPI.endTransaction();
+
+      _dirty[pos] = 0;
+    }
+  }
+
+private:
+  uint8_t _cs_pin;
+  uint8_t _count;
+  bool _ready;
+  uint8_t _digits[MAX7219_MAX_CHAIN][MAX7219_DIGITS];
+  uint8_t _dirty[MAX7219_DIGITS]; // Bit per device, for each digit register
+};
+
 class SsedComponent : public OutputComponent {
 public:
+  // A display on its own pins, driven through LedControl
   SsedComponent(char* id, uint8_t clock_pin, uint8_t data_pin, uint8_t cs_pin)
     : OutputComponent(id, ssed_type) {
       this->_led = new LedControl(data_pin, clock_pin, cs_pin);
+      this->_chain = NULL;
+      this->_device = 0;
 
       // Init values
       this->_brightness = 1;
+      this->_valid = 0;
+  }
+
+  // Device number device on a chain of MAX7219s, 0 being nearest the MCU
+  SsedComponent(char* id, MyMax7219* chain, uint8_t device)
+    : OutputComponent(id, ssed_type) {
+      this->_led = NULL;
+      this->_chain = chain;
+      this->_device = device;
+
+      // Init values
+      this->_brightness = 1;
+      this->_valid = 0;
   }
 
   char* set(char* args) {
     char* line_num;
     char* pos;
     uint8_t pos_num;
-    int8_t pos_val;
     char* params;
     char* output;
 
@@ -901,7 +1177,8 @@ public:
     // Clear the entire screen
     if(strcasecmp(line_num, "CLR") == 0) 
     {
-      _lcd->clearDisplay();
+      for (pos_num = 0; pos_num < MAX7219_DIGITS; pos_num++)
+        display_segments(pos_num, SSED_SEG_BLANK);
 
       return "ACK";
     }
@@ -911,14 +1188,14 @@ public:
     {
       if(strcasecmp(params, "OFF") == 0) {
         _brightness = 0;
-        _lcd->setIntensity(0, _brightness);
+        apply_brightness();
 
         return "ACK";
       }
 
       if(strcasecmp(params, "ONN") == 0) {
         _brightness = 1;
-        _lcd->setIntensity(0, _brightness);
+        apply_brightness();
 
         return "ACK";
       }
@@ -928,7 +1205,7 @@ public:
           && (params[0] >= '0') 
           && (params[0] <= '7') ) {
         _brightness = params[0] - '0';
-        _lcd->setIntensity(0, _brightness);
+        apply_brightness();
       }else{
         return "ERR Valid LIGHT values are 0-7";
       }
@@ -936,6 +1213,18 @@ public:
       return "ACK";
     }
 
+    // Whole value, as display_digits() does
+    if(strcasecmp(line_num, "NUM") == 0) 
+    {
+      pos = params ? pop_token(params, &output) : NULL;
+      if (!pos)
+        return "ERR SET NUM wanted value";
+
+      display_digits(strtoul(pos, NULL, 10));
+
+      return "ACK";
+    }
+
     // Treat it as a one digit line number
     switch (line_num[0]) {
       case '1':
@@ -976,7 +1265,10 @@ public:
   }
 
   void update() {
-    // We do nothing on update()
+    // Changed digits on a chain go out together, whichever display
+    // on it gets here first
+    if (_chain)
+      _chain->flush();
   }
 
   void getMessage(char* buf) {
@@ -984,9 +1276,17 @@ public:
   }
 
   bool setup() {
-    _lcd->shutdown(0, false);
-    _lcd->setIntensity(0, _brightness);
-    _lcd->clearDisplay(0);
+    if (_chain) {
+      _chain->setup();
+    } else {
+      _led->shutdown(0, false);
+      _led->clearDisplay(0);
+    }
+    apply_brightness();
+
+    // Both start blanked
+    memset(_segs, SSED_SEG_BLANK, sizeof(_segs));
+    _valid = 0xFF;
 
     return true;
   }
@@ -994,26 +1294,264 @@ public:
   // Display a single character at a given position
   // Supports numbers and a limited number of characters
   void display_digit(uint8_t pos, int8_t data) {
-    _lcd->setDigit(0, pos, (byte)data, false);
+    display_segments(pos, ssed_coding(data));
   }
 
+  // Digits that haven't changed aren't resent, and there's no clear
+  // first, so a refresh doesn't flicker
   void display_digits(uint32_t num) {
     uint32_t disp_num = num;
-    _lcd->clearDisplay(0);
 
     for(int i=0; i<8; i++) {
-      _lcd->setDigit(0, i, (byte)(disp_num % 10), false);
+      display_digit(i, (disp_num % 10));
       disp_num = disp_num / 10;
     }
   }
 
+  void display_segments(uint8_t pos, uint8_t segs) {
+    if (pos >= MAX7219_DIGITS)
+      return;
+
+    if ((_valid & _BV(pos)) && _segs[pos] == segs)
+      return;
+
+    if (_chain)
+      _chain->setDigit(_device, pos, segs);
+    else
+      _led->setRow(0, pos, segs);
+
+    _segs[pos] = segs;
+    _valid |= _BV(pos);
+  }
+
 private:
-  LedControl* _lcd;
+  LedControl* _led;
+  MyMax7219* _chain;
+  uint8_t _device;
   uint8_t _brightness; // Value is 0-7
+  uint8_t _segs[MAX7219_DIGITS]; // Last segments written to each digit
+  uint8_t _valid; // Bit per digit that _segs is known for
+
+  void apply_brightness() {
+    if (_chain)
+      _chain->write(_device, MAX7219_REG_INTENSITY, _brightness);
+    else
+      _led->setIntensity(0, _brightness);
+  }
 };
 
 
-#endif // #ifdef SSFD_SUPPORT
+#endif // #ifdef SSED_SUPPORT
+
+
+//
+// BUZZER_SUPPORT
+// Pattern player for a buzzer on a direct pin. Timer1 belongs to the
+// player, so analogWrite() on pins 9 and 10 and the Servo library
+// can't be used alongside it.
+//
+#ifdef BUZZER_SUPPORT
+#include <avr/interrupt.h>
+
+// Step frequencies with a special meaning
+#define BUZZ_SILENT 0  // Pin low
+#define BUZZ_ON 1      // Pin high, for buzzers with their own oscillator
+#define BUZZ_MIN_HZ 31
+#define BUZZ_MAX_HZ 16000
+
+// A step with no duration ends the pattern, its frequency says how
+#define BUZZ_STOP 0
+#define BUZZ_REPEAT 1
+
+// Rate the timer runs at when it's only counting off a step
+#define BUZZ_TICK_HZ 1000
+
+#define BUZZ_NONE 0xFF
+
+typedef struct buzz_step {
+  uint16_t freq;  // Hz, or BUZZ_SILENT / BUZZ_ON
+  uint16_t ms;
+} buzz_step_t;
+
+const buzz_step_t BUZZ_STEPS[] PROGMEM = {
+  // 0: Silence
+  { BUZZ_STOP, 0 },
+  // 1: Single beep
+  { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 2: Two beeps
+  { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 }, { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 3: Three beeps
+  { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 }, { BUZZ_ON, 100 }, { BUZZ_SILENT, 100 },
+  { BUZZ_ON, 100 }, { BUZZ_STOP, 0 },
+  // 4: Alarm, four quick beeps then a pause, until stopped
+  { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 }, { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 },
+  { BUZZ_ON, 80 }, { BUZZ_SILENT, 80 }, { BUZZ_ON, 80 }, { BUZZ_SILENT, 600 },
+  { BUZZ_REPEAT, 0 },
+  // 5: Slow pulse, until stopped
+  { BUZZ_ON, 500 }, { BUZZ_SILENT, 500 }, { BUZZ_REPEAT, 0 },
+  // 6: Falling chime
+  { 1319, 150 }, { 988, 150 }, { 659, 300 }, { BUZZ_STOP, 0 },
+  // 7: Two tone siren, until stopped
+  { 880, 300 }, { 660, 300 }, { BUZZ_REPEAT, 0 }
+};
+
+// Index of each pattern's first step
+const uint8_t BUZZ_PATTERNS[] PROGMEM = { 0, 1, 3, 7, 13, 22, 25, 29 };
+#define BUZZ_PATTERN_COUNT (sizeof(BUZZ_PATTERNS) / sizeof(BUZZ_PATTERNS[0]))
+
+/*
+ * Pattern player
+ *
+ * Timer1 runs in CTC mode, interrupting at twice the tone frequency
+ * while a tone is playing (toggling the pin each time), or at
+ * BUZZ_TICK_HZ otherwise. Every interrupt counts down the current
+ * step, and the next step is loaded from the table in the ISR, so a
+ * pattern keeps its timing however long loop() takes.
+ */
+volatile uint8_t* BUZZ_PORT = NULL;
+uint8_t BUZZ_MASK = 0;
+volatile uint8_t BUZZ_PATTERN = BUZZ_NONE;
+uint8_t BUZZ_START = 0;
+uint8_t BUZZ_STEP = 0;
+bool BUZZ_TONE = false;
+uint16_t BUZZ_TICKS = 0;
+
+void buzz_stop() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+  BUZZ_TONE = false;
+  BUZZ_PATTERN = BUZZ_NONE;
+
+  if (BUZZ_PORT)
+    *BUZZ_PORT &= ~BUZZ_MASK;
+}
+
+// Load BUZZ_STEP into the timer, called from the ISR once running
+void buzz_load() {
+  uint16_t freq = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].freq);
+  uint16_t ms = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].ms);
+  uint16_t hz;
+  uint32_t ticks;
+
+  if (!ms) {
+    if (freq != BUZZ_REPEAT || BUZZ_STEP == BUZZ_START) {
+      buzz_stop();
+      return;
+    }
+
+    BUZZ_STEP = BUZZ_START;
+    freq = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].freq);
+    ms = pgm_read_word(&BUZZ_STEPS[BUZZ_STEP].ms);
+  }
+
+  BUZZ_TONE = (freq > BUZZ_ON);
+  hz = BUZZ_TONE ? (constrain(freq, BUZZ_MIN_HZ, BUZZ_MAX_HZ) * 2) : BUZZ_TICK_HZ;
+
+  if (freq == BUZZ_ON)
+    *BUZZ_PORT |= BUZZ_MASK;
+  else
+    *BUZZ_PORT &= ~BUZZ_MASK;
+
+  ticks = ((uint32_t)ms * hz) / 1000;
+  BUZZ_TICKS = ticks ? min(ticks, 0xFFFFUL) : 1;
+  OCR1A = (F_CPU / 8) / hz - 1;
+  BUZZ_STEP++;
+}
+
+void buzz_play(uint8_t pattern) {
+  buzz_stop();
+
+  BUZZ_START = pgm_read_byte(&BUZZ_PATTERNS[pattern]);
+  BUZZ_STEP = BUZZ_START;
+  BUZZ_PATTERN = pattern;
+
+  // CTC, clk/8
+  TCCR1A = 0;
+  TCNT1 = 0;
+  buzz_load();
+  if (BUZZ_PATTERN == BUZZ_NONE)
+    return;
+
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  TCCR1B = _BV(WGM12) | _BV(CS11);
+}
+
+ISR(TIMER1_COMPA_vect) {
+  if (BUZZ_TONE)
+    *BUZZ_PORT ^= BUZZ_MASK;
+
+  if (!--BUZZ_TICKS)
+    buzz_load();
+}
+
+
+class BuzzerComponent : public OutputComponent {
+public:
+  BuzzerComponent(char* id, uint8_t pin)
+    : OutputComponent(id, buzzer_type) {
+    this->_pin = pin;
+  }
+
+  // PATTERN <n>, or OFF
+  char* set(char* args) {
+    char* cmd;
+    char* params;
+    char* value;
+    int pattern;
+
+    cmd = pop_token(args, &params);
+    if (!cmd)
+      return "ERR BUZZ SET wanted PATTERN or OFF";
+
+    if (strcasecmp(cmd, "OFF") == 0) {
+      buzz_stop();
+      return "ACK";
+    }
+
+    if (strcasecmp(cmd, "PATTERN") == 0) {
+      value = params ? pop_token(params, NULL) : NULL;
+      if (!value)
+        return "ERR BUZZ PATTERN wanted a pattern number";
+
+      pattern = atoi(value);
+      if (pattern < 0 || pattern >= (int)BUZZ_PATTERN_COUNT)
+        return "ERR BUZZ PATTERN out of range";
+
+      buzz_play(pattern);
+      return "ACK";
+    }
+
+    return "ERR BUZZ SET wanted PATTERN or OFF";
+  }
+
+  // Patterns run from the timer interrupt
+  void update() {}
+
+  void getMessage(char* buf) {
+    uint8_t pattern = BUZZ_PATTERN;
+
+    if (pattern == BUZZ_NONE)
+      sprintf(buf, "%s\t%s\tOFF", id, getCTypeName(type));
+    else
+      sprintf(buf, "%s\t%s\tPATTERN\t%hhu", id, getCTypeName(type), pattern);
+  }
+
+  bool setup() {
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+
+    BUZZ_PORT = portOutputRegister(digitalPinToPort(_pin));
+    BUZZ_MASK = digitalPinToBitMask(_pin);
+
+    return true;
+  }
+
+private:
+  uint8_t _pin;
+};
+
+#endif // #ifdef BUZZER_SUPPORT
 //
 // LCD20X4_SUPPORT
 //
@@ -1637,64 +2175,318 @@ private:
 // Weird Component implementations
 // // // // // // // // // // // // // // // // // // // // // // // // 
 
-// Simple alarm
-// Is *BOTH* an InputComponent *AND* an OutputComponent
-// So must be added to both for Panel
 //
-class AlarmComponent : public InputComponent, public OutputComponent {
+// ALARM_SUPPORT
+// Any number of alarms (up to ALARM_MAX) on a hierarchical timer
+// wheel, each reported as an EVENT when it goes off.
+//
+#ifdef ALARM_SUPPORT
+
+#ifndef ALARM_MAX
+#define ALARM_MAX 8
+#endif
+
+// Wheel resolution
+#ifndef ALARM_TICK_MS
+#define ALARM_TICK_MS 100
+#endif
+
+// Levels of 32 slots, a slot on one level spans a whole turn of the
+// level below, so 4 levels reach 2^20 ticks (29 hours at 100ms).
+// Alarms further out sit on the top level and are placed again each
+// time it comes round.
+#define ALARM_WHEEL_BITS 5
+#define ALARM_WHEEL_SLOTS (1 << ALARM_WHEEL_BITS)
+#define ALARM_WHEEL_MASK (ALARM_WHEEL_SLOTS - 1)
+#define ALARM_LEVELS 4
+
+#define ALARM_NIL 0xFF
+
+typedef struct alarm_entry {
+  uint32_t expires;  // Wheel tick it goes off on
+  uint8_t id;        // Id given by the host, ALARM_NIL when free
+  uint8_t slot;      // Wheel slot it's listed in
+  uint8_t next;
+  uint8_t prev;
+} alarm_entry_t;
+
+/*
+ * Alarm scheduler
+ *
+ * Adding or removing an alarm is constant time, it's linked into the
+ * slot for its expiry on the lowest level that reaches it. Every tick
+ * only looks at one slot of the bottom level, and whenever a level
+ * completes a turn the next slot of the level above is spread back
+ * down, so the cost per tick doesn't grow with the number of alarms.
+ *
+ * SET <id> ADD <n> <ms>, or ADD <n> AT <unixtime> with DS3231_SUPPORT,
+ * SET <id> DEL <n>, SET <id> LIST
+ */
+class AlarmComponent : public InputComponent {
 public:
-  AlarmComponent(char* id, tick ts)
+  AlarmComponent(char* id)
     : InputComponent(id, alarm_type) {
       // Do nothing
   }
 
   bool poll() {
-    if(_ts)
-      return is_tc_alert(_ts);
+    uint8_t i;
 
-    return false;
+    _event = ALARM_NIL;
+
+    // Catch the wheel up with the clock
+    while ((GLOBAL_TC - _last) >= ALARM_TICK_MS) {
+      _last += ALARM_TICK_MS;
+      advance();
+    }
+
+    // Report one alarm per poll()
+    if (!_fired_count)
+      return false;
+
+    _event = _fired[0];
+    _fired_count--;
+    for (i = 0; i < _fired_count; i++)
+      _fired[i] = _fired[i + 1];
+
+    return true;
   }
 
   void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%lu", id, getCTypeName(type), _ts);
+    if (_event != ALARM_NIL)
+      sprintf(buf, "%s\t%s\tFIRE\t%hhu", id, getCTypeName(type), _event);
+    else
+      sprintf(buf, "%s\t%s\t%hhu", id, getCTypeName(type), _count);
   }
 
   char* set(char* args) {
-    char* new_time_str;
-    uint32_t new_time_int = 0;
+    char* cmd;
     char* params;
+    char* id_str;
+    char* value;
+    uint8_t n;
 
-    new_time_str = pop_token(args, &params);
-    if (!new_time_str)
-      return "ERR\tSET needs new time value (in secs)";
+    cmd = pop_token(args, &params);
+    if (!cmd)
+      return "ERR\tSET wanted ADD, DEL or LIST";
 
-    new_time_int = atol(new_time_str);
-    if(!new_time_int)
-      return "ERR\tcouldn't parse new time value to int";
-    
-    _ts = get_tc_alert(new_time_int);
+    if (strcasecmp(cmd, "LIST") == 0) {
+      list();
+      return "ACK";
+    }
 
-    return "ACK";
-  }
+    id_str = params ? pop_token(params, &params) : NULL;
+    if (!id_str || atoi(id_str) < 0 || atoi(id_str) >= ALARM_NIL)
+      return "ERR\tSET wanted an alarm id, 0-254";
+    n = atoi(id_str);
 
-  void update() {
-    // We do nothing on update()
+    if (strcasecmp(cmd, "DEL") == 0)
+      return remove(n) ? "ACK" : "ERR\tALARM DEL alarm not found";
+
+    if (strcasecmp(cmd, "ADD") != 0)
+      return "ERR\tSET wanted ADD, DEL or LIST";
+
+    value = params ? pop_token(params, &params) : NULL;
+    if (!value)
+      return "ERR\tALARM ADD wanted ms or AT <unixtime>";
+
+#ifdef DS3231_SUPPORT
+    if (strcasecmp(value, "AT") == 0) {
+      uint16_t ms;
+      uint32_t now = rtc_now(&ms);
+      uint32_t at;
+
+      value = params ? pop_token(params, NULL) : NULL;
+      at = value ? atol(value) : 0;
+      if (at <= now)
+        return "ERR\tALARM ADD AT is in the past";
+
+      // Out past about 49 days won't fit
+      if ((at - now) > 4000000UL)
+        return "ERR\tALARM ADD AT is too far off";
+
+      return add(n, ((at - now) * 1000) - ms) ? "ACK" : "ERR\tALARM ADD no free alarms";
+    }
+#endif
+
+    if (atol(value) <= 0)
+      return "ERR\tALARM ADD wanted a positive ms";
+
+    return add(n, atol(value)) ? "ACK" : "ERR\tALARM ADD no free alarms";
   }
 
   bool setup() {
-    _ts = 0;
+    uint8_t i;
+
+    for (i = 0; i < ALARM_MAX; i++)
+      _alarms[i].id = ALARM_NIL;
+    memset(_wheel, ALARM_NIL, sizeof(_wheel));
+
+    _last = GLOBAL_TC;
+    return true;
+  }
+
+  // Schedule alarm n to go off in ms, replacing any alarm n already set
+  bool add(uint8_t n, uint32_t ms) {
+    uint8_t e;
+
+    remove(n);
+
+    for (e = 0; e < ALARM_MAX; e++)
+      if (_alarms[e].id == ALARM_NIL)
+        break;
+
+    if (e >= ALARM_MAX)
+      return false;
+
+    // The next tick runs within ALARM_TICK_MS, count from when it would
+    _alarms[e].id = n;
+    _alarms[e].expires = _now + ((GLOBAL_TC - _last) + ms + ALARM_TICK_MS - 1) / ALARM_TICK_MS;
+    if (_alarms[e].expires != _now)
+      _alarms[e].expires--;
+
+    schedule(e);
+    _count++;
+
+    return true;
+  }
+
+  bool remove(uint8_t n) {
+    uint8_t e = find(n);
+
+    if (e == ALARM_NIL)
+      return false;
+
+    unlink(e);
+    _alarms[e].id = ALARM_NIL;
+    _count--;
 
     return true;
   }
 
   void set_alarm(uint32_t millis) {
-    _ts = get_tc_alert(millis);
+    add(0, millis);
   }
 
 private:
-  tick _ts;
+  alarm_entry_t _alarms[ALARM_MAX];
+  uint8_t _wheel[ALARM_LEVELS * ALARM_WHEEL_SLOTS];
+  uint32_t _now = 0;  // Next wheel tick to run
+  tick _last = 0;     // GLOBAL_TC that tick was due at
+  uint8_t _count = 0;
+  uint8_t _fired[ALARM_MAX];
+  uint8_t _fired_count = 0;
+  uint8_t _event = ALARM_NIL;
+
+  uint8_t find(uint8_t n) {
+    uint8_t e;
+
+    for (e = 0; e < ALARM_MAX; e++)
+      if (_alarms[e].id == n)
+        return e;
+
+    return ALARM_NIL;
+  }
+
+  void list() {
+    char buf[SERIAL_BUFFER_SIZE];
+    uint32_t left;
+    uint8_t e;
+
+    for (e = 0; e < ALARM_MAX; e++) {
+      if (_alarms[e].id == ALARM_NIL)
+        continue;
+
+      left = (_alarms[e].expires - _now + 1) * ALARM_TICK_MS - (GLOBAL_TC - _last);
+      snprintf(buf, (SERIAL_BUFFER_SIZE-3), "%s\t%hhu\t%lu", id, _alarms[e].id, left);
+      Serial.println(buf);
+      Serial.flush();
+    }
+  }
+
+  // Link an alarm into the lowest level that reaches its expiry
+  void schedule(uint8_t e) {
+    alarm_entry_t* a = &_alarms[e];
+    uint32_t delta = a->expires - _now;
+    uint8_t level;
+    uint8_t slot;
+
+    for (level = 0; level < ALARM_LEVELS - 1; level++)
+      if (delta < (1UL << ((level + 1) * ALARM_WHEEL_BITS)))
+        break;
+
+    slot = (level * ALARM_WHEEL_SLOTS) + ((a->expires >> (level * ALARM_WHEEL_BITS)) & ALARM_WHEEL_MASK);
+
+    a->slot = slot;
+    a->prev = ALARM_NIL;
+    a->next = _wheel[slot];
+    if (a->next != ALARM_NIL)
+      _alarms[a->next].prev = e;
+    _wheel[slot] = e;
+  }
+
+  void unlink(uint8_t e) {
+    alarm_entry_t* a = &_alarms[e];
+
+    if (a->prev != ALARM_NIL)
+      _alarms[a->prev].next = a->next;
+    else
+      _wheel[a->slot] = a->next;
+
+    if (a->next != ALARM_NIL)
+      _alarms[a->next].prev = a->prev;
+  }
+
+  // Spread a slot of an upper level back down, returns the slot index
+  uint8_t cascade(uint8_t level) {
+    uint8_t index = (_now >> (level * ALARM_WHEEL_BITS)) & ALARM_WHEEL_MASK;
+    uint8_t slot = (level * ALARM_WHEEL_SLOTS) + index;
+    uint8_t e = _wheel[slot];
+    uint8_t next;
+
+    _wheel[slot] = ALARM_NIL;
+    for (; e != ALARM_NIL; e = next) {
+      next = _alarms[e].next;
+      schedule(e);
+    }
+
+    return index;
+  }
+
+  void advance() {
+    uint8_t index = _now & ALARM_WHEEL_MASK;
+    uint8_t level;
+    uint8_t e;
+    uint8_t next;
+
+    if (!index)
+      for (level = 1; level < ALARM_LEVELS; level++)
+        if (cascade(level))
+          break;
+
+    e = _wheel[index];
+    _wheel[index] = ALARM_NIL;
+    for (; e != ALARM_NIL; e = next) {
+      next = _alarms[e].next;
+
+      // Never go off early
+      if (_alarms[e].expires != _now) {
+        schedule(e);
+        continue;
+      }
+
+      if (_fired_count < ALARM_MAX)
+        _fired[_fired_count++] = _alarms[e].id;
+      _alarms[e].id = ALARM_NIL;
+      _count--;
+    }
+
+    _now++;
+  }
 };
 
+#endif // #ifdef ALARM_SUPPORT
+
 
 
 // // // // // // // // // // // // // // // // // // // // // // // // 
@@ -1902,8 +2694,13 @@ char* com_prot_set(Panel* panel, char* args) {
 
   if (panel->outputs[i])
     return panel->outputs[i]->set(params);
-  else
-    return "ERR\tComponent not found in SET command";
+
+  // Inputs can take configuration too
+  for (i = 0; panel->inputs[i]; i++)
+    if (strcasecmp(comp_name, panel->inputs[i]->id) == 0)
+      return panel->inputs[i]->set(params);
+
+  return "ERR\tComponent not found in SET command";
 }
 
 char* com_prot_get(Panel* panel, char* args) {
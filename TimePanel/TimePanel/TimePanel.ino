@@ -130,6 +130,13 @@ LedControl ssed[] = {
 // LedControl ssed[2]=LedControl(PIN_SSED3_DIN, PIN_SSED3_CLK, PIN_SSED3_CS, 1);
 TM1637 ssfd_now(PIN_SSD_CLK, PIN_SSFD_NOW);
 DS3231M_Class rtc;
+
+// Time is only read from the RTC every RTC_RESYNC_MS, millis() carries
+// it in between. There's no interrupt pin left for the 1Hz SQW output.
+#define RTC_RESYNC_MS 600000UL
+uint32_t rtc_seconds = 0;
+unsigned long rtc_synced = 0;
+bool rtc_valid = false;
 Adafruit_MCP23017 mcp;
 
 
@@ -152,16 +159,34 @@ void debug(String s) {
 //
 // Display Functions
 //
-void ssed_display(LedControl lc, int lc_id,  unsigned long num) {
+// Last digit written to each SSED position, so a refresh only sends
+// the digits that changed, and never needs to clear first (flicker)
+#define SSED_DIGIT_BLANK -1
+int8_t ssed_digits[SSED_DISPLAY_COUNT][8];
+
+void ssed_display(int display_id, unsigned long num) {
   unsigned long disp_num = num;
-  lc.clearDisplay(lc_id);
 
    for(int i=0; i<8; i++) {
-     lc.setDigit(lc_id, i, (byte)(disp_num % 10), false);
+     int8_t digit = disp_num % 10;
+
+     if(ssed_digits[display_id][i] != digit) {
+       ssed[display_id].setDigit(0, i, (byte)digit, false);
+       ssed_digits[display_id][i] = digit;
+     }
      disp_num = disp_num / 10;
    }
 }
 
+void ssed_clear(int display_id) {
+   for(int i=0; i<8; i++) {
+     if(ssed_digits[display_id][i] != SSED_DIGIT_BLANK) {
+       ssed[display_id].setChar(0, i, ' ', false);
+       ssed_digits[display_id][i] = SSED_DIGIT_BLANK;
+     }
+   }
+}
+
 void ssfd_display(TM1637 tm, unsigned int num) {
   int i=0;
 
@@ -172,6 +197,21 @@ void ssfd_display(TM1637 tm, unsigned int num) {
 }
 
 
+// Current time from the cached clock, reading the RTC when it's due
+DateTime rtc_now() {
+  unsigned long since = millis() - rtc_synced;
+
+  if(!rtc_valid || (since >= RTC_RESYNC_MS)) {
+    rtc_seconds = rtc.now().unixtime();
+    rtc_synced = millis();
+    rtc_valid = true;
+    since = 0;
+  }
+
+  return DateTime(rtc_seconds + (since / 1000));
+}
+
+
 // Enable or disable buzzer w/ HIGH or LOW
 // 
 void buzzer(bool state) {
@@ -290,10 +330,10 @@ void display_alarms(MyInternalState *is) {
       display_digits+=alarm;
 
       debug("SSED\t" + String(display_id) + "\tTIME\t" + String(hour_diff) + "\t" + String(min_diff) +  "\t" + String((unsigned long)display_digits));
-      ssed_display(ssed[display_id], 0, display_digits);
+      ssed_display(display_id, display_digits);
 
     }else{ // Case alarm has expired
-      ssed[display_id].clearDisplay(0);
+      ssed_clear(display_id);
 
     }
   }
@@ -315,6 +355,7 @@ void setup() {
     ssed[i].shutdown(0, false);
     ssed[i].setIntensity(0, SSED_LED_BRIGHTNESS);
     ssed[i].clearDisplay(0);
+    memset(ssed_digits[i], SSED_DIGIT_BLANK, sizeof(ssed_digits[i]));
   }
 
 
@@ -519,7 +560,7 @@ void loop() {
 
 
   if( !(loop_count%LOOP_DISPLAY_INTERVAL) || force_display) {
-    DateTime now = rtc.now();
+    DateTime now = rtc_now();
     unsigned int time_digit = 0;
     unsigned long debug_digit = 0;
 
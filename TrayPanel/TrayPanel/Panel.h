@@ -247,6 +247,427 @@ private:
 #endif // #ifdef PCF8575_SUPPORT
 
 
+#ifdef ADC_SUPPORT
+#include <avr/interrupt.h>
+
+// Maximum number of analog pins sampled in the background
+#ifndef ADC_MAX_CHANNELS
+#define ADC_MAX_CHANNELS 4
+#endif
+
+// Extra bits of resolution from oversampling, 4^n samples per value.
+// Anything above 3 overflows the sample counter.
+#ifndef ADC_EXTRA_BITS
+#define ADC_EXTRA_BITS 2
+#endif
+
+#if ADC_EXTRA_BITS > 3
+#error "ADC_EXTRA_BITS can't be more than 3, the sample counter is a uint8_t"
+#endif
+
+#define ADC_SAMPLES (1 << (2 * ADC_EXTRA_BITS))
+#define ANALOG_MAX ((1024L << ADC_EXTRA_BITS) - 1)
+
+/*
+ * Background ADC sampler
+ *
+ * The ADC complete interrupt walks through every registered channel,
+ * taking ADC_SAMPLES conversions of each, and stores the decimated
+ * sum. The first conversion after switching channels is thrown away
+ * while the sample and hold settles. Once running, the ADC belongs to
+ * the sampler, so analogRead() can't be used.
+ */
+uint8_t ADC_CHANNELS[ADC_MAX_CHANNELS];
+volatile uint16_t ADC_VALUES[ADC_MAX_CHANNELS];
+volatile uint8_t ADC_COUNT = 0;
+volatile uint8_t ADC_CURRENT = 0;
+volatile uint8_t ADC_SAMPLE = 0;
+volatile uint32_t ADC_SUM = 0;
+bool ADC_RUNNING = false;
+
+// Register an analog pin, returns its slot or 0xFF if we're full
+uint8_t adc_add(uint8_t pin) {
+  uint8_t i;
+  uint8_t channel = (pin >= A0) ? (pin - A0) : pin;
+
+  for (i = 0; i < ADC_COUNT; i++)
+    if (ADC_CHANNELS[i] == channel)
+      return i;
+
+  if (ADC_COUNT >= ADC_MAX_CHANNELS)
+    return 0xFF;
+
+  // Start off with a single reading, while we still own the ADC
+  ADC_VALUES[i] = ADC_RUNNING ? 0 : (analogRead(pin) << ADC_EXTRA_BITS);
+  ADC_CHANNELS[i] = channel;
+  ADC_COUNT = i + 1;
+
+  return i;
+}
+
+void adc_start() {
+  if (ADC_RUNNING || !ADC_COUNT)
+    return;
+
+  ADC_CURRENT = 0;
+  ADC_SAMPLE = 0;
+  ADC_SUM = 0;
+  ADC_RUNNING = true;
+
+  // AVcc reference, same as analogReference(DEFAULT), 125kHz ADC clock
+  ADMUX = _BV(REFS0) | (ADC_CHANNELS[0] & 0x0F);
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+uint16_t adc_read(uint8_t slot) {
+  uint16_t value;
+
+  noInterrupts();
+  value = ADC_VALUES[slot];
+  interrupts();
+
+  return value;
+}
+
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+
+  if (ADC_SAMPLE++)
+    ADC_SUM += sample;
+
+  if (ADC_SAMPLE > ADC_SAMPLES) {
+    ADC_VALUES[ADC_CURRENT] = ADC_SUM >> ADC_EXTRA_BITS;
+    ADC_SUM = 0;
+    ADC_SAMPLE = 0;
+
+    if (++ADC_CURRENT >= ADC_COUNT)
+      ADC_CURRENT = 0;
+    ADMUX = (ADMUX & 0xF0) | (ADC_CHANNELS[ADC_CURRENT] & 0x0F);
+  }
+
+  ADCSRA |= _BV(ADSC);
+}
+
+
+/*
+ * Analog pin read through the background sampler,
+ * readAnalog() returns 0 - ANALOG_MAX without waiting on the ADC
+ */
+class AnalogIOMethod : public IOMethod {
+public:
+  AnalogIOMethod(uint8_t pin)
+    : IOMethod() {
+    this->_pin = pin;
+    this->_slot = 0xFF;
+  }
+
+  bool setup() {
+    pinMode(_pin, INPUT);
+    _slot = adc_add(_pin);
+
+    return (_slot != 0xFF);
+  }
+
+  bool read() {
+    return readAnalog() > (ANALOG_MAX / 2);
+  }
+
+  int readAnalog() {
+    if (_slot == 0xFF)
+      return 0;
+
+    // Start sampling once every channel has been registered
+    adc_start();
+
+    return adc_read(_slot);
+  }
+
+  void write(bool state) {
+    // Can't write to an analog input
+  }
+
+private:
+  uint8_t _pin;
+  uint8_t _slot;
+};
+
+#else
+
+#define ANALOG_MAX 1023
+
+#endif // #ifdef ADC_SUPPORT
+
+//
+// CONFIG_SUPPORT
+// Small key/value store in EEPROM, for settings that should survive
+// a reboot. Values are read from a RAM cache, and writes are spread
+// over the whole area.
+//
+#ifdef CONFIG_SUPPORT
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+// EEPROM area, in 16 byte records, all of a 328P's 1KB by default
+#ifndef CONFIG_BASE
+#define CONFIG_BASE 0
+#endif
+#ifndef CONFIG_SLOTS
+#define CONFIG_SLOTS 64
+#endif
+
+// Keys kept, each takes 20 bytes of RAM
+#ifndef CONFIG_MAX
+#define CONFIG_MAX 8
+#endif
+
+// Milliseconds a changed value has to stay put before it's written,
+// so something like an encoder being spun costs one write, not dozens.
+// Each key settles on its own, so a busy one can't hold up the rest.
+#ifndef CONFIG_SETTLE_MS
+#define CONFIG_SETTLE_MS 5000
+#endif
+
+#if CONFIG_MAX >= CONFIG_SLOTS
+#error "CONFIG_SLOTS must be more than CONFIG_MAX"
+#endif
+
+#define CONFIG_KEY_LEN 9
+
+// Writes a record may fall behind before it's rewritten, well inside
+// the 32768 the sequence numbers can be compared over
+#define CONFIG_REFRESH 8192
+
+#define CONFIG_NIL 0xFF
+
+typedef struct config_record {
+  int32_t value;
+  uint16_t seq;
+  char key[CONFIG_KEY_LEN];  // NUL padded, not terminated when full
+  uint8_t crc;
+} config_record_t;
+
+typedef struct config_entry {
+  char key[CONFIG_KEY_LEN + 1];
+  int32_t value;
+  uint8_t slot;  // Record holding the value, CONFIG_NIL until written
+  bool dirty;
+  tick due;      // When a dirty value has settled
+} config_entry_t;
+
+/*
+ * Log structured store
+ *
+ * Every write is a whole new record, put in the next slot round the
+ * area that doesn't hold the current record of any key, so the cells
+ * wear evenly and a write cut short by a power loss (caught by the
+ * CRC) still leaves the previous value. The newest sequence number
+ * tells setup where writing left off, and which record of a key is
+ * current. A record skipped over for too long is rewritten, to keep
+ * the sequence numbers in range of each other.
+ */
+config_entry_t CONFIG[CONFIG_MAX];
+uint8_t CONFIG_COUNT = 0;
+uint8_t CONFIG_HEAD = 0;  // Next slot to try
+uint16_t CONFIG_SEQ = 0;
+
+int config_addr(uint8_t slot) {
+  return CONFIG_BASE + (slot * sizeof(config_record_t));
+}
+
+uint8_t config_crc(config_record_t* r) {
+  uint8_t* p = (uint8_t*)r;
+  uint8_t crc = 0;
+  uint8_t i;
+
+  for (i = 0; i < offsetof(config_record_t, crc); i++)
+    crc = _crc8_ccitt_update(crc, p[i]);
+
+  return crc;
+}
+
+bool config_read(uint8_t slot, config_record_t* r) {
+  EEPROM.get(config_addr(slot), *r);
+
+  // Erased cells read 0xFF
+  return (r->key[0] != '\0') && ((uint8_t)r->key[0] != 0xFF)
+         && (config_crc(r) == r->crc);
+}
+
+uint16_t config_seq(uint8_t slot) {
+  uint16_t seq;
+
+  EEPROM.get(config_addr(slot) + offsetof(config_record_t, seq), seq);
+  return seq;
+}
+
+uint8_t config_find(const char* key) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (strncmp(CONFIG[i].key, key, CONFIG_KEY_LEN) == 0)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+// Key whose current record is in slot
+uint8_t config_owner(uint8_t slot) {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (CONFIG[i].slot == slot)
+      return i;
+
+  return CONFIG_NIL;
+}
+
+uint8_t config_add(const char* key) {
+  config_entry_t* e;
+
+  if ((CONFIG_COUNT >= CONFIG_MAX) || (strlen(key) > CONFIG_KEY_LEN))
+    return CONFIG_NIL;
+
+  e = &CONFIG[CONFIG_COUNT];
+  memset(e, 0, sizeof(config_entry_t));
+  strncpy(e->key, key, CONFIG_KEY_LEN);
+  e->slot = CONFIG_NIL;
+
+  return CONFIG_COUNT++;
+}
+
+// Fill the cache, called by Panel::setup() before any component
+void config_setup() {
+  config_record_t r;
+  uint8_t newest = CONFIG_NIL;
+  uint8_t slot;
+  uint8_t i;
+
+  for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!config_read(slot, &r))
+      continue;
+
+    if ((newest == CONFIG_NIL) || ((int16_t)(r.seq - CONFIG_SEQ) > 0)) {
+      newest = slot;
+      CONFIG_SEQ = r.seq;
+    }
+
+    // Several records of a key, the newest is the one
+    i = config_find(r.key);
+    if (i == CONFIG_NIL) {
+      char key[CONFIG_KEY_LEN + 1];
+
+      memcpy(key, r.key, CONFIG_KEY_LEN);
+      key[CONFIG_KEY_LEN] = '\0';
+      i = config_add(key);
+      if (i == CONFIG_NIL)
+        continue;
+
+    } else if ((int16_t)(r.seq - config_seq(CONFIG[i].slot)) < 0) {
+      continue;
+    }
+
+    CONFIG[i].value = r.value;
+    CONFIG[i].slot = slot;
+  }
+
+  if (newest != CONFIG_NIL) {
+    CONFIG_HEAD = (newest + 1) % CONFIG_SLOTS;
+    CONFIG_SEQ++;
+  }
+}
+
+void config_write(uint8_t i) {
+  config_record_t r;
+  uint8_t* p = (uint8_t*)&r;
+  uint8_t slot;
+  uint8_t owner;
+  uint8_t b;
+  int addr;
+
+  // There's always a free slot, CONFIG_MAX is under CONFIG_SLOTS
+  for (;;) {
+    slot = CONFIG_HEAD;
+    CONFIG_HEAD = (CONFIG_HEAD + 1) % CONFIG_SLOTS;
+
+    owner = config_owner(slot);
+    if (owner == CONFIG_NIL)
+      break;
+
+    if ((uint16_t)(CONFIG_SEQ - config_seq(slot)) > CONFIG_REFRESH) {
+      CONFIG[owner].dirty = true;
+      CONFIG[owner].due = GLOBAL_TC;
+    }
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.seq = CONFIG_SEQ++;
+  strncpy(r.key, CONFIG[i].key, CONFIG_KEY_LEN);
+  r.value = CONFIG[i].value;
+  r.crc = config_crc(&r);
+
+  addr = config_addr(slot);
+  for (b = 0; b < sizeof(r); b++)
+    EEPROM.update(addr + b, p[b]);
+
+  CONFIG[i].slot = slot;
+  CONFIG[i].dirty = false;
+}
+
+// Write out one changed value that has settled. A record is 16
+// blocking EEPROM writes, about 55ms, so each loop() only pays for one.
+void config_flush() {
+  uint8_t i;
+
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (CONFIG[i].dirty && is_tc_alert(CONFIG[i].due)) {
+      config_write(i);
+      return;
+    }
+  }
+}
+
+bool config_get(const char* key, int32_t* value) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL)
+    return false;
+
+  *value = CONFIG[i].value;
+  return true;
+}
+
+// False when the key is too long, or there's no room for it.
+// now skips the settle time, the value goes out on the next loop().
+bool config_set(const char* key, int32_t value, bool now = false) {
+  uint8_t i;
+
+  if (strlen(key) > CONFIG_KEY_LEN)
+    return false;
+
+  i = config_find(key);
+  if (i == CONFIG_NIL) {
+    i = config_add(key);
+    if (i == CONFIG_NIL)
+      return false;
+
+  } else if ((CONFIG[i].value == value) && !CONFIG[i].dirty) {
+    return true;
+  }
+
+  CONFIG[i].value = value;
+  CONFIG[i].dirty = true;
+  CONFIG[i].due = now ? GLOBAL_TC : get_tc_alert(CONFIG_SETTLE_MS);
+
+  return true;
+}
+
+#endif // #ifdef CONFIG_SUPPORT
+
+
 /*
  * Components
  */
@@ -264,6 +685,7 @@ enum ComponentType {
   ssed_type,
   rtc_type,
   rgbled_type,
+  motion_type,
   loglcd_type,
   panel_type
 };
@@ -294,6 +716,8 @@ const char* getCTypeName(ComponentType type) {
       return "RTC";
     case rgbled_type:
       return "RGBLED";
+    case motion_type:
+      return "MOTION";
     case loglcd_type:
       return "LOGLCD";
     case panel_type:
@@ -320,6 +744,36 @@ public:
     this->id = (char*)id;
     this->type = type;
   }
+
+#ifdef CONFIG_SUPPORT
+  // Keep a value over a reboot, under the component's id, or
+  // "<id>.<n>" for one of several. Written once it has settled.
+  bool persist(int32_t value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_set(key, value);
+  }
+
+  // Value persisted before the last reboot, false if there isn't one
+  bool restore(int32_t* value, int8_t n = -1) {
+    char key[CONFIG_KEY_LEN + 2];
+
+    return config_key(key, sizeof(key), n) && config_get(key, value);
+  }
+
+private:
+  // False when the key would be too long
+  bool config_key(char* key, size_t len, int8_t n) {
+    int used;
+
+    if (n < 0)
+      used = snprintf(key, len, "%s", id);
+    else
+      used = snprintf(key, len, "%s.%d", id, n);
+
+    return used <= CONFIG_KEY_LEN;
+  }
+#endif
 };
 
 class InputComponent : public Component {
@@ -331,6 +785,12 @@ public:
   // Is called every iteration of loop()
   // if returns true, getMessage() is returned as an EVENT
   virtual bool poll() = 0;
+
+  // Optional runtime configuration, used by SET when
+  // no OutputComponent has a matching id
+  virtual char* set(char* args) {
+    return (char*)"ERR\tComponent doesn't support SET";
+  }
 };
 
 class OutputComponent : public Component {
@@ -1041,6 +1501,667 @@ private:
 
 #endif // #ifdef ST7920_SUPPORT
 
+//
+// MOTION_SUPPORT
+// A pair of steppers driving one load from either side, the second
+// turning the opposite way. Steps come from Timer1, so like
+// BUZZER_SUPPORT it rules out analogWrite() on pins 9 and 10 and the
+// Servo library.
+//
+#ifdef MOTION_SUPPORT
+#ifdef BUZZER_SUPPORT
+#error "MOTION_SUPPORT and BUZZER_SUPPORT both need Timer1"
+#endif
+
+#include <avr/interrupt.h>
+
+// Stored positions, slot 0 is home
+#ifndef MOTION_SLOTS
+#define MOTION_SLOTS 4
+#endif
+
+// Target for moves that run until STOP or a limit switch
+#define MOTION_JOG_STEPS 1000000L
+
+// Speed levels in the acceleration profile, up to 127
+#ifndef STEP_LEVELS
+#define STEP_LEVELS 64
+#endif
+
+// Default profile, in steps/s, steps/s/s and steps/s/s/s
+#ifndef STEP_TOP_SPEED
+#define STEP_TOP_SPEED 8000
+#endif
+#ifndef STEP_ACCEL
+#define STEP_ACCEL 16000
+#endif
+#ifndef STEP_JERK
+#define STEP_JERK 100000UL
+#endif
+
+// Timer1 runs at F_CPU / 8
+#define STEP_TICK_HZ (F_CPU / 8)
+
+/*
+ * Step generator
+ *
+ * The profile splits 0 to the top speed into STEP_LEVELS even levels.
+ * Each level has its step interval in timer ticks, and how many steps
+ * to dwell there before moving on, which sets the acceleration. The
+ * ISR only counts.
+ *
+ * At the end of each level the ISR climbs one level if there's still
+ * room to come back down, stays if there's room to stay, and otherwise
+ * drops one. STEP_BRAKE keeps the steps it takes to get from the
+ * current level back to a stop, so a move never has to be planned
+ * step by step, and can be cut short or lengthened on the fly.
+ *
+ * STEP_CAP is the level count the ISR may climb to. The dwells are
+ * shaped for it as an S-curve: acceleration builds up at the jerk
+ * limit leaving the bottom, and eases off the same way nearing the
+ * cap, so the motors never see a step change in acceleration.
+ *
+ * Everything is integer. The interval and the acceleration k levels
+ * from either end of a ramp are worked out once by step_profile().
+ * Shaping for a new cap only redoes the dwells, into the spare one of
+ * two buffers, which is swapped in between steps. That's how the
+ * speed can change mid-move, and how a move too short to reach the
+ * requested speed gets a gentle peak of its own.
+ *
+ * loop() only hands over targets, and the step rate doesn't depend
+ * on it at all.
+ */
+uint16_t STEP_INTERVAL[STEP_LEVELS];
+uint16_t STEP_RATE[STEP_LEVELS];  // Acceleration k levels from an end
+uint16_t STEP_SHAPES[2][STEP_LEVELS];
+uint16_t* STEP_DWELL = STEP_SHAPES[0];
+uint16_t STEP_DV16 = 0;           // Speed between levels, 1/16 steps/s
+
+uint8_t STEP_SPEED_CAP = STEP_LEVELS;  // From the requested speed
+uint8_t STEP_MOVE_CAP = STEP_LEVELS;   // Highest the move can peak at
+uint8_t STEP_SHAPED = 0xFF;            // Cap STEP_DWELL is shaped for
+
+volatile uint8_t* STEP_PORT_L = NULL;
+volatile uint8_t* STEP_PORT_R = NULL;
+uint8_t STEP_MASK_L = 0;
+uint8_t STEP_MASK_R = 0;
+
+volatile int32_t STEP_POS = 0;    // Position, left motor's way round
+volatile uint32_t STEP_LEFT = 0;  // Steps to go, 0 when idle
+volatile uint32_t STEP_BRAKE = 0;
+volatile uint8_t STEP_CAP = 0;    // Highest level + 1, 0 to hold
+int8_t STEP_DIR = 1;
+uint8_t STEP_LEVEL = 0;
+uint16_t STEP_COUNT = 0;          // Steps taken on this level
+
+void step_timer_off() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+}
+
+void step_timer_on() {
+  OCR1A = STEP_INTERVAL[STEP_LEVEL];
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A);
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11);
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+bool step_paused() {
+  return !(TIMSK1 & _BV(OCIE1A));
+}
+
+uint16_t step_isqrt(uint32_t x) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > x)
+    bit >>= 2;
+
+  while (bit) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+// Acceleration at v steps/s, starting from rest at the jerk limit.
+// v = a^2 / (2 * jerk) until a reaches accel, so a = sqrt(2 * jerk * v)
+uint16_t step_accel(uint16_t accel, uint32_t jerk, uint32_t v) {
+  if (v >= (((uint32_t)accel * accel) >> 1) / jerk)
+    return accel;
+
+  return max(step_isqrt(2 * jerk * v), 1);
+}
+
+// Steps to spend on level i, when climbing to cap
+uint16_t step_dwell(uint8_t i, uint8_t cap) {
+  uint16_t rate = STEP_RATE[i];
+  uint32_t v = ((uint32_t)STEP_DV16 * (i + 1)) >> 4;
+  uint32_t n;
+
+  // Easing into the cap from below, or back down onto it from above
+  if (i + 1 < cap)
+    rate = min(rate, STEP_RATE[cap - 2 - i]);
+  else if (i >= cap)
+    rate = min(rate, STEP_RATE[i - cap]);
+
+  // Gaining one level takes dv / rate seconds, at v steps/s
+  // setProfile() turns down profiles that won't fit
+  n = (((v * STEP_DV16) >> 4) + (rate >> 1)) / rate;
+  return constrain(n, 1, 0xFFFF);
+}
+
+// Steps to climb from a stop to the top of cap, and so to come back
+uint32_t step_climb(uint8_t cap) {
+  uint32_t steps = 0;
+  uint8_t i;
+
+  for (i = 0; i + 1 < cap; i++)
+    steps += step_dwell(i, cap);
+
+  return steps;
+}
+
+// Shape the spare dwells for cap and swap them in
+void step_shape(uint8_t cap) {
+  uint16_t* dwell;
+  uint8_t sreg;
+  uint32_t brake = 0;
+  uint8_t i;
+
+  if (cap == STEP_SHAPED)
+    return;
+
+  dwell = (STEP_DWELL == STEP_SHAPES[0]) ? STEP_SHAPES[1] : STEP_SHAPES[0];
+  for (i = 0; i < STEP_LEVELS; i++)
+    dwell[i] = step_dwell(i, cap);
+
+  // The way down from the current level changed along with it
+  sreg = SREG;
+  cli();
+  for (i = 0; i < STEP_LEVEL; i++)
+    brake += dwell[i];
+
+  STEP_DWELL = dwell;
+  STEP_BRAKE = brake;
+  STEP_CAP = cap;
+  SREG = sreg;
+
+  STEP_SHAPED = cap;
+}
+
+// Integer only, must be called while idle
+void step_profile(uint16_t accel, uint16_t top, uint32_t jerk) {
+  uint32_t x;
+  uint8_t i;
+
+  STEP_DV16 = ((uint32_t)top << 4) / STEP_LEVELS;
+
+  for (i = 0; i < STEP_LEVELS; i++) {
+    x = (STEP_TICK_HZ << 4) / ((uint32_t)STEP_DV16 * (i + 1));
+    STEP_INTERVAL[i] = min(x, 0xFFFFUL);
+
+    // At the speed half way through level k
+    x = ((uint32_t)STEP_DV16 * (2 * i + 1)) >> 5;
+    STEP_RATE[i] = step_accel(accel, jerk, x);
+  }
+
+  STEP_SHAPED = 0xFF;
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+}
+
+// Highest speed to climb to, 0 ramps down and holds the move
+void step_speed(uint16_t speed) {
+  uint32_t fastest;
+  uint8_t level = 0;
+
+  if (speed) {
+    fastest = STEP_TICK_HZ / speed;
+
+    // Every level no quicker than speed, and at least the first
+    while ((level < STEP_LEVELS) && (STEP_INTERVAL[level] >= fastest))
+      level++;
+
+    if (!level)
+      level = 1;
+  }
+
+  STEP_SPEED_CAP = level;
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+
+  if (STEP_CAP && STEP_LEFT && step_paused())
+    step_timer_on();
+}
+
+// Highest cap a move of dist steps can climb to and still stop
+uint8_t step_peak(uint32_t dist) {
+  uint8_t lo = 1;
+  uint8_t hi = STEP_SPEED_CAP ? STEP_SPEED_CAP : STEP_LEVELS;
+  uint8_t mid;
+
+  if ((2 * step_climb(hi)) <= dist)
+    return STEP_LEVELS;
+
+  while (lo + 1 < hi) {
+    mid = (lo + hi) / 2;
+    if ((2 * step_climb(mid)) <= dist)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+// Steps it takes to stop from here, call with interrupts off
+uint32_t step_brake() {
+  return STEP_BRAKE + STEP_DWELL[STEP_LEVEL] - STEP_COUNT;
+}
+
+// Ramp down to a stop as soon as possible
+void step_stop() {
+  uint8_t sreg = SREG;
+  uint32_t brake;
+
+  cli();
+  if (step_paused()) {
+    STEP_LEFT = 0;
+  } else {
+    brake = step_brake();
+    if (STEP_LEFT > brake)
+      STEP_LEFT = brake;
+  }
+  SREG = sreg;
+}
+
+// Stop dead, safe to call from another interrupt
+void step_halt() {
+  step_timer_off();
+  STEP_LEFT = 0;
+
+  *STEP_PORT_L &= ~STEP_MASK_L;
+  *STEP_PORT_R &= ~STEP_MASK_R;
+}
+
+int32_t step_position() {
+  uint8_t sreg = SREG;
+  int32_t pos;
+
+  cli();
+  pos = STEP_POS;
+  SREG = sreg;
+
+  return pos;
+}
+
+void step_zero() {
+  uint8_t sreg = SREG;
+
+  cli();
+  STEP_POS = 0;
+  SREG = sreg;
+}
+
+bool step_running() {
+  uint8_t sreg = SREG;
+  bool running;
+
+  cli();
+  running = (STEP_LEFT != 0);
+  SREG = sreg;
+
+  return running;
+}
+
+// Head for target, false when the motors must stop first because
+// they're going the other way, or can't stop in time
+bool step_move(int32_t target, uint8_t dir_l, uint8_t dir_r) {
+  uint8_t sreg = SREG;
+  int32_t dist;
+  int8_t dir;
+
+  cli();
+  dist = target - STEP_POS;
+  dir = (dist < 0) ? -1 : 1;
+  if (dist < 0)
+    dist = -dist;
+
+  if (STEP_LEFT) {
+    if (step_paused())
+      STEP_LEFT = 0;
+    else if ((dir != STEP_DIR) || ((uint32_t)dist < step_brake())) {
+      SREG = sreg;
+      step_stop();
+      return false;
+    } else {
+      STEP_LEFT = dist;
+      SREG = sreg;
+
+      // Already on its way, the ISR keeps it able to stop
+      STEP_MOVE_CAP = STEP_LEVELS;
+      step_shape(STEP_SPEED_CAP);
+      return true;
+    }
+  }
+  SREG = sreg;
+
+  if (!dist)
+    return true;
+
+  // Mirrored, so the right motor's DIR is the opposite level
+  digitalWrite(dir_l, (dir > 0) ? HIGH : LOW);
+  digitalWrite(dir_r, (dir > 0) ? LOW : HIGH);
+
+  STEP_DIR = dir;
+  STEP_LEVEL = 0;
+  STEP_COUNT = 0;
+  STEP_BRAKE = 0;
+
+  STEP_MOVE_CAP = step_peak(dist);
+  step_shape(min(STEP_SPEED_CAP, STEP_MOVE_CAP));
+  STEP_LEFT = dist;
+
+  if (STEP_CAP)
+    step_timer_on();
+
+  return true;
+}
+
+ISR(TIMER1_COMPA_vect) {
+  uint8_t level = STEP_LEVEL;
+
+  // Pins go low again at the end, the work in between
+  // is longer than the pulse drivers need
+  *STEP_PORT_L |= STEP_MASK_L;
+  *STEP_PORT_R |= STEP_MASK_R;
+
+  STEP_POS += STEP_DIR;
+
+  if (!--STEP_LEFT) {
+    step_timer_off();
+    delayMicroseconds(2);
+
+  } else if (++STEP_COUNT >= STEP_DWELL[level]) {
+    STEP_COUNT = 0;
+
+    if (level >= STEP_CAP) {
+      // Over the cap, or holding
+      if (level) {
+        level--;
+        STEP_BRAKE -= STEP_DWELL[level];
+      } else {
+        step_timer_off();
+      }
+    } else if ((level + 1 < STEP_CAP)
+               && (STEP_LEFT >= (uint32_t)STEP_BRAKE + STEP_DWELL[level] + STEP_DWELL[level + 1])) {
+      STEP_BRAKE += STEP_DWELL[level];
+      level++;
+    } else if ((STEP_LEFT < (uint32_t)STEP_BRAKE + STEP_DWELL[level]) && level) {
+      level--;
+      STEP_BRAKE -= STEP_DWELL[level];
+    }
+
+    STEP_LEVEL = level;
+    OCR1A = STEP_INTERVAL[level];
+  }
+
+  *STEP_PORT_L &= ~STEP_MASK_L;
+  *STEP_PORT_R &= ~STEP_MASK_R;
+}
+
+
+enum MotionState {
+  motion_idle,
+  motion_moving,
+  motion_homing,
+  motion_limit
+};
+
+class MotionComponent : public OutputComponent {
+public:
+  MotionComponent(const char* id, uint8_t step_l, uint8_t dir_l, uint8_t step_r, uint8_t dir_r)
+    : OutputComponent(id, motion_type) {
+    this->_step_l = step_l;
+    this->_dir_l = dir_l;
+    this->_step_r = step_r;
+    this->_dir_r = dir_r;
+    this->_state = motion_idle;
+    this->_hit = false;
+    this->_pending = false;
+    this->_target = 0;
+    memset(this->_slots, 0, sizeof(this->_slots));
+  }
+
+  // MOVE FWD|BACK|<steps>, STOP, GOTO <slot>, or SAVE <slot>
+  char* set(char* args) {
+    char* cmd;
+    char* params = NULL;
+    char* value;
+
+    cmd = args ? pop_token(args, &params) : NULL;
+    if (!cmd)
+      return (char*)"ERR MOTION SET wanted MOVE, STOP, GOTO or SAVE";
+
+    if (strcasecmp(cmd, "STOP") == 0) {
+      stop();
+      return (char*)"ACK";
+    }
+
+    value = params ? pop_token(params, NULL) : NULL;
+
+    if (strcasecmp(cmd, "MOVE") == 0) {
+      if (!value)
+        return (char*)"ERR MOTION MOVE wanted FWD, BACK or steps";
+
+      if (strcasecmp(value, "FWD") == 0)
+        jog(1);
+      else if (strcasecmp(value, "BACK") == 0)
+        jog(-1);
+      else
+        moveTo(position() + atol(value));
+
+      return (char*)"ACK";
+    }
+
+    if (strcasecmp(cmd, "GOTO") == 0) {
+      if (!value)
+        return (char*)"ERR MOTION GOTO wanted a slot";
+
+      if (!gotoSlot(atoi(value)))
+        return (char*)"ERR MOTION GOTO slot out of range";
+
+      return (char*)"ACK";
+    }
+
+    if (strcasecmp(cmd, "SAVE") == 0) {
+      if (!value)
+        return (char*)"ERR MOTION SAVE wanted a slot";
+
+      if (!saveSlot(atoi(value)))
+        return (char*)"ERR MOTION SAVE slot out of range";
+
+      return (char*)"ACK";
+    }
+
+    return (char*)"ERR MOTION SET wanted MOVE, STOP, GOTO or SAVE";
+  }
+
+  // Steps come from the timer, this only follows up on them
+  void update() {
+    if (_hit) {
+      _hit = false;
+      _pending = false;
+      _state = motion_limit;
+      return;
+    }
+
+    if (((_state != motion_moving) && (_state != motion_homing))
+        || step_running())
+      return;
+
+    // Stopped to turn round, now head for the real target
+    if (_pending) {
+      _pending = false;
+      step_move(_target, _dir_l, _dir_r);
+      return;
+    }
+
+    _state = motion_idle;
+  }
+
+  void getMessage(char* buf) {
+    const char* state;
+
+    switch (_state) {
+      case motion_moving:
+        state = "MOVE";
+        break;
+      case motion_homing:
+        state = "HOME";
+        break;
+      case motion_limit:
+        state = "LIMIT";
+        break;
+      default:
+        state = "IDLE";
+    }
+
+    sprintf(buf, "%s\t%s\t%s\t%ld", id, getCTypeName(type), state, position());
+  }
+
+  bool setup() {
+#ifdef CONFIG_SUPPORT
+    uint8_t n;
+
+    for (n = 1; n < MOTION_SLOTS; n++)
+      restore(&_slots[n], n);
+#endif
+
+    pinMode(_step_l, OUTPUT);
+    pinMode(_dir_l, OUTPUT);
+    pinMode(_step_r, OUTPUT);
+    pinMode(_dir_r, OUTPUT);
+    digitalWrite(_step_l, LOW);
+    digitalWrite(_step_r, LOW);
+
+    STEP_PORT_L = portOutputRegister(digitalPinToPort(_step_l));
+    STEP_MASK_L = digitalPinToBitMask(_step_l);
+    STEP_PORT_R = portOutputRegister(digitalPinToPort(_step_r));
+    STEP_MASK_R = digitalPinToBitMask(_step_r);
+
+    step_profile(STEP_ACCEL, STEP_TOP_SPEED, STEP_JERK);
+    return true;
+  }
+
+  // Called from the limit switch interrupt, which also marks zero
+  void limit() {
+    step_halt();
+    STEP_POS = 0;
+    _hit = true;
+  }
+
+  void moveTo(int32_t pos) {
+    _target = pos;
+    _state = motion_moving;
+    _pending = !step_move(pos, _dir_l, _dir_r);
+  }
+
+  // Run one way until stop() or a limit switch
+  void jog(int8_t dir) {
+    moveTo((dir > 0) ? MOTION_JOG_STEPS : -MOTION_JOG_STEPS);
+  }
+
+  // Ramps down, update() goes idle once it's done
+  void stop() {
+    _pending = false;
+    step_stop();
+  }
+
+  // Steps per second per second, steps per second and steps per
+  // second per second per second, for motors that can do better
+  // than the defaults. Follow with setSpeed().
+  bool setProfile(uint16_t accel, uint16_t top, uint32_t jerk) {
+    uint16_t dv16 = ((uint32_t)top << 4) / STEP_LEVELS;
+
+    if (step_running() || !accel || (top < STEP_LEVELS) || !jerk)
+      return false;
+
+    // The longest dwell is easing into the top level, at the first
+    // level's acceleration. Too long to count and the ramp gets cut.
+    if ((((uint32_t)top * dv16) >> 4) / step_accel(accel, jerk, dv16 >> 5) > 0xFFFF)
+      return false;
+
+    step_profile(accel, top, jerk);
+    return true;
+  }
+
+  // Steps per second, takes effect mid-move
+  void setSpeed(uint16_t speed) {
+    step_speed(speed);
+  }
+
+  int32_t position() {
+    return step_position();
+  }
+
+  // Slot 0 homes against the limit switch
+  bool gotoSlot(uint8_t n) {
+    if (n >= MOTION_SLOTS)
+      return false;
+
+    if (n == 0) {
+      jog(-1);
+      _state = motion_homing;
+    } else {
+      moveTo(_slots[n]);
+    }
+    return true;
+  }
+
+  int32_t getSlot(uint8_t n) {
+    return (n < MOTION_SLOTS) ? _slots[n] : 0;
+  }
+
+  void setSlot(uint8_t n, int32_t pos) {
+    if (n < MOTION_SLOTS)
+      _slots[n] = pos;
+  }
+
+  // Store the current position in a slot, kept over a reboot
+  // with CONFIG_SUPPORT
+  bool saveSlot(uint8_t n) {
+    if (!n || (n >= MOTION_SLOTS))
+      return false;
+
+    _slots[n] = position();
+#ifdef CONFIG_SUPPORT
+    persist(_slots[n], n);
+#endif
+    return true;
+  }
+
+private:
+  uint8_t _step_l;
+  uint8_t _dir_l;
+  uint8_t _step_r;
+  uint8_t _dir_r;
+  MotionState _state;
+  volatile bool _hit;
+  bool _pending;
+  int32_t _target;
+  int32_t _slots[MOTION_SLOTS];
+};
+
+#endif // #ifdef MOTION_SUPPORT
+
 class RGBLedComponent : public OutputComponent {
 public:
   RGBLedComponent(const char* id, IOMethod* red_method, IOMethod* green_method, IOMethod* blue_method)
@@ -1198,29 +2319,149 @@ private:
 };
 
 
+// Default deadband, in 10-bit ADC steps
+#ifndef POT_THRESHOLD
+#define POT_THRESHOLD 3
+#endif
+
+enum PotFilter {
+  potf_none,
+  potf_ema,
+  potf_median
+};
+
+/*
+ * Analog input, run through a small pipeline before it's reported
+ *
+ *   filter   - NONE, EMA <shift> (new = old + (x - old) / 2^shift),
+ *              or MEDIAN of the last 3 samples
+ *   deadband - raw change needed before a new value is accepted,
+ *              so reversing direction has to cross the whole band
+ *   range    - fixed-point mapping of 0-ANALOG_MAX onto <min> <max>
+ *   interval - minimum milliseconds between EVENTs
+ *
+ * All are configurable at runtime, ex. "SET SPEED FILTER EMA 3"
+ */
 class PotComponent : public InputComponent {
 public:
   PotComponent(const char* id, IOMethod* method)
     : InputComponent(id, pot_type) {
     this->_method = method;
+    this->_filter = potf_none;
+    this->_ema_shift = 2;
+    this->_deadband = POT_THRESHOLD * ((ANALOG_MAX + 1) / 1024);
+    this->_interval = 0;
+    this->_timer = 0;
+    this->_primed = false;
+    this->_state = 0;
+    setRange(0, ANALOG_MAX);
   }
 
   bool poll() {
-    int new_state = _method->readAnalog();
-    if (((_state - new_state) > 3)
-        || ((new_state - _state) > 3)) {
-      _state = new_state;
-      return true;
+    int32_t mapped;
+    int new_state = filter(_method->readAnalog());
+
+    if ((((_state - new_state) <= _deadband)
+         && ((new_state - _state) <= _deadband))
+        || (_interval && !is_tc_alert(_timer)))
+      return false;
+
+    _state = new_state;
+    _timer = get_tc_alert(_interval);
+
+    // Several raw values can land on the same output value
+    mapped = getMapped();
+    if (mapped == _mapped)
+      return false;
+
+    _mapped = mapped;
+    return true;
+  }
+
+  char* set(char* args) {
+    char* opt;
+    char* params = NULL;
+
+    if (!args || !(opt = pop_token(args, &params)))
+      return (char*)"ERR\tSET wanted FILTER, DEADBAND, RANGE or INTERVAL";
+
+    if (strcasecmp(opt, "FILTER") == 0) {
+      char* mode = params ? pop_token(params, &params) : NULL;
+
+      if (!mode)
+        return (char*)"ERR\tSET FILTER wanted NONE, EMA or MEDIAN";
+
+      if (strcasecmp(mode, "NONE") == 0) {
+        _filter = potf_none;
+      } else if (strcasecmp(mode, "MEDIAN") == 0) {
+        _filter = potf_median;
+      } else if (strcasecmp(mode, "EMA") == 0) {
+        if (params && *params)
+          _ema_shift = constrain(atoi(params), 1, 8);
+        _filter = potf_ema;
+      } else {
+        return (char*)"ERR\tSET FILTER wanted NONE, EMA or MEDIAN";
+      }
+
+      _primed = false;
+      return (char*)"ACK";
     }
-    return false;
+
+    if (strcasecmp(opt, "DEADBAND") == 0) {
+      if (!params || !*params)
+        return (char*)"ERR\tSET DEADBAND wanted a value";
+
+      _deadband = atoi(params);
+      return (char*)"ACK";
+    }
+
+    if (strcasecmp(opt, "RANGE") == 0) {
+      char* min_str = params ? pop_token(params, &params) : NULL;
+      char* max_str = params ? pop_token(params, NULL) : NULL;
+
+      if (!min_str || !max_str)
+        return (char*)"ERR\tSET RANGE wanted min and max";
+
+      if (!setRange(atoi(min_str), atoi(max_str)))
+        return (char*)"ERR\tSET RANGE span must be under 32768";
+
+      _mapped = getMapped();
+      return (char*)"ACK";
+    }
+
+    if (strcasecmp(opt, "INTERVAL") == 0) {
+      if (!params || !*params)
+        return (char*)"ERR\tSET INTERVAL wanted milliseconds";
+
+      _interval = atol(params);
+      return (char*)"ACK";
+    }
+
+    return (char*)"ERR\tSET wanted FILTER, DEADBAND, RANGE or INTERVAL";
   }
 
   void getMessage(char* buf) {
-    sprintf(buf, "%s\t%s\t%d", id, getCTypeName(type), _state);
+    sprintf(buf, "%s\t%s\t%ld", id, getCTypeName(type), _mapped);
+  }
+
+  // Map the output range onto min-max, in 16.16 fixed-point
+  bool setRange(int16_t out_min, int16_t out_max) {
+    int32_t span = (int32_t)out_max - out_min;
+
+    if ((span > 32767) || (span < -32767))
+      return false;
+
+    _out_min = out_min;
+    _scale = (span << 16) / ANALOG_MAX;
+    return true;
+  }
+
+  int32_t getMapped() {
+    return _out_min + (((int32_t)_state * _scale) >> 16);
   }
 
   float getValue() {
-    return (float)_state / 1024;
+    return (float)_state / (ANALOG_MAX + 1);
   }
 
   bool setup() {
@@ -1231,6 +2472,51 @@ public:
 private:
   IOMethod* _method;
   int _state;
+  int32_t _mapped = 0;
+
+  PotFilter _filter;
+  uint8_t _ema_shift;
+  int32_t _ema;  // 4 fractional bits
+  int _history[3];
+  bool _primed;
+
+  int _deadband;
+  int16_t _out_min;
+  int32_t _scale;
+  uint32_t _interval;
+  tick _timer;
+
+  int filter(int x) {
+    if (!_primed) {
+      _ema = (int32_t)x << 4;
+      _history[0] = _history[1] = _history[2] = x;
+      _primed = true;
+    }
+
+    if (_filter == potf_ema) {
+      _ema += (((int32_t)x << 4) - _ema) >> _ema_shift;
+      return (int)(_ema >> 4);
+    }
+
+    if (_filter == potf_median) {
+      int a;
+      int b;
+      int c;
+
+      _history[0] = _history[1];
+      _history[1] = _history[2];
+      _history[2] = x;
+      a = _history[0];
+      b = _history[1];
+      c = _history[2];
+
+      if (a > b) { int t = a; a = b; b = t; }
+      if (b > c) { b = c; }
+      return (a > b) ? a : b;
+    }
+
+    return x;
+  }
 };
 
 
@@ -1333,10 +2619,14 @@ public:
   OutputComponent** outputs;
   char buf[SERIAL_BUFFER_SIZE];
 
+  // Optional binding, called with each input that raised an EVENT
+  void (*on_event)(InputComponent*);
+
   Panel(const char* id, InputComponent** inputs, OutputComponent** outputs)
     : Component(id, panel_type) {
     this->inputs = inputs;
     this->outputs = outputs;
+    this->on_event = NULL;
   }
 
   void getMessage(char* buf) {
@@ -1346,6 +2636,11 @@ public:
   bool setup() {
     int i;
 
+#ifdef CONFIG_SUPPORT
+    // Components restore their settings in setup()
+    config_setup();
+#endif
+
     for (i = 0; inputs[i]; i++)
       if (!inputs[i]->setup())
         return false;
@@ -1377,6 +2672,9 @@ char* com_prot_desc(Panel*, char*);
 char* com_prot_ping(Panel*, char*);
 char* com_prot_set(Panel*, char*);
 char* com_prot_get(Panel*, char*);
+#ifdef CONFIG_SUPPORT
+char* com_prot_config(Panel*, char*);
+#endif
 
 /* List of commands */
 cmd_t command[] = {
@@ -1386,6 +2684,9 @@ cmd_t command[] = {
   { "DESC", com_prot_desc },
   { "SET", com_prot_set },
   { "GET", com_prot_get },
+#ifdef CONFIG_SUPPORT
+  { "CONFIG", com_prot_config },
+#endif
   { 0, 0 }
 };
 
@@ -1434,6 +2735,9 @@ bool Panel::loop() {
       inputs[i]->getMessage(buf + 6);
       Serial.println(buf);
       Serial.flush();
+
+      if (on_event)
+        on_event(inputs[i]);
     }
   }
 
@@ -1441,6 +2745,11 @@ bool Panel::loop() {
   for (i = 0; outputs[i]; i++)
     outputs[i]->update();
 
+#ifdef CONFIG_SUPPORT
+  // Write out settings that have stopped changing
+  config_flush();
+#endif
+
   // Check Serial
   if (Serial.available() > 0) {
     char* cmd;
@@ -1536,8 +2845,13 @@ char* com_prot_set(Panel* panel, char* args) {
 
   if (panel->outputs[i])
     return panel->outputs[i]->set(params);
-  else
-    return (char*)"ERR\tComponent not found in SET command";
+
+  // Inputs can take configuration too
+  for (i = 0; panel->inputs[i]; i++)
+    if (strcasecmp(comp_name, panel->inputs[i]->id) == 0)
+      return panel->inputs[i]->set(params);
+
+  return (char*)"ERR\tComponent not found in SET command";
 }
 
 char* com_prot_get(Panel* panel, char* args) {
@@ -1565,4 +2879,60 @@ char* com_prot_get(Panel* panel, char* args) {
   return (char*)"ACK";
 }
 
+#ifdef CONFIG_SUPPORT
+// "CONFIG LIST" (or just CONFIG) prints every stored key and value,
+// "CONFIG GET <key>" one of them, and "CONFIG SET <key> <value>"
+// stores a value without waiting for it to settle. Components read
+// theirs in setup(), so a SET reaches them on the next boot.
+char* com_prot_config(Panel* panel, char* args) {
+  uint8_t i;
+  int32_t value;
+  char* opt = NULL;
+  char* key = NULL;
+  char* value_str = NULL;
+  char* params = NULL;
+
+  if (args)
+    opt = pop_token(args, &params);
+
+  if (!opt || (strcasecmp(opt, "LIST") == 0)) {
+    for (i = 0; i < CONFIG_COUNT; i++) {
+      snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", CONFIG[i].key, CONFIG[i].value);
+      Serial.println(panel->buf);
+      Serial.flush();
+    }
+
+    return (char*)"ACK";
+  }
+
+  key = params ? pop_token(params, &params) : NULL;
+
+  if (strcasecmp(opt, "GET") == 0) {
+    if (!key)
+      return (char*)"ERR\tCONFIG GET needs a key";
+
+    if (!config_get(key, &value))
+      return (char*)"ERR\tCONFIG key not found";
+
+    snprintf(panel->buf, (SERIAL_BUFFER_SIZE-3), "CONFIG\t%s\t%ld", key, value);
+    Serial.println(panel->buf);
+    Serial.flush();
+    return (char*)"ACK";
+  }
+
+  if (strcasecmp(opt, "SET") == 0) {
+    value_str = params ? pop_token(params, NULL) : NULL;
+    if (!key || !value_str)
+      return (char*)"ERR\tCONFIG SET needs key and value";
+
+    if (!config_set(key, atol(value_str), true))
+      return (char*)"ERR\tCONFIG SET key too long or store full";
+
+    return (char*)"ACK";
+  }
+
+  return (char*)"ERR\tCONFIG wanted LIST, GET or SET";
+}
+#endif
+
 #endif
@@ -1,33 +1,15 @@
+#define ADC_SUPPORT
+#define MOTION_SUPPORT
+#define CONFIG_SUPPORT // Keeps the 3 memory positions in EEPROM
 #include "Panel.h"
 
-#include <EEPROM.h> // Store 3 memory positions in EEPROM
-#include <AccelStepper.h>
-#include <MultiStepper.h>
 
-
-// Define a stepper and the pins it will use
-//
-AccelStepper stepper_left(AccelStepper::DRIVER, A0, A1); // LEFT
-AccelStepper stepper_right(AccelStepper::DRIVER, A2, A3); // RIGHT
-MultiStepper steppers;
-
-// Define stepper positions for each memory button
-// 
-int32_t button_1_pos;
-int32_t button_2_pos;
-int32_t button_3_pos;
-
-// Define an emergency exit
-//
-bool emergency_halt = false;
-
-// Define maximum number of steps per second
-#define STEPPER_MAX_SPEED 3000
-
-// Define memory address of Button positions in EEPROM
-#define BUTTON_1_EEPROM_MEM_ADDR 0
-#define BUTTON_2_EEPROM_MEM_ADDR 4 // sizeof(int32_t) * 1
-#define BUTTON_3_EEPROM_MEM_ADDR 8 // sizeof(int32_t) * 2
+// Define maximum number of steps per second, how quickly the
+// motors get there in steps per second per second, and how quickly
+// that acceleration builds up (steps per second per second per second)
+#define STEPPER_MAX_SPEED 8000
+#define STEPPER_ACCEL 16000
+#define STEPPER_JERK 100000UL
 
 // Define how long a memory button should be held down to store
 // the position in memory, versus activate the movement
@@ -40,7 +22,7 @@ bool emergency_halt = false;
 ToggleComponent* bigred_button  = new ToggleComponent("BIG_RED",  new DirectIOMethod(8, iomt_input_pullup));
 ButtonComponent* forward_button = new ButtonComponent("FORWARD",  new DirectIOMethod(7, iomt_input_pullup));
 ButtonComponent* back_button    = new ButtonComponent("BACK",     new DirectIOMethod(6, iomt_input_pullup));
-PotComponent*    speed_pot      = new PotComponent   ("SPEED",    new DirectIOMethod(A6, iomt_input));
+PotComponent*    speed_pot      = new PotComponent   ("SPEED",    new AnalogIOMethod(A6));
 ButtonComponent* button_0       = new ButtonComponent("BUTTON_0", new DirectIOMethod(9, iomt_input_pullup));
 ButtonComponent* button_1       = new ButtonComponent("BUTTON_1", new DirectIOMethod(12, iomt_input_pullup));
 ButtonComponent* button_2       = new ButtonComponent("BUTTON_2", new DirectIOMethod(10, iomt_input_pullup));
@@ -62,8 +44,12 @@ NULL
 };
 
 
+// Both steppers, STEP and DIR pins for the left one then the right
+MotionComponent* tray = new MotionComponent("TRAY", A0, A1, A2, A3);
+
 OutputComponent* outputs[] = 
 {
+tray,
 NULL
 };
 
@@ -73,17 +59,93 @@ Panel *panel = new Panel("TRAY_PANEL", inputs, outputs);
 // Interrupt function to activate when tray hits the terminator switches
 //
 void terminator() {
+  // Stop the motors dead and zero the position
+  tray->limit();
+}
+
+
+// When each memory button went down, 0 while it isn't held
+uint32_t pressed_at[MOTION_SLOTS];
+
+
+// Memory buttons act on release: a long press stores the
+// current position, a short one moves there
+//
+void memory_button(ButtonComponent* button, uint8_t slot) {
+  uint32_t held;
+
+  if (button->getValue()) {
+    pressed_at[slot] = max(millis(), 1UL);
+    return;
+  }
+
+  // A release without a press we saw, ex. pressed during an emergency
+  if (!pressed_at[slot])
+    return;
 
-  // Enable emergency halt
-  emergency_halt = true;
-  
-  // Reset position
-  stepper_left.setCurrentPosition(0);
-  stepper_right.setCurrentPosition(0);
+  held = millis() - pressed_at[slot];
+  pressed_at[slot] = 0;
 
-  // Stop motors
-  stepper_left.move(0);
-  stepper_right.move(0);
+  if (held >= BUTTON_LONG_PRESS_MS) {
+    tray->saveSlot(slot);
+  } else {
+    tray->gotoSlot(slot);
+  }
+}
+
+
+// Button bindings, called by the panel for every input EVENT
+//
+void handle_event(InputComponent* input) {
+
+  // Emergency Button
+  // Opens the tray at full speed when it turns OFF
+  if (input == bigred_button) {
+    // Presses from either side of it don't count
+    memset(pressed_at, 0, sizeof(pressed_at));
+
+    if (!bigred_button->getValue()) {
+      tray->setSpeed(STEPPER_MAX_SPEED);
+      tray->jog(-1);
+    } else {
+      tray->stop();
+      tray->setSpeed(speed_pot->getMapped());
+    }
+    return;
+  }
+
+  // Nothing else moves the tray until the emergency is over
+  if (!bigred_button->getValue())
+    return;
+
+  if (input == speed_pot) {
+    tray->setSpeed(speed_pot->getMapped());
+
+  // Forward and Back run while held down
+  } else if (input == forward_button) {
+    if (forward_button->getValue())
+      tray->jog(1);
+    else
+      tray->stop();
+
+  } else if (input == back_button) {
+    if (back_button->getValue())
+      tray->jog(-1);
+    else
+      tray->stop();
+
+  // Button 0 opens the tray until the terminator zeroes it
+  } else if (input == button_0) {
+    if (button_0->getValue())
+      tray->gotoSlot(0);
+
+  } else if (input == button_1) {
+    memory_button(button_1, 1);
+  } else if (input == button_2) {
+    memory_button(button_2, 2);
+  } else if (input == button_3) {
+    memory_button(button_3, 3);
+  }
 }
 
 
@@ -92,208 +154,30 @@ void terminator() {
 void setup() {  
   Serial.begin(115200);
 
-  // Initialize panel
+  // Initialize panel, the tray restores its memory positions
   if(!panel->setup()) {
     Serial.println("ERR Panel init failed, do something!");
     Serial.flush();
   }
+  panel->on_event = handle_event;
  
   // Register terminator switches!
   pinMode(2, INPUT_PULLUP);
   pinMode(3, INPUT_PULLUP);
   attachInterrupt(digitalPinToInterrupt(2), terminator, FALLING); // Left side
   attachInterrupt(digitalPinToInterrupt(3), terminator, FALLING); // Right side
-  emergency_halt = false;
-
-  // Init steppers, and add them to group
-  stepper_left.setMaxSpeed(STEPPER_MAX_SPEED);
-  stepper_right.setMaxSpeed(STEPPER_MAX_SPEED);
-  steppers.addStepper(stepper_left);
-  steppers.addStepper(stepper_right);
-
-  // Pull memory button values from EEPROM
-  EEPROM.get(BUTTON_1_EEPROM_MEM_ADDR, button_1_pos);
-  EEPROM.get(BUTTON_2_EEPROM_MEM_ADDR, button_2_pos);
-  EEPROM.get(BUTTON_3_EEPROM_MEM_ADDR, button_3_pos);
+
+  // Have the SPEED pot report steps per second directly
+  speed_pot->setRange(0, STEPPER_MAX_SPEED);
+  tray->setProfile(STEPPER_ACCEL, STEPPER_MAX_SPEED, STEPPER_JERK);
+  tray->setSpeed(speed_pot->getMapped());
 }
 
 
 // Main loop
 //
 void loop() {
-  static int16_t speed=0; // Store motor speed through every iteration
- 
-  // Check panel basics on every loop
+  // Buttons, pot and serial all go through the panel,
+  // the motors are stepped from Timer1
   panel->loop();
-
-  // Handle speed changes
-  if(1) {
-    int16_t new_speed = STEPPER_MAX_SPEED * speed_pot->getValue();
- 
-    if(new_speed != speed) {
-      speed = new_speed;
-      stepper_left.setMaxSpeed(speed);
-      stepper_right.setMaxSpeed(speed);
-
-      //Serial.println("DEBUG");
-      //Serial.println(speed);
-      //Serial.println(emergency_halt);
-      //Serial.println(digitalRead(2));
-      //Serial.println(digitalRead(3));
-      //Serial.println(stepper_left.currentPosition());
-    }
-    // Serial.println(speed);
-  }
-
-  // Handle Forward button
-  if(forward_button->getValue()) {
-    int32_t dist = 1000000;
-    int32_t positions[2] = {dist, (dist * -1)};
-    
-    steppers.moveTo(positions);
-
-    // Do this while the button is held down
-    while(!forward_button->poll() && !emergency_halt) {
-      steppers.run();
-    }
-    emergency_halt = false;
-  }
-
-  // Handle Back button
-  if(back_button->getValue()) {
-    int32_t dist = 1000000;
-    int32_t positions[2] = {(dist * -1), dist};
-    
-    steppers.moveTo(positions);
-
-    // Do this while the button is held down
-    while(!back_button->poll() && !emergency_halt) {
-      steppers.run();
-    }
-    emergency_halt = false;
-  }
-
-  // Emergency Button
-  // Activates when it turns OFF
-  if(!bigred_button->getValue()) {
-    int32_t dist = 1000000;
-    int32_t positions[2] = {(dist * -1), dist};
-    
-    // Set MAX speed for motors
-    stepper_left.setMaxSpeed(STEPPER_MAX_SPEED);
-    stepper_right.setMaxSpeed(STEPPER_MAX_SPEED);
-  
-    steppers.moveTo(positions);
-
-    // Do this while the button is off
-    while(!bigred_button->poll() && !emergency_halt) {
-      steppers.run();
-      // Keep doing run() until the button is unlocked
-      // Alternatively, terminator switch and interrupt may stop us as well.
-    }
-    emergency_halt = false;
-  }
-
-  // Handle Button 0 (Open)
-  // Also zero's the tray
-  if(button_0->getValue()) {
-    int32_t dist = 1000000;
-    int32_t positions[2] = {(dist * -1), dist};
-    steppers.moveTo(positions);
-
-    // Open the tray at set speed until terminator engages
-    while(!emergency_halt) {
-      steppers.run();
-    }
-    emergency_halt = false;
-  }
-
-  // Handle Button 1 (Memory)
-  if(button_1->getValue()) {
-    uint32_t start = millis();
-    uint32_t dur = 0;
-
-    while(!button_1->poll()) {
-      // Doing nothing waiting to see how long button is held down
-    }
-    dur = millis() - start;
-
-    if( dur >= BUTTON_LONG_PRESS_MS) {
-      // Long press, let's record the current position in memory
-      button_1_pos = stepper_left.currentPosition();
-      EEPROM.put(BUTTON_1_EEPROM_MEM_ADDR, button_1_pos);
-
-    }else{
-      // Short press, let's make the motors move there
-      int32_t positions[2] = {button_1_pos, (button_1_pos * -1)};
-    
-      steppers.moveTo(positions);
-
-      while(steppers.run() && !emergency_halt) {
-        // Keep doing run() until run() returns false meaning we're in position
-        // Alternatively, terminator switch and interrupt may stop us as well.
-      }
-      emergency_halt = false;
-    }
-  }
-
-  // Handle Button 2 (Memory)
-  if(button_2->getValue()) {
-    uint32_t start = millis();
-    uint32_t dur = 0;
-
-    while(!button_2->poll()) {
-      // Doing nothing waiting to see how long button is held down
-    }
-    dur = millis() - start;
-
-    if( dur >= BUTTON_LONG_PRESS_MS) {
-      // Long press, let's record the current position in memory
-      button_2_pos = stepper_left.currentPosition();
-      EEPROM.put(BUTTON_2_EEPROM_MEM_ADDR, button_2_pos);
-
-    }else{
-      // Short press, let's make the motors move there
-      int32_t positions[2] = {button_2_pos, (button_2_pos * -1)};
-    
-      steppers.moveTo(positions);
-
-      while(steppers.run() && !emergency_halt) {
-        // Keep doing run() until run() returns false meaning we're in position
-        // Alternatively, terminator switch and interrupt may stop us as well.
-      }
-      emergency_halt = false;
-    }
-  }
-
-  // Handle Button 3 (Memory)
-  if(button_3->getValue()) {
-    uint32_t start = millis();
-    uint32_t dur = 0;
-
-    while(!button_3->poll()) {
-      // Doing nothing waiting to see how long button is held down
-    }
-    dur = millis() - start;
-
-    if( dur >= BUTTON_LONG_PRESS_MS) {
-      // Long press, let's record the current position in memory
-      button_3_pos = stepper_left.currentPosition();
-      EEPROM.put(BUTTON_3_EEPROM_MEM_ADDR, button_3_pos);
-
-    }else{
-      // Short press, let's make the motors move there
-      int32_t positions[2] = {button_3_pos, (button_3_pos * -1)};
-    
-      steppers.moveTo(positions);
-
-      while(steppers.run() && !emergency_halt) {
-        // Keep doing run() until run() returns false meaning we're in position
-        // Alternatively, terminator switch and interrupt may stop us as well.
-      }
-      emergency_halt = false;
-    }
-  }
-
-  // end loop()
 }
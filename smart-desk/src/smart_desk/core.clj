@@ -1,5 +1,6 @@
 (ns smart-desk.core
   (:require [clojure.java.io :as io]
+            [clojure.string :as str]
             )
   (:import [java.net Socket SocketTimeoutException])
 
@@ -273,9 +274,9 @@
   ""
   []
   (let [{:keys [mode title]} (get-mocp-state)]
-    (cmd :music-panel :set :lcd :clr)
-    (cmd :music-panel :set :lcd 1 0 mode)
-    (cmd :music-panel :set :lcd 2 0 (apply str (take 20 title)))))
+    ;; One SCREEN write, the panel only sends the cells that changed
+    (cmd :music-panel :set :lcd :screen
+         (str mode "|" (apply str (take 20 (str/replace (str title) "|" "/")))))))
 
 (defn get-available-panels
   "Return list of available panels"